@@ -0,0 +1,494 @@
+// host benchmarks of the hot paths: frame parsing, register sweeps, the page,
+// json and cbor renderers and the history encoding. Inputs are generated from fixed
+// seeds, so two runs differ by the code and the machine only.
+//
+//   pio run -e bench && .pio/build/bench/program > after.json
+//   python3 tools/bench_compare.py before.json after.json
+//
+// BENCH_MS in the environment sets the time per repetition (default 200).
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <new>
+#include "battery.h"
+#include "config.h"
+#include "dashboard.h"
+#include "frame_parser.h"
+#include "histogram.h"
+#include "history.h"
+#include "metrics.h"
+#include "mqtt_publisher.h"
+#include "pack_stats.h"
+#include "state_cbor.h"
+#include "state_json.h"
+
+// every allocation of the process goes through here, the size is kept in front
+// of the block so delete can account for it
+namespace {
+size_t allocNow = 0;
+size_t allocPeak = 0;
+uint32_t allocCount = 0;
+}
+
+void *operator new(size_t size) {
+    size_t *block = static_cast<size_t *>(malloc(size + sizeof(size_t) * 2));
+    if (block == nullptr) throw std::bad_alloc();
+    block[0] = size;
+    allocNow += size;
+    allocPeak = std::max(allocPeak, allocNow);
+    allocCount++;
+    return block + 2;
+}
+
+void operator delete(void *ptr) noexcept {
+    if (ptr == nullptr) return;
+    size_t *block = static_cast<size_t *>(ptr) - 2;
+    allocNow -= block[0];
+    free(block);
+}
+
+void operator delete(void *ptr, size_t) noexcept {
+    operator delete(ptr);
+}
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+const int repetitions = 5;
+const byte hostAddress = 0x3D;
+
+struct Result {
+    const char *name;
+    const char *unit; // what one op is
+    uint64_t ops; // per repetition
+    double nsMin;
+    double nsMedian;
+    size_t allocPeak; // bytes, above what was allocated before the run
+    uint32_t allocs; // per op
+    size_t outBytes; // per op, 0 where nothing is produced
+};
+
+Result results[16];
+int resultCount = 0;
+unsigned long runMs = 200;
+
+uint32_t seed = 0x9e3779b9;
+
+uint32_t nextRandom() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+// runs body(iterations) in batches until runMs passed, repetitions times, and
+// keeps the fastest and the median time per op. body returns the ops it did.
+template <typename Body>
+void measure(const char *name, const char *unit, size_t outBytes, Body body) {
+    // calibrate the batch to about a tenth of runMs
+    uint64_t batch = 1;
+    for (;;) {
+        Clock::time_point start = Clock::now();
+        body(batch);
+        auto took = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - start).count();
+        if (took * 10 >= long(runMs) * 1000 || batch >= (1ULL << 40)) break;
+        batch *= 2;
+    }
+
+    double ns[repetitions];
+    uint64_t ops = 0;
+    size_t baseline = allocNow;
+    allocPeak = allocNow;
+    uint32_t allocsBefore = allocCount;
+    for (int r = 0; r < repetitions; r++) {
+        ops = 0;
+        Clock::time_point start = Clock::now();
+        Clock::time_point now;
+        do {
+            ops += body(batch);
+            now = Clock::now();
+        } while (now - start < std::chrono::milliseconds(runMs));
+        ns[r] = double(std::chrono::duration_cast<std::chrono::nanoseconds>(now - start).count()) / double(ops);
+    }
+    uint64_t totalOps = ops * repetitions; // close enough for the per op allocation count
+    std::sort(ns, ns + repetitions);
+
+    Result &res = results[resultCount++];
+    res = Result{name, unit, ops, ns[0], ns[repetitions / 2], allocPeak - baseline,
+                 uint32_t((allocCount - allocsBefore) / std::max<uint64_t>(totalOps, 1)), outBytes};
+}
+
+// a pack that looks like one in use: 10-16 cells around 3.9 V, discharging
+BatteryState sampleState(uint32_t uptime) {
+    BatteryState state{};
+    state.uptime = uptime;
+    state.status = 0;
+    state.factory_capacity = 7800;
+    state.actual_capacity = 7400;
+    state.remaining_capacity = 5180 - int16_t(uptime / 4);
+    state.remaining_capacity_perc = int16_t(state.remaining_capacity * 100 / state.actual_capacity);
+    state.current_ma = -1500 - int32_t(nextRandom() % 40) * 10;
+    int32_t sum = 0;
+    for (int16_t &mv : state.cells) {
+        mv = int16_t(3900 + nextRandom() % 25);
+        sum += mv;
+    }
+    state.voltage_mv = sum;
+    state.power_mw = (state.current_ma / 10) * (state.voltage_mv / 10) / 10;
+    state.temp_zone0 = 24;
+    state.temp_zone1 = 25;
+    strcpy(state.serial, "3NBJ1234567890");
+    state.error = BATTERY_OK;
+    return state;
+}
+
+// register image of the pack, 16 bit words as the BMS stores them
+struct RegisterImage {
+    uint16_t words[0x100]{};
+
+    explicit RegisterImage(const BatteryState &state) {
+        for (int i = 0; i < 14; i += 2) {
+            words[0x10 + i / 2] = uint16_t(byte(state.serial[i]) | (byte(state.serial[i + 1]) << 8));
+        }
+        words[0x18] = uint16_t(state.factory_capacity);
+        words[0x19] = uint16_t(state.actual_capacity);
+        words[0x30] = uint16_t(state.status);
+        words[0x31] = uint16_t(state.remaining_capacity);
+        words[0x32] = uint16_t(state.remaining_capacity_perc);
+        words[0x33] = uint16_t(state.current_ma / 10);
+        words[0x34] = uint16_t(state.voltage_mv / 10);
+        words[0x35] = uint16_t((state.temp_zone0 + 20) | ((state.temp_zone1 + 20) << 8));
+        for (size_t i = 0; i < state.cells.size(); i++) {
+            words[0x40 + i] = uint16_t(state.cells[i]);
+        }
+    }
+
+    // reply to a register read, returns the frame length
+    size_t reply(byte address, byte reg, byte len, byte *out) const {
+        out[0] = 0x5A;
+        out[1] = 0xA5;
+        out[2] = len;
+        out[3] = address;
+        out[4] = hostAddress;
+        out[5] = 0x04;
+        out[6] = reg;
+        for (byte i = 0; i < len; i++) {
+            uint16_t word = words[(reg + i / 2) & 0xFF];
+            out[7 + i] = (i & 1) ? byte(word >> 8) : byte(word & 0xFF);
+        }
+        uint16_t cs = NinebotFrameParser::checksum(out, len);
+        out[7 + len] = cs & 0xFF;
+        out[8 + len] = cs >> 8;
+        return NinebotFrame::overhead + len;
+    }
+};
+
+// what a sweep of the whole register map looks like on the wire, with a
+// corrupted frame and line noise now and then
+size_t captureStream(const RegisterImage &image, byte *out, size_t size) {
+    static const byte blocks[][2] = {{0x10, 20}, {0x30, 12}, {0x40, BATTERY_CELLS * 2}};
+    size_t pos = 0;
+    for (uint32_t n = 0; pos + 64 + NinebotFrameParser::maxFrameLen < size; n++) {
+        const byte *block = blocks[n % 3];
+        size_t len = image.reply(0x22, block[0], block[1], out + pos);
+        if (n % 16 == 15) out[pos + 7] ^= 0x01;
+        pos += len;
+        if (nextRandom() % 100 < 3) {
+            for (uint32_t junk = nextRandom() % 8 + 1; junk > 0; junk--) out[pos++] = byte(nextRandom());
+        }
+    }
+    return pos;
+}
+
+void benchParser(const RegisterImage &image) {
+    static byte stream[64 * 1024];
+    size_t len = captureStream(image, stream, sizeof(stream));
+    NinebotFrameParser parser;
+    size_t frames = 0;
+
+    // uart sized chunks, every frame is taken out right after the chunk that completed it
+    measure("parser_stream", "byte", 0, [&](uint64_t n) {
+        uint64_t done = 0;
+        for (uint64_t i = 0; i < n; i++) {
+            parser.reset();
+            for (size_t pos = 0; pos < len;) {
+                size_t take = parser.feed(stream + pos, std::min<size_t>(32, len - pos));
+                pos += take;
+                NinebotFrame frame;
+                while (parser.next(frame)) frames++;
+            }
+            done += len;
+        }
+        return done;
+    });
+    if (frames == 0) fprintf(stderr, "parser found no frames\n");
+
+    measure("checksum", "byte", 0, [&](uint64_t n) {
+        volatile uint16_t sink = 0;
+        for (uint64_t i = 0; i < n; i++) sink = sink + NinebotFrameParser::checksum(stream, 120);
+        return n * 120;
+    });
+}
+
+template <typename Source>
+size_t drain(Source &source, char *buf, size_t chunk) {
+    size_t total = 0;
+    size_t len;
+    while ((len = source.read(buf, chunk)) > 0) total += len;
+    return total;
+}
+
+// the listener on its own, with every field of the sample fresh
+void benchStats(PackStats &stats) {
+    BatteryState states[64];
+    for (uint32_t i = 0; i < 64; i++) states[i] = sampleState(i);
+
+    measure("stats_add", "sample", 0, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) stats.add(states[i & 63]);
+        return n;
+    });
+
+    char buf[256];
+    size_t outBytes;
+    {
+        StatsSource body(stats);
+        outBytes = drain(body, buf, sizeof(buf));
+    }
+    measure("stats_json", "body", outBytes, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            StatsSource body(stats);
+            drain(body, buf, sizeof(buf));
+        }
+        return n;
+    });
+}
+
+// full register sweeps through BatteryMonitor over a pty, answered from here.
+// Includes the pty round trips, so the figure is an upper bound of the decode cost.
+void benchSweep(const RegisterImage &image, const LatencyHistogram &loopTime) {
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        fprintf(stderr, "no pty, sweep skipped\n");
+        return;
+    }
+    fcntl(master, F_SETFL, O_NONBLOCK);
+    static char slavePath[64];
+    strncpy(slavePath, ptsname(master), sizeof(slavePath) - 1);
+
+    PosixSerial serial(slavePath);
+    BatteryMonitor monitor(serial, false);
+    BatteryState state{};
+    byte request[64];
+    size_t requestLen = 0;
+    byte reply[NinebotFrameParser::maxFrameLen];
+
+    auto answer = [&]() {
+        ssize_t got = read(master, request + requestLen, sizeof(request) - requestLen);
+        if (got <= 0) return;
+        requestLen += size_t(got);
+        while (requestLen >= 2 && (request[0] != 0x5A || request[1] != 0xA5)) {
+            memmove(request, request + 1, --requestLen);
+        }
+        if (requestLen < 3 || requestLen < NinebotFrame::overhead + request[2]) return;
+        size_t frameLen = NinebotFrame::overhead + request[2];
+        size_t len = image.reply(request[4], request[6], request[7], reply);
+        if (write(master, reply, len) != ssize_t(len)) fprintf(stderr, "short pty write\n");
+        memmove(request, request + frameLen, requestLen - frameLen);
+        requestLen -= frameLen;
+    };
+
+    measure("monitor_sweep", "sweep", 0, [&](uint64_t n) {
+        uint64_t done = 0;
+        for (uint64_t i = 0; i < n; i++) {
+            monitor.beginRead(BatteryMonitor::allFields, 0);
+            BatteryMonitor::TransactionStatus status;
+            while ((status = monitor.pollRead(state, 0)) == BatteryMonitor::TX_PENDING) answer();
+            if (status == BatteryMonitor::TX_DONE) done++;
+        }
+        return done;
+    });
+    if (state.cells[0] != image.words[0x40]) fprintf(stderr, "sweep decoded the wrong values\n");
+
+    // one real sample, so the poller knows which fields it read
+    BatteryPoller poller;
+    BatteryState snapshot{};
+    poller.attach(monitor, snapshot, 0);
+    PackStats stats(poller);
+    for (int tries = 0; tries < 100000 && !poller.hasSample(); tries++) {
+        poller.update();
+        answer();
+    }
+    if (poller.lastFields() != BatteryMonitor::allFields) fprintf(stderr, "poller sample incomplete\n");
+
+    benchStats(stats);
+
+    // the monitor is only around here, /metrics needs its counters
+    char line[256];
+    size_t outBytes;
+    {
+        MetricsSource body(monitor, poller, stats, loopTime);
+        outBytes = drain(body, line, sizeof(line));
+    }
+    // sendStream() hands out 256 byte chunks
+    measure("metrics_body", "body", outBytes, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            MetricsSource body(monitor, poller, stats, loopTime);
+            drain(body, line, sizeof(line));
+        }
+        return n;
+    });
+    close(master);
+}
+
+// the page as it was rendered before DashboardRenderer: the whole template copied
+// to a String and a replace() per placeholder, the baseline of dashboard_page
+String legacyTime(long seconds) {
+    char buf[16];
+    snprintf(buf, sizeof(buf), "%02ld:%02ld:%02ld", seconds / 3600, (seconds % 3600) / 60, seconds % 60);
+    return String(buf);
+}
+
+String legacyDashboardPage(const BatteryState &state, long age) {
+    String statusText = (state.status == 1) ? "Charging" : (state.status == 0 ? "Discharging" : "Idle");
+    String uptimeStr = legacyTime(state.uptime);
+    String ageStr = (age < 0) ? String(F("never")) : legacyTime(age) + " ago";
+    int perc = state.remaining_capacity_perc;
+    String barColor = perc > 50 ? "#2ecc71" : (perc > 20 ? "#f1c40f" : "#e74c3c");
+    int soh = (state.factory_capacity > 0) ? (state.actual_capacity * 100 / state.factory_capacity) : 0;
+
+    String html = FPSTR(dashboardTemplate());
+    html.replace("{{PERC}}", String(perc));
+    html.replace("{{COLOR}}", barColor);
+    html.replace("{{STATUS}}", statusText);
+    html.replace("{{REM}}", String(state.remaining_capacity));
+    html.replace("{{ACT}}", String(state.actual_capacity));
+    html.replace("{{SOH}}", String(soh));
+    html.replace("{{AGE}}", ageStr);
+    html.replace("{{VOLT}}", String(state.voltage_mv / 1000.0f, 2));
+    html.replace("{{CURR}}", String(state.current_ma / 1000.0f, 2));
+    html.replace("{{POW}}", String(state.power_mw / 1000.0f, 2));
+    html.replace("{{SER}}", state.serial);
+    html.replace("{{UP}}", uptimeStr);
+    html.replace("{{T0}}", String(state.temp_zone0));
+    html.replace("{{T1}}", String(state.temp_zone1));
+    for (int i = 0; i < 10; i++) {
+        String cell = i < BATTERY_CELLS ? String(state.cells[i]) : String("-");
+        html.replace(String("{{C") + String(i) + "}}", cell);
+    }
+    bool error = state.error != BATTERY_OK;
+    html.replace("{{SHOW_ERR}}", error ? "block" : "none");
+    html.replace("{{ERR_MSG}}", FPSTR(batteryErrorText(state.error)));
+    return html;
+}
+
+void benchRenderers(const BatteryState &state) {
+    char buf[1024];
+    size_t jsonLen = writeStateJson(buf, sizeof(buf), state, true);
+    measure("state_json", "body", jsonLen, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) writeStateJson(buf, sizeof(buf), state, true);
+        return n;
+    });
+
+    uint8_t cbor[80 + 3 * BATTERY_CELLS];
+    size_t cborLen = writeStateCbor(cbor, sizeof(cbor), state, true);
+    measure("state_cbor", "body", cborLen, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) writeStateCbor(cbor, sizeof(cbor), state, true);
+        return n;
+    });
+
+    size_t pageLen;
+    {
+        DashboardRenderer page(state, 3);
+        pageLen = drain(page, buf, 256);
+    }
+    // sendStream() hands out 256 byte chunks
+    measure("dashboard_page", "page", pageLen, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            DashboardRenderer page(state, 3);
+            drain(page, buf, 256);
+        }
+        return n;
+    });
+
+    size_t legacyLen = legacyDashboardPage(state, 3).length();
+    measure("dashboard_legacy", "page", legacyLen, [&](uint64_t n) {
+        volatile size_t sink = 0;
+        for (uint64_t i = 0; i < n; i++) sink = sink + legacyDashboardPage(state, 3).length();
+        return n;
+    });
+
+    BatteryState moved = state;
+    moved.current_ma += 20;
+    measure("mqtt_differs", "compare", 0, [&](uint64_t n) {
+        volatile uint32_t sink = 0;
+        for (uint64_t i = 0; i < n; i++) sink = sink + MqttPublisher::differs(state, i & 1 ? moved : state);
+        return n;
+    });
+}
+
+void benchHistory() {
+    // one sample per second, the poller's pace in normal mode
+    static BatteryState states[600];
+    for (uint32_t i = 0; i < 600; i++) states[i] = sampleState(i);
+
+    static TelemetryHistory history;
+    uint32_t t = 0;
+    measure("history_add", "sample", 0, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            BatteryState &state = states[t % 600];
+            state.uptime = t++;
+            history.add(state);
+        }
+        return n;
+    });
+
+    char buf[256];
+    size_t outBytes;
+    {
+        HistorySource body(history, TelemetryHistory::RES_SAMPLE, 0);
+        outBytes = drain(body, buf, sizeof(buf));
+    }
+    measure("history_json", "body", outBytes, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+            HistorySource body(history, TelemetryHistory::RES_SAMPLE, 0);
+            drain(body, buf, sizeof(buf));
+        }
+        return n;
+    });
+}
+
+void report() {
+    printf("{\"suite\":\"bms-host\",\"cells\":%d,\"run_ms\":%lu,\"repetitions\":%d,\"results\":[", BATTERY_CELLS,
+           runMs, repetitions);
+    for (int i = 0; i < resultCount; i++) {
+        const Result &r = results[i];
+        printf("%s\n{\"name\":\"%s\",\"unit\":\"%s\",\"ops\":%llu,\"ns_min\":%.1f,\"ns_median\":%.1f,"
+               "\"ops_per_s\":%.0f,\"alloc_peak\":%zu,\"allocs_per_op\":%lu,\"out_bytes\":%zu}",
+               i == 0 ? "" : ",", r.name, r.unit, (unsigned long long)r.ops, r.nsMin, r.nsMedian,
+               r.nsMedian > 0 ? 1e9 / r.nsMedian : 0.0, r.allocPeak, (unsigned long)r.allocs, r.outBytes);
+    }
+    printf("\n]}\n");
+}
+
+}
+
+int main() {
+    const char *ms = getenv("BENCH_MS");
+    if (ms != nullptr && atol(ms) > 0) runMs = strtoul(ms, nullptr, 10);
+
+    BatteryState state = sampleState(3600);
+    RegisterImage image(state);
+    LatencyHistogram loopTime;
+    for (uint32_t us = 50; us < 50000; us = us * 3 / 2) loopTime.observe(us);
+
+    benchParser(image);
+    benchSweep(image, loopTime);
+    benchRenderers(state);
+    benchHistory();
+    report();
+
+    return 0;
+}
@@ -0,0 +1,193 @@
+// host check of the charge limit under an uneven loop(): BatteryPoller and
+// ChargeController against a charging pack answered over a pty, on the virtual
+// clock, with loop() passes of a few ms and now and then a slow handler. Every
+// sample has to bring capacity, current and cells together, so the relay stays
+// closed and the watchdog never trips.
+//
+//   pio run -e chargecheck && .pio/build/chargecheck/program --seconds 1200 --seed 7
+//
+// Prints one line per failed check and exits 1 if there was one.
+#include <fcntl.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <thread>
+#include "battery.h"
+#include "charge_control.h"
+#include "config.h"
+
+namespace {
+
+// virtual time the run starts at, deadlines before it would wrap
+const unsigned long startUs = 1000000;
+const uint8_t relayPin = 5;
+const byte hostAddress = 0x3D;
+
+int failures = 0;
+uint32_t seed = 1;
+
+BatteryPoller poller;
+ChargeController controller(poller);
+
+#define CHECK(cond, ...)                     \
+    do {                                     \
+        if (!(cond)) {                       \
+            fprintf(stderr, __VA_ARGS__);    \
+            fputc('\n', stderr);             \
+            failures++;                      \
+        }                                    \
+    } while (0)
+
+uint32_t nextRandom() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+// mostly short passes, some busy ones and a slow handler now and then, all below
+// CHARGE_DEADLINE_MS and RESPONSE_TIMEOUT_MS
+unsigned long loopPassUs() {
+    uint32_t r = nextRandom() % 100;
+    if (r < 80) return 1000 + nextRandom() % 9000;
+    if (r < 98) return 10000 + nextRandom() % 50000;
+    return 100000 + nextRandom() % 300000;
+}
+
+// a pack charging at 3 A, well below both stop limits
+struct ChargingPack {
+    uint16_t words[0x100]{};
+
+    ChargingPack() {
+        words[0x18] = 7800;
+        words[0x19] = 7400;
+        words[0x30] = 1;
+        words[0x31] = 4440;
+        words[0x32] = 60;
+        words[0x33] = 300;
+        words[0x34] = BATTERY_CELLS * 395;
+        words[0x35] = uint16_t((24 + 20) | ((25 + 20) << 8));
+        for (int i = 0; i < BATTERY_CELLS; i++) words[0x40 + i] = uint16_t(3940 + i);
+    }
+
+    // reply to a register read, returns the frame length
+    size_t reply(byte address, byte reg, byte len, byte *out) const {
+        out[0] = 0x5A;
+        out[1] = 0xA5;
+        out[2] = len;
+        out[3] = address;
+        out[4] = hostAddress;
+        out[5] = 0x04;
+        out[6] = reg;
+        for (byte i = 0; i < len; i++) {
+            uint16_t word = words[(reg + i / 2) & 0xFF];
+            out[7 + i] = (i & 1) ? byte(word >> 8) : byte(word & 0xFF);
+        }
+        uint16_t cs = NinebotFrameParser::checksum(out, len);
+        out[7 + len] = cs & 0xFF;
+        out[8 + len] = cs >> 8;
+        return NinebotFrame::overhead + len;
+    }
+};
+
+}
+
+int main(int argc, char **argv) {
+    unsigned long seconds = 1200;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--seconds") == 0) seconds = strtoul(argv[i + 1], nullptr, 10);
+        else if (strcmp(argv[i], "--seed") == 0) seed = uint32_t(strtoul(argv[i + 1], nullptr, 10));
+    }
+    if (seed == 0) seed = 1; // xorshift stays at 0
+    uint32_t firstSeed = seed;
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        fprintf(stderr, "no pty\n");
+        return 1;
+    }
+    fcntl(master, F_SETFL, O_NONBLOCK);
+    static char slavePath[64];
+    strncpy(slavePath, ptsname(master), sizeof(slavePath) - 1);
+
+    setVirtualMicros(startUs);
+    PosixSerial serial(slavePath);
+    BatteryMonitor monitor(serial, false);
+    // second handle on the slave, to see when a reply has arrived there
+    int probe = open(slavePath, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+    if (probe < 0) return 1;
+
+    BatteryState snapshot{};
+    poller.attach(monitor, snapshot, 0);
+    controller.begin(relayPin, CHARGE_RELAY_ACTIVE_LOW);
+    poller.onSample([](const BatteryState &state) { controller.add(state); });
+
+    ChargingPack pack;
+    byte request[64];
+    size_t requestLen = 0;
+    byte reply[NinebotFrameParser::maxFrameLen];
+    uint32_t answered = 0;
+
+    // answers every request the monitor wrote, right away
+    auto answer = [&]() {
+        for (int spins = 0; answered < monitor.framesSent() && spins < 100000; spins++) {
+            ssize_t got = read(master, request + requestLen, sizeof(request) - requestLen);
+            if (got <= 0) {
+                std::this_thread::yield();
+                continue;
+            }
+            requestLen += size_t(got);
+            while (requestLen >= 2 && (request[0] != 0x5A || request[1] != 0xA5)) {
+                memmove(request, request + 1, --requestLen);
+            }
+            if (requestLen < 3 || requestLen < NinebotFrame::overhead + request[2]) continue;
+            size_t frameLen = NinebotFrame::overhead + request[2];
+            size_t len = pack.reply(request[4], request[6], request[7], reply);
+            if (write(master, reply, len) != ssize_t(len)) fprintf(stderr, "short pty write\n");
+            memmove(request, request + frameLen, requestLen - frameLen);
+            requestLen -= frameLen;
+            answered++;
+
+            int count = 0;
+            for (int wait = 0; wait < 100000 && (ioctl(probe, FIONREAD, &count) != 0 || count < int(len)); wait++) {
+                std::this_thread::yield();
+            }
+        }
+    };
+
+    unsigned long now = startUs;
+    unsigned long endUs = startUs + seconds * 1000000UL;
+    uint32_t passes = 0;
+    uint32_t openPasses = 0; // relay open after the first decision
+    while (now < endUs) {
+        poller.update();
+        answer();
+        controller.update();
+        if (controller.reason() != ChargeController::REASON_NONE && !controller.charging()) openPasses++;
+
+        now += loopPassUs();
+        setVirtualMicros(now);
+        passes++;
+    }
+
+    uint32_t decisions = controller.latency().count();
+    CHECK(controller.watchdogTrips() == 0, "watchdog tripped %u times", controller.watchdogTrips());
+    CHECK(controller.deadlineMisses() == 0, "%u decisions came after the deadline", controller.deadlineMisses());
+    CHECK(openPasses == 0, "relay open in %u of %u loop passes", openPasses, passes);
+    CHECK(controller.charging() && controller.reason() == ChargeController::REASON_BELOW_LIMIT,
+          "relay %s at the end, %s", controller.charging() ? "closed" : "open",
+          ChargeController::reasonText(controller.reason()));
+    // one decision per CHARGE_CONTROL_MS at least
+    CHECK(decisions >= seconds * 1000 / CHARGE_CONTROL_MS, "%u decisions in %lu s", decisions, seconds);
+    CHECK(poller.failedSweeps() == 0, "%u failed sweeps", poller.failedSweeps());
+
+    close(probe);
+    close(master);
+
+    printf("{\"suite\":\"bms-chargecheck\",\"seed\":%u,\"seconds\":%lu,\"passes\":%u,\"sweeps\":%u,\"decisions\":%u,"
+           "\"worst_gap_ms\":%lu,\"trips\":%u,\"failures\":%d}\n",
+           unsigned(firstSeed), seconds, passes, poller.sweeps(), decisions, controller.worstGapMs(),
+           controller.watchdogTrips(), failures);
+    return failures > 0 ? 1 : 0;
+}
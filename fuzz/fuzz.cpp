@@ -0,0 +1,213 @@
+// randomized check of NinebotFrameParser: streams of valid frames mixed with
+// noise, truncated frames, oversized length bytes and bad checksums, fed in
+// random chunks. Every valid frame has to come out at its offset with its
+// bytes, every view has to lie inside the parser, nothing may stall.
+//
+//   pio run -e fuzz && .pio/build/fuzz/program --rounds 100000 --seed 7
+//
+// Exits 1 with the seed and round of the first failure, which reproduce it.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+#include "frame_parser.h"
+
+namespace {
+
+uint32_t seed = 1;
+
+uint32_t nextRandom() {
+    seed ^= seed << 13;
+    seed ^= seed >> 17;
+    seed ^= seed << 5;
+    return seed;
+}
+
+uint32_t below(uint32_t n) {
+    return nextRandom() % n;
+}
+
+// the wire checksum, written out again so the parser's own is checked as well
+uint16_t wireChecksum(const uint8_t *frame, size_t len) {
+    unsigned int sum = 0;
+    for (size_t i = 2; i < len - 2; i++) sum += frame[i];
+    return uint16_t(0xFFFF - sum);
+}
+
+struct Expected {
+    size_t offset;
+    size_t len;
+};
+
+struct Round {
+    std::vector<uint8_t> stream;
+    std::vector<Expected> frames;
+};
+
+const size_t maxPayload = NinebotFrameParser::maxFrameLen - NinebotFrame::overhead;
+
+void addFrame(Round &round, size_t payloadLen, bool badCrc) {
+    size_t offset = round.stream.size();
+    size_t len = payloadLen + NinebotFrame::overhead;
+    round.stream.push_back(0x5A);
+    round.stream.push_back(0xA5);
+    round.stream.push_back(uint8_t(payloadLen));
+    for (size_t i = 3; i < len - 2; i++) round.stream.push_back(uint8_t(nextRandom()));
+    uint16_t crc = wireChecksum(&round.stream[offset], len);
+    if (badCrc) crc ^= uint16_t(1 + below(0xFFFF));
+    round.stream.push_back(uint8_t(crc));
+    round.stream.push_back(uint8_t(crc >> 8));
+    if (!badCrc) round.frames.push_back({offset, len});
+}
+
+// noise is biased towards header bytes, so there are plenty of false starts
+void addNoise(Round &round, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        uint32_t r = nextRandom();
+        round.stream.push_back((r & 7) == 0 ? 0x5A : ((r & 7) == 1 ? 0xA5 : uint8_t(r >> 8)));
+    }
+}
+
+Round makeRound() {
+    Round round;
+    int segments = 1 + below(24);
+    for (int s = 0; s < segments; s++) {
+        switch (below(6)) {
+            case 0:
+                addNoise(round, 1 + below(80));
+                break;
+            case 1: {
+                // a frame cut off anywhere after its header
+                size_t start = round.stream.size();
+                addFrame(round, below(maxPayload + 1), true);
+                round.stream.resize(start + 1 + below(round.stream.size() - start - 1));
+                break;
+            }
+            case 2:
+                // too long for the ring, the parser has to skip the header
+                round.stream.push_back(0x5A);
+                round.stream.push_back(0xA5);
+                round.stream.push_back(uint8_t(maxPayload + 1 + below(0xFF - maxPayload)));
+                addNoise(round, below(40));
+                break;
+            case 3:
+                addFrame(round, below(maxPayload + 1), true);
+                break;
+            default:
+                // short register replies are the usual case, now and then the longest one
+                addFrame(round, below(8) == 0 ? maxPayload : below(40), false);
+                break;
+        }
+    }
+    // a frame behind a cut-off header only shows up once enough bytes followed to
+    // fail that header's checksum, the end of a round brings them
+    round.stream.resize(round.stream.size() + NinebotFrameParser::maxFrameLen, 0x00);
+
+    return round;
+}
+
+struct Totals {
+    uint64_t bytes = 0;
+    uint64_t frames = 0; // valid ones generated
+    uint64_t found = 0;
+    uint64_t accidental = 0; // garbage that happened to pass the checksum
+    uint64_t shadowed = 0; // valid frames swallowed by an accidental one
+};
+
+// feeds one round in random chunks, false and a message on stderr on the first violation
+bool runRound(const Round &round, Totals &totals) {
+    NinebotFrameParser parser;
+    const uint8_t *lo = reinterpret_cast<const uint8_t *>(&parser);
+    const uint8_t *hi = lo + sizeof(parser);
+    std::vector<Expected> got;
+
+    size_t fed = 0;
+    while (fed < round.stream.size()) {
+        size_t chunk = below(4) == 0 ? 1 + below(200) : 1 + below(32);
+        size_t take = parser.feed(&round.stream[fed], std::min(chunk, round.stream.size() - fed));
+        fed += take;
+
+        NinebotFrame frame;
+        bool any = false;
+        while (parser.next(frame)) {
+            any = true;
+            // the view starts at the read position, which is what was fed minus what is still buffered
+            size_t offset = fed - parser.buffered();
+            if (frame.data < lo || frame.data + frame.len > hi) {
+                fprintf(stderr, "view of %zu bytes at offset %zu lies outside the parser\n", frame.len, offset);
+                return false;
+            }
+            if (frame.len > NinebotFrameParser::maxFrameLen || frame.len != frame.payloadLen() + NinebotFrame::overhead) {
+                fprintf(stderr, "frame at offset %zu has length %zu\n", offset, frame.len);
+                return false;
+            }
+            if (offset + frame.len > fed || memcmp(frame.data, &round.stream[offset], frame.len) != 0) {
+                fprintf(stderr, "frame at offset %zu does not match the stream\n", offset);
+                return false;
+            }
+            uint16_t crc = frame.data[frame.len - 2] | (frame.data[frame.len - 1] << 8);
+            if (crc != wireChecksum(frame.data, frame.len)) {
+                fprintf(stderr, "frame at offset %zu has a bad checksum\n", offset);
+                return false;
+            }
+            got.push_back({offset, frame.len});
+        }
+        if (take == 0 && !any) {
+            fprintf(stderr, "stalled at offset %zu with %zu bytes buffered\n", fed, parser.buffered());
+            return false;
+        }
+    }
+
+    size_t g = 0;
+    for (const Expected &want : round.frames) {
+        while (g < got.size() && got[g].offset < want.offset) {
+            // an accidental frame reaching into this one explains why it is missing
+            if (got[g].offset + got[g].len > want.offset) break;
+            totals.accidental++;
+            g++;
+        }
+        if (g < got.size() && got[g].offset == want.offset && got[g].len == want.len) {
+            totals.found++;
+            g++;
+        } else if (g < got.size() && got[g].offset < want.offset) {
+            totals.shadowed++;
+        } else {
+            fprintf(stderr, "valid frame of %zu bytes at offset %zu was not recovered\n", want.len, want.offset);
+            return false;
+        }
+    }
+    totals.accidental += got.size() - g;
+    totals.frames += round.frames.size();
+    totals.bytes += round.stream.size();
+
+    return true;
+}
+
+}
+
+int main(int argc, char **argv) {
+    unsigned long rounds = 20000;
+    uint32_t firstSeed = 1;
+    for (int i = 1; i + 1 < argc; i += 2) {
+        if (strcmp(argv[i], "--rounds") == 0) rounds = strtoul(argv[i + 1], nullptr, 10);
+        else if (strcmp(argv[i], "--seed") == 0) firstSeed = uint32_t(strtoul(argv[i + 1], nullptr, 10));
+    }
+    if (firstSeed == 0) firstSeed = 1; // xorshift stays at 0
+
+    Totals totals;
+    seed = firstSeed;
+    for (unsigned long r = 0; r < rounds; r++) {
+        Round round = makeRound();
+        if (!runRound(round, totals)) {
+            fprintf(stderr, "failed in round %lu of --seed %u\n", r, unsigned(firstSeed));
+            return 1;
+        }
+    }
+    printf("{\"suite\":\"bms-fuzz\",\"seed\":%u,\"rounds\":%lu,\"bytes\":%llu,\"frames\":%llu,\"found\":%llu,"
+           "\"shadowed\":%llu,\"accidental\":%llu}\n",
+           unsigned(firstSeed), rounds, (unsigned long long)totals.bytes, (unsigned long long)totals.frames,
+           (unsigned long long)totals.found, (unsigned long long)totals.shadowed, (unsigned long long)totals.accidental);
+
+    return 0;
+}
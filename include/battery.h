@@ -1,76 +1,368 @@
 #pragma once
-#include <ESP8266WiFi.h>
+#include "hal.h"
 #include "config.h"
+#include "bms_registers.h"
+#include "frame_parser.h"
+#include "histogram.h"
+#include <array>
+#include <type_traits>
 
+static_assert(BATTERY_CELLS > 0 && BATTERY_CELLS <= 16, "cell registers 0x40..0x4F");
+static_assert(BATTERY_PACKS > 0 && BUS_PIPELINE_DEPTH > 0, "at least one pack and one request on the bus");
+
+// result of the last read, the texts live in flash, see batteryErrorText()
+enum BatteryError : uint8_t {
+    BATTERY_OK = 0,
+    BATTERY_ERR_NO_DATA, // nothing read yet
+    // one per register field, in register table order
+    BATTERY_ERR_READ_SERIAL,
+    BATTERY_ERR_READ_FACTORY_CAPACITY,
+    BATTERY_ERR_READ_ACTUAL_CAPACITY,
+    BATTERY_ERR_READ_STATUS,
+    BATTERY_ERR_READ_REMAINING_CAPACITY,
+    BATTERY_ERR_READ_REMAINING_CAPACITY_PERC,
+    BATTERY_ERR_READ_CURRENT,
+    BATTERY_ERR_READ_VOLTAGE,
+    BATTERY_ERR_READ_TEMPERATURE,
+    BATTERY_ERR_READ_CELLS_VOLTAGE,
+    BATTERY_ERR_RESTORED, // last sample from before the reset, nothing read since
+    BATTERY_ERROR_COUNT,
+};
+
+// PROGMEM string, empty for BATTERY_OK
+PGM_P batteryErrorText(BatteryError error);
+
+// integers in the units of the BMS scaled to milli, decimals are only made
+// when formatting for output (formatFixed() in state_json.h)
 struct BatteryState {
+    uint32_t uptime; // s, when the sample was taken
+    int32_t voltage_mv;
+    int32_t current_ma; // negative while discharging
+    int32_t power_mw;
     int16_t status; // 0=Discharge, 1=Charge, 2=Idle
-    String serial;
     int16_t remaining_capacity_perc;
-    int16_t remaining_capacity;
+    int16_t remaining_capacity; // mAh
     int16_t factory_capacity;
     int16_t actual_capacity;
-    double current;
-    double voltage;
-    double power;
+    std::array<int16_t, BATTERY_CELLS> cells; // mV
     int8_t temp_zone0, temp_zone1;
-    int16_t cell_voltage_cell0, cell_voltage_cell1, cell_voltage_cell2, cell_voltage_cell3,
-            cell_voltage_cell4, cell_voltage_cell5, cell_voltage_cell6, cell_voltage_cell7,
-            cell_voltage_cell8, cell_voltage_cell9;
-    long uptime;
-    String error;
+    BatteryError error;
+    char serial[15];
 };
+static_assert(std::is_trivially_copyable<BatteryState>::value, "snapshots are plain copies");
+
 
+class BusCapture;
 
 class BatteryMonitor {
 public:
+    enum TransactionStatus {
+        TX_IDLE = 0,
+        TX_PENDING = 1,
+        TX_DONE = 2,
+        TX_ERROR = 3,
+    };
+    enum TransactionError {
+        ERR_NONE = 0,
+        ERR_TIMEOUT = 1,
+        ERR_CRC = 2,
+    };
+
+    // one value of the register map, reg is the word address on the BMS
+    enum FieldId {
+        FIELD_SERIAL = 0,
+        FIELD_FACTORY_CAPACITY,
+        FIELD_ACTUAL_CAPACITY,
+        FIELD_STATUS,
+        FIELD_REMAINING_CAPACITY,
+        FIELD_REMAINING_CAPACITY_PERC,
+        FIELD_CURRENT,
+        FIELD_VOLTAGE,
+        FIELD_TEMPERATURE,
+        FIELD_CELLS_VOLTAGE,
+        FIELD_COUNT,
+    };
+    static const uint16_t allFields = (1 << FIELD_COUNT) - 1;
+
+    // how often a field is worth reading, see BatteryPoller::fieldInterval()
+    enum RefreshClass : uint8_t {
+        REFRESH_ONCE = 0, // never changes while powered
+        REFRESH_SLOW, // POLL_SLOW_MS
+        REFRESH_LIVE, // POLL_LIVE_MS, scaled by the poller mode
+        REFRESH_DETAIL, // POLL_DETAIL_MS, scaled by the poller mode
+    };
+    static RefreshClass refreshClass(FieldId id);
+
     bool debug = false;
     SERIAL_TYPE *batterySerial;
 
+    // one pack per entry of BATTERY_ADDRESSES, all on the same serial line
     BatteryMonitor(SERIAL_TYPE &_serial, bool debugEnabled);
 
-    bool readBatteryState(BatteryState &state);
+    int packCount() const { return BATTERY_PACKS; }
+    byte packAddress(int pack) const { return slots[pack].address; }
+
+    // blocking full read, prefer beginRead()/pollRead() from loop()
+    bool readBatteryState(BatteryState &state, int pack = 0);
+
+    // starts a non-blocking sweep over the given fields (bit per FieldId) of one pack.
+    // Fields that sit between two wanted ones come along with the same request.
+    // Sweeps of different packs run side by side, up to BUS_PIPELINE_DEPTH
+    // requests are on the bus at once.
+    void beginRead(uint16_t fields = allFields, int pack = 0);
+
+    // fields decoded by the last sweep of the pack that returned TX_DONE
+    uint16_t fieldsRead(int pack = 0) const { return slots[pack].fields; }
+
+    // advances the running sweep of the pack, fills state once it returns TX_DONE
+    TransactionStatus pollRead(BatteryState &state, int pack = 0);
+
+    // blocking single request/response, built on begin()/poll()
+    bool sendCommand(const byte cmd[], int cmdLen, int pack = 0);
 
-    bool sendCommand(const byte cmd[], int cmdLen);
+    // queues cmd (at most maxRequest bytes) for the pack and arms a response deadline
+    // of timeoutMs once it is on the bus. The reply is matched by source address,
+    // command and register, not by the order it arrives in.
+    void begin(const byte cmd[], int cmdLen, unsigned long timeoutMs = RESPONSE_TIMEOUT_MS, int pack = 0);
 
-    bool receiving();
+    // consumes whatever bytes are available without waiting for more, replies
+    // for other packs are handed to their slots on the way
+    TransactionStatus poll(int pack = 0);
+
+    TransactionError lastError(int pack = 0) const { return slots[pack].error; }
+
+    // starts block read number block of the register dump range on the pack, see registerDumpFirst
+    void beginDump(int block, int pack = 0);
+
+    // payload of the last reply of the pack that returned TX_DONE, returns its length
+    size_t copyReply(byte *out, size_t max, int pack = 0) const;
+
+    // requests on the bus right now
+    int inFlight() const;
+
+    // the last stretch with sweeps running, first request to the end of the last
+    // sweep. When all packs are due together that is the time of the whole round.
+    unsigned long roundMs() const { return lastRoundMs; }
+
+    // bus counters for /metrics, they only ever grow
+    uint32_t framesSent() const { return sent; }
+    uint32_t replies() const { return received; }
+    uint32_t timeouts() const { return timedOut; }
+    uint32_t crcErrors() const { return parser.crcErrors(); }
+    uint32_t resyncs() const { return parser.resyncs(); }
+    // replies from a pack that had no matching request outstanding
+    uint32_t strays() const { return unmatched; }
+
+    // request to reply time, one series per request register in the order they
+    // were first seen, the last one collects everything past latencySeries - 1
+    static const int latencySeries = 4;
+    const LatencyHistogram &latency(int series) const { return roundTrip[series]; }
+    // register of the series, -1 for the catch-all one and for series no register was
+    // seen for yet (those stay empty)
+    int latencyRegister(int series) const;
+
+    // records every byte written to and read from the bus, nullptr to stop
+    void setCapture(BusCapture *_capture) { capture = _capture; }
 
 private:
 
-    const byte get_status[10] = {0x5a, 0xa5, 0x01, 0x20, 0x22, 0x01, 0x30, 0x02, 0x89, 0xff,};
-    const byte get_serial[10] = {0x5a, 0xa5, 0x01, 0x20, 0x22, 0x01, 0x10, 0x0e, 0x9d, 0xff,};
-    const byte get_remaining_capacity_perc[10] = {0x5a, 0xa5, 0x01, 0x20, 0x22, 0x01, 0x32, 0x02, 0x87, 0xff,};
-    const byte get_remaining_capacity[10] = {0x5a, 0xa5, 0x01, 0x20, 0x22, 0x01, 0x31, 0x02, 0x88, 0xff,};
-    const byte get_actual_capacity[10] = {0x5a, 0xa5, 0x01, 0x20, 0x22, 0x01, 0x19, 0x02, 0xa0, 0xff,};
-    const byte get_factory_capacity[10] = {0x5a, 0xa5, 0x01, 0x20, 0x22, 0x01, 0x18, 0x02, 0xa1, 0xff,};
-    const byte get_current[10] = {0x5a, 0xa5, 0x01, 0x20, 0x22, 0x01, 0x33, 0x02, 0x86, 0xff,};
-    const byte get_voltage[10] = {0x5a, 0xa5, 0x01, 0x20, 0x22, 0x01, 0x34, 0x02, 0x85, 0xff,};
-    const byte get_cells_voltage[10] = {0x5a, 0xa5, 0x01, 0x20, 0x22, 0x01, 0x40, 0x14, 0x67, 0xff,};
-    const byte get_temperature[10] = {0x5a, 0xa5, 0x01, 0x20, 0x22, 0x01, 0x35, 0x02, 0x84, 0xff,};
-
-    enum states {
-        STATE_NONE = 0,
-        STATE_HEADER1 = 1,
-        STATE_HEADER2 = 2,
-        STATE_LEN = 3,
-        STATE_SRCADDR = 4,
-        STATE_DSTADDR = 5,
-        STATE_CMD = 6,
-        STATE_ARG = 7,
-        STATE_PAYLOAD = 8,
-        STATE_CRC = 9,
-        STATE_READY = 10,
+    struct RegisterField {
+        byte reg;
+        byte len; // bytes
+        FieldId id;
+        RefreshClass refresh;
     };
-    static const int responseSize = 64;
-    byte response[responseSize]{};
-    int expectedLen{};
-    int payloadPos{};
-    int responsePos{};
-    states state = STATE_NONE;
+    static const RegisterField registerTable[FIELD_COUNT];
+
+    // contiguous register range fetched with one request
+    struct ReadBlock {
+        byte reg;
+        byte len;
+        byte firstField;
+        byte fieldCount;
+    };
+    // fields closer than this many registers are merged into one request
+    static const int batchMaxGap = 4;
+    // largest payload of one block read, the frame has to fit into the parser ring
+    static const int batchMaxLen = 48;
+    static_assert(registerDumpBlockWords * 2 <= batchMaxLen, "dump blocks have to fit the reply buffer");
+    static const int maxRequest = 16;
+
+    // one pack: its running sweep and its request, at most one per pack is outstanding
+    struct PackSlot {
+        byte address = 0;
+
+        ReadBlock plan[FIELD_COUNT]{};
+        byte blocks = 0;
+        byte block = 0;
+        bool running = false;
+        uint16_t fields = 0;
+
+        byte request[maxRequest]{};
+        byte requestLen = 0;
+        bool queued = false; // waiting for room in the pipeline
+        TransactionStatus status = TX_IDLE;
+        TransactionError error = ERR_NONE;
+        byte replyCmd = 0;
+        byte reg = 0;
+        unsigned long started = 0;
+        unsigned long timeout = 0;
+        unsigned long startedUs = 0;
+
+        byte reply[batchMaxLen]{}; // payload of the matched reply
+        byte replyLen = 0;
+    };
+    PackSlot slots[BATTERY_PACKS];
+    int nextSend = 0; // round robin start for queued requests
+
+    NinebotFrameParser parser;
+    NinebotFrame frame; // last received frame, points into parser
+    uint32_t crcErrorsSeen{};
+    unsigned long roundStarted = 0;
+    unsigned long lastRoundMs = 0;
+
+    uint32_t sent = 0;
+    uint32_t received = 0;
+    uint32_t timedOut = 0;
+    uint32_t unmatched = 0;
+    LatencyHistogram roundTrip[latencySeries];
+    byte seriesRegister[latencySeries - 1]{};
+    int seriesUsed = 0;
+    BusCapture *capture = nullptr;
+
+    // merges the wanted fields of the register table into as few block reads as possible
+    void planReads(PackSlot &slot, uint16_t fields);
+
+    void beginBlock(int pack);
+
+    // writes a queued request to the bus
+    void send(PackSlot &slot);
+
+    // reads the bus, dispatches replies to their slots, expires deadlines and
+    // sends queued requests while the pipeline has room
+    void pump();
+
+    void finish(PackSlot &slot, TransactionStatus status, TransactionError error);
+    void endSweep(PackSlot &slot);
+
+    // scatters the payload of one block read into the state fields
+    bool decodeBlock(const PackSlot &slot, BatteryState &state);
+
+    void decodeField(FieldId id, const byte data[], BatteryState &state);
 
     int16_t convertBytesToInt(byte byte1, byte byte2);
 
     void printBytes(const String &tag, const byte bytes[], int len);
-
-    bool verifyCrc();
 };
 
+// polls the BMS from loop() on its own schedule and publishes the result into a
+// shared snapshot, so web handlers never touch the bus themselves.
+//
+// Every field has its own refresh interval from its RefreshClass: static ones
+// are read once, live ones (current, voltage, ...) every POLL_LIVE_MS. Live and
+// detail intervals follow the battery: shorter while charging or under heavy
+// load, longer while idle. A sweep only requests the fields that are due.
+class BatteryPoller {
+public:
+    typedef void (*SampleListener)(const BatteryState &state);
+
+    enum Mode {
+        MODE_IDLE = 0, // no current worth mentioning, intervals * POLL_IDLE_FACTOR
+        MODE_NORMAL,
+        MODE_ACTIVE, // charging or above POLL_HEAVY_MA, intervals / POLL_ACTIVE_DIVISOR
+    };
+
+    // polls nothing until attach()
+    BatteryPoller() = default;
+
+    BatteryPoller(BatteryMonitor &_monitor, BatteryState &_snapshot, int _pack = 0);
+
+    // for pollers in arrays, one per pack of the monitor
+    void attach(BatteryMonitor &_monitor, BatteryState &_snapshot, int _pack);
+
+    int pack() const { return packIndex; }
+
+    // call from loop(), reads the fields that are due
+    void update();
+
+    // picked from status and current of the snapshot
+    Mode mode() const;
+
+    // refresh interval of a field in the current mode, 0 for read once
+    unsigned long fieldInterval(BatteryMonitor::FieldId id) const;
+
+    // caps the interval of live and detail fields (bit per FieldId) at intervalMs in every mode,
+    // once one of them is due they are all read in that sweep
+    void require(uint16_t fields, unsigned long intervalMs);
+
+    // fields refreshed by the last published sample
+    uint16_t lastFields() const { return sampleFields; }
+
+    // micros() when the first request of the last published sample went out
+    unsigned long sampleStartedUs() const { return sampleStartUs; }
+
+    // incremented every time the snapshot changes (new sample or new error)
+    uint32_t version() const { return snapshotVersion; }
+
+    bool hasSample() const { return sampled; }
+    // a sweep is on the bus
+    bool busy() const { return reading; }
+
+    // milliseconds since the last successful read
+    unsigned long ageMs() const;
+
+    // duration of the last finished sweep, request of the first block to the last response
+    unsigned long sweepMs() const { return lastSweepMs; }
+
+    // called from update() with every successful read, after the snapshot was published
+    bool onSample(SampleListener listener);
+
+    // asks for a dump of the whole register range in a few block reads, run
+    // between two sweeps. Returns the dumps() count once that dump is done.
+    uint32_t requestDump();
+    // dumps finished so far, blocks that failed included
+    uint32_t dumps() const { return dumpsDone; }
+    const RegisterDump &dump() const { return dumpImage; }
+
+    uint32_t sweeps() const { return okSweeps; }
+    uint32_t failedSweeps() const { return badSweeps; }
+    // sweeps started after a failed one, after the one live interval of backoff
+    uint32_t retries() const { return retriedSweeps; }
+
+private:
+    static const int maxListeners = 8;
+    SampleListener listeners[maxListeners]{};
+    int listenerCount = 0;
+
+    BatteryMonitor *monitor = nullptr;
+    BatteryState *snapshot = nullptr;
+    int packIndex = 0;
+    BatteryState scratch{};
+    unsigned long lastRead[BatteryMonitor::FIELD_COUNT]{};
+    uint16_t readOnce = 0; // fields that have a value
+    uint16_t requiredFields = 0;
+    unsigned long requiredMs = 0;
+    uint16_t sampleFields = 0;
+    unsigned long sweepStartUs = 0;
+    unsigned long sampleStartUs = 0;
+    bool reading = false;
+    unsigned long lastPoll = 0;
+    unsigned long lastSample = 0;
+    unsigned long sweepStarted = 0;
+    unsigned long lastSweepMs = 0;
+    uint32_t snapshotVersion = 0;
+    uint32_t okSweeps = 0;
+    uint32_t badSweeps = 0;
+    uint32_t retriedSweeps = 0;
+    bool failed = false;
+    bool sampled = false;
+
+    RegisterDump dumpImage;
+    bool dumpWanted = false;
+    bool dumping = false;
+    uint8_t dumpBlock = 0;
+    unsigned long dumpStarted = 0;
+    uint32_t dumpsDone = 0;
+
+    void advanceDump();
+};
@@ -0,0 +1,87 @@
+#pragma once
+#include "hal.h"
+#include "config.h"
+#include "stream_source.h"
+
+// word addresses of the registers the firmware knows. The BMS stores 16 bit
+// little endian words, a read request asks for a byte count starting at one.
+enum BmsRegister : uint8_t {
+    BMS_REG_SERIAL = 0x10, // 7 words, 14 ascii characters
+    BMS_REG_FIRMWARE = 0x17,
+    BMS_REG_FACTORY_CAPACITY = 0x18,
+    BMS_REG_ACTUAL_CAPACITY = 0x19,
+    BMS_REG_CHARGE_CYCLES = 0x1B,
+    BMS_REG_CHARGE_COUNT = 0x1C,
+    BMS_REG_MANUFACTURED = 0x20,
+    BMS_REG_STATUS = 0x30,
+    BMS_REG_REMAINING_CAPACITY = 0x31,
+    BMS_REG_REMAINING_CAPACITY_PERC = 0x32,
+    BMS_REG_CURRENT = 0x33,
+    BMS_REG_VOLTAGE = 0x34,
+    BMS_REG_TEMPERATURE = 0x35,
+    BMS_REG_HEALTH = 0x3B,
+    BMS_REG_CELLS = 0x40, // one word per cell
+};
+
+enum RegisterType : uint8_t {
+    REG_UINT, // unsigned words
+    REG_INT, // signed words
+    REG_TEXT, // ascii, low byte first
+    REG_BYTES, // two unsigned bytes per word, low byte first
+    REG_HEX, // bit fields and versions, printed as hex
+};
+
+// one entry of the register map. value = raw * scale + bias in unit, for
+// REG_BYTES per byte. The table lives in flash.
+struct RegisterInfo {
+    char name[24];
+    uint8_t reg;
+    uint8_t words;
+    RegisterType type;
+    int8_t scale;
+    int8_t bias;
+    char unit[4];
+};
+
+extern const RegisterInfo bmsRegisters[] PROGMEM;
+extern const uint8_t bmsRegisterCount;
+
+// the range read by a register dump, in block reads of at most registerDumpBlockWords
+static const uint8_t registerDumpFirst = BMS_REG_SERIAL;
+static const uint8_t registerDumpWords = 0x40; // up to the last cell register
+static const uint8_t registerDumpBlockWords = 24; // 48 byte replies, the largest a sweep reads as well
+static const uint8_t registerDumpBlocks = (registerDumpWords + registerDumpBlockWords - 1) / registerDumpBlockWords;
+
+// words of the last register dump of a pack, see BatteryPoller::requestDump()
+struct RegisterDump {
+    uint16_t words[registerDumpWords]{};
+    uint8_t blocksRead = 0; // bit per block that was answered
+    unsigned long readMs = 0; // first request to the last reply
+    unsigned long finished = 0; // millis()
+
+    bool has(uint8_t reg) const;
+    uint16_t word(uint8_t reg) const { return words[reg - registerDumpFirst]; }
+};
+
+class BatteryMonitor;
+class BatteryPoller;
+
+// /api/registers: the dump of one pack decoded with the register table plus
+// the raw words, waits for the dump that was requested with it
+class RegistersSource : public RecordSource {
+public:
+    // wanted: BatteryPoller::requestDump() of the dump to send
+    RegistersSource(const BatteryMonitor &_monitor, const BatteryPoller &_poller, uint32_t _wanted);
+
+    bool ready() const override;
+
+protected:
+    size_t nextRecord(char *line, size_t size) override;
+
+private:
+    const BatteryMonitor *monitor;
+    const BatteryPoller *poller;
+    uint32_t wanted;
+    uint8_t item = 0;
+    uint8_t word = 0;
+};
@@ -0,0 +1,86 @@
+#pragma once
+#include "hal.h"
+#include "config.h"
+#include "stream_source.h"
+
+// raw bus traffic with microsecond timestamps, for reproducing field issues
+// with tools/replay. Kept in a RAM ring that evicts its oldest records whole.
+// A record is
+//   varint dt (us since the previous record), varint len << 1 | direction, len bytes
+// The dt of the oldest record refers to an evicted one and means nothing.
+class BusCapture {
+public:
+    enum Direction : uint8_t {
+        CAPTURE_RX = 0, // read from the bus, our own echo included
+        CAPTURE_TX = 1, // written by BatteryMonitor
+    };
+    static const size_t maxRecordHead = 6; // two varints of up to three bytes
+
+    BusCapture(uint8_t *_storage, size_t _size);
+
+    // one write or one chunk read, stamped with micros()
+    void add(Direction dir, const uint8_t *data, size_t len);
+
+    void clear();
+
+    // nothing is recorded while a download copies the ring, see CaptureSource
+    void hold() { held++; }
+    void release() { held--; }
+
+    size_t used() const { return fill; }
+    size_t capacity() const { return size; }
+    uint32_t records() const { return count; }
+    // records evicted for room and records missed while held
+    uint32_t evicted() const { return dropped; }
+    uint32_t missed() const { return skipped; }
+
+    // ring bytes from the oldest record on, returns how many were copied
+    size_t copy(size_t offset, uint8_t *buf, size_t max) const;
+
+    // one record of a trace, data points into the trace
+    struct Record {
+        uint32_t dtUs;
+        Direction dir;
+        const uint8_t *data;
+        size_t len;
+    };
+    // decodes the record at pos of a downloaded trace body and moves pos past it,
+    // false at the end or on a truncated record
+    static bool parse(const uint8_t *trace, size_t len, size_t &pos, Record &record);
+
+private:
+    uint8_t *storage;
+    size_t size;
+    size_t head = 0; // next byte written
+    size_t fill = 0;
+    uint32_t count = 0;
+    uint32_t dropped = 0;
+    uint32_t skipped = 0;
+    uint8_t held = 0;
+    unsigned long lastUs = 0;
+
+    void put(uint8_t value);
+    size_t putVarint(uint32_t value);
+    uint8_t at(size_t offset) const { return storage[(head + size - fill + offset) % size]; }
+    uint32_t varintAt(size_t &offset) const;
+    void evictOldest();
+};
+
+// /api/capture: a header and the records of the ring, the capture is held
+// until the download is done. Header:
+//   "NBCP", version, pack count, the pack addresses, baud rate (uint32 le)
+class CaptureSource : public StreamSource {
+public:
+    static const uint8_t version = 1;
+
+    explicit CaptureSource(BusCapture &_capture);
+    ~CaptureSource() override;
+
+    size_t read(char *buf, size_t max) override;
+
+private:
+    BusCapture *capture;
+    uint8_t header[4 + 2 + BATTERY_PACKS + 4];
+    size_t headerPos = 0;
+    size_t offset = 0;
+};
@@ -0,0 +1,84 @@
+#pragma once
+#include "hal.h"
+#include "battery.h"
+#include "histogram.h"
+#if defined(ESP32) || defined(ESP8266)
+#include <Ticker.h>
+#endif
+
+// keeps the pack below CHARGE_STOP_PERC by switching the charger with a relay.
+//
+// The poller is asked to refresh remaining capacity, current and the cells every
+// CHARGE_CONTROL_MS whatever its mode, always in the same sweep, and every sample
+// carrying all three is decided on in the sample listener, right after the last
+// reply was decoded.
+// Charging stops at the capacity limit or when one cell reaches
+// CHARGE_CELL_MAX_MV and resumes below the lower thresholds.
+//
+// A watchdog opens the relay when no decision was made for CHARGE_DEADLINE_MS,
+// be it a dead bus or a loop() held up by a slow handler. On the esp it runs
+// from a Ticker. The esp32 calls it from the esp_timer task, so it fires while
+// loop() is blocked. The esp8266 calls it from the SDK timer, which only runs
+// when the sketch yields: a handler that neither returns nor calls yield() or
+// delay() holds the trip back until it does.
+class ChargeController {
+public:
+    enum Reason : uint8_t {
+        REASON_NONE = 0, // no decision yet, relay open
+        REASON_BELOW_LIMIT,
+        REASON_PERC_LIMIT,
+        REASON_CELL_LIMIT,
+        REASON_HYSTERESIS, // below the stop limits, waiting for the resume ones
+        REASON_WATCHDOG,
+    };
+
+    ChargeController(BatteryPoller &_poller);
+
+    // takes over the pin, the relay starts open
+    void begin(uint8_t _pin, bool _activeLow);
+
+    // sample listener, see BatteryPoller::onSample()
+    void add(const BatteryState &state);
+
+    // call from loop(): deadline check where there is no Ticker
+    void update();
+
+    bool enabled() const { return active; }
+    bool charging() const { return closed; }
+    Reason reason() const { return why; }
+    static PGM_P reasonText(Reason reason);
+
+    // sample request to relay write, in microseconds
+    const LatencyHistogram &latency() const { return decideTime; }
+    // longest time between two decisions in ms
+    unsigned long worstGapMs() const { return worstGap; }
+    // decisions that came later than CHARGE_DEADLINE_MS after the previous one
+    uint32_t deadlineMisses() const { return missed; }
+    uint32_t watchdogTrips() const { return trips; }
+    // samples still showing charge current while the relay was open
+    uint32_t relayFaults() const { return faults; }
+
+private:
+    BatteryPoller *poller;
+    uint8_t pin = 0;
+    bool activeLow = false;
+    bool active = false;
+    volatile bool closed = false;
+    volatile Reason why = REASON_NONE;
+    volatile unsigned long lastDecision = 0;
+    bool decided = false;
+
+    LatencyHistogram decideTime;
+    unsigned long worstGap = 0;
+    uint32_t missed = 0;
+    volatile uint32_t trips = 0;
+    uint32_t faults = 0;
+
+    #if defined(ESP32) || defined(ESP8266)
+    Ticker watchdog;
+    #endif
+
+    void write(bool close);
+    void trip();
+    static void onWatchdog(ChargeController *self);
+};
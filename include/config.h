@@ -1,16 +1,95 @@
 #pragma once
-#include <Arduino.h>
+#include "hal.h"
+#ifndef NATIVE
 #include <SoftwareSerial.h>
 #include <HardwareSerial.h>
+#endif
 
 #define CREATE_APN
 #define SSID F("Battery")
 #define PASSWORD F("")
 #define LOCAL_DNS_NAME F("battery")
+#define FAST_BOOT_LEASE true // station: a reset reconnects with the dhcp lease kept in RTC memory, needs a lease the router keeps
+#define FAST_BOOT_WIFI_MS 3000 // a reconnect on the cached channel and bssid taking longer falls back to a full scan
+// #define STATIC_IP 192, 168, 1, 50 // station: fixed address instead of dhcp
+#define STATIC_GATEWAY 192, 168, 1, 1
+#define STATIC_NETMASK 255, 255, 255, 0
 #define SERIAL_BAUDRATE 115200
+#define BATTERY_CELLS 10 // cells in series, 10 on ES1/2 packs, at most 16
+#define RESPONSE_TIMEOUT_MS 500 // deadline for a complete BMS response frame
+#define BATTERY_ADDRESSES {0x22} // bus address per pack, the first one feeds mqtt, history and the charge limit
+#define BATTERY_PACKS 1 // entries in BATTERY_ADDRESSES
+#define BUS_PIPELINE_DEPTH BATTERY_PACKS // requests to different packs on the bus at once, 1: strictly one after another
+// per field refresh, see BatteryPoller. Serial and factory capacity are read once
+#define POLL_LIVE_MS 1000 // status, current, voltage, remaining capacity
+#define POLL_DETAIL_MS 10000 // cells and temperatures
+#define POLL_SLOW_MS 3600000UL // actual capacity
+#define POLL_HEAVY_MA 5000 // discharge above this polls like charging
+#define POLL_ACTIVE_DIVISOR 2 // charging or heavy discharge: live and detail intervals / 2
+#define POLL_IDLE_MA 100 // below this and not charging the pack counts as idle
+#define POLL_IDLE_FACTOR 10 // idle: live and detail intervals * 10
+#define HISTORY_RAW_BYTES 4096 // every sample, ~20 min at the default poll interval
+#define HISTORY_MINUTE_BYTES 3072 // 1 min min/max/avg rollups, ~1 h
+#define HISTORY_QUARTER_BYTES 2048 // 15 min min/max/avg rollups, ~10 h
+#define FLASH_LOG_INTERVAL_S 60 // one persisted sample per minute
+#define FLASH_LOG_SEGMENTS 8 // segment files kept on LittleFS, the oldest is deleted
+#define FLASH_LOG_SEGMENT_BYTES 4096 // one flash block, 102 samples
+#define FLASH_LOG_BATCH 8 // samples buffered in RAM per write, lost on reset
+
+// #define MQTT_HOST "192.168.4.2" // enables the mqtt publisher
+#define MQTT_PORT 1883
+#define MQTT_CLIENT_ID "battery"
+#define MQTT_TOPIC_PREFIX "battery"
+#define MQTT_KEEPALIVE_S 30
+#define MQTT_REFRESH_S 300 // republish every field at least this often, deadband or not
+
+#define HTTP_MAX_CLIENTS 6 // connections served side by side, further ones get a 503
+#define HTTP_STREAMS 2 // streamed bodies (history, log, metrics, ...) in flight, requests queue for a slot
+#define HTTP_BUFFER_SIZE 640 // output buffer per connection
+#define HTTP_STREAM_SIZE 640 // room for the largest StreamSource
+#define HTTP_IDLE_MS 5000 // keep-alive connections and half sent requests are closed after this
+#define HTTP_STALL_MS 10000 // a client taking no response bytes for this long is dropped
+
+#define SSE_MAX_CLIENTS 4 // /events subscribers, each holds a tcp connection
+#define SSE_KEEPALIVE_MS 15000 // comment line to idle clients, finds dead connections
+
+// #define CHARGE_RELAY_PIN 5 // enables the charge limit, relay between charger and pack
+#define CHARGE_RELAY_ACTIVE_LOW false // true for relay boards that switch on a low input
+#define CHARGE_STOP_PERC 80
+#define CHARGE_RESUME_PERC 75
+#define CHARGE_CELL_MAX_MV 4150 // any cell at or above stops charging
+#define CHARGE_CELL_RESUME_MV 4100 // all cells at or below before it resumes
+#define CHARGE_CONTROL_MS 1000 // capacity, current and cells are read at least this often
+#define CHARGE_DEADLINE_MS 3000 // without a decision for this long the relay opens
+#define CHARGE_FAULT_MA 200 // charge current above this with the relay open counts as a fault
+
+// #define DUTY_CYCLE_S 60 // low power operation, one burst read per period, see DutyCycle
+#define DUTY_CYCLE_DEEP true // deep sleep, needs GPIO16 wired to RST and has no web server.
+                             // false: light sleep, needs station mode (no CREATE_APN)
+#define DUTY_PUBLISH_EVERY 15 // deep: radio on at least every n-th wake, right away when a value moved
+#define DUTY_BURST_MS 2000 // deep: a wake without radio gives up after this long
+#define DUTY_RADIO_BURST_MS 10000 // deep: a wake with radio, wifi and mqtt connect included
+#define DUTY_IDLE_MS 50 // light: sleep per loop() pass once nothing is pending, POLL_* still apply
+// energy estimate of the monitor itself, esp8266 datasheet figures
+#define DUTY_AWAKE_MA 20 // cpu on, radio off
+#define DUTY_RADIO_MA 75 // cpu and radio on
+#define DUTY_DEEP_SLEEP_UA 20
+#define DUTY_LIGHT_SLEEP_UA 1000
+
+#define STATS_EWMA_S 60 // time constant of the smoothed current and power behind time to empty/full
+#define STATS_MIN_CURRENT_MA 50 // no time to empty/full below this smoothed current
+#define STATS_MAX_GAP_S 120 // the current is not integrated across longer gaps between samples
+
+// #define BUS_CAPTURE_BYTES 8192 // RAM ring of raw bus traffic for /api/capture and tools/replay
+// #define TRACE_SPANS 256 // ring of loop() phase and bus transaction spans for /trace, 12 bytes each
+#define TRACE_MIN_US 500 // shorter spans are not kept
 
 // #define DEBUG
-#ifdef DEBUG
+#if defined(NATIVE)
+#include "native/posix_serial.h"
+#define SERIAL_TYPE PosixSerial
+#define NATIVE_HTTP_PORT 8080
+#elif defined(DEBUG)
 #define SERIAL_TYPE SoftwareSerial
 #else
 #define SERIAL_TYPE HardwareSerial
@@ -0,0 +1,28 @@
+#pragma once
+#include "hal.h"
+#include "battery.h"
+#include "stream_source.h"
+
+// streams the dashboard page straight from the flash template, placeholder
+// values are formatted one at a time into a small member buffer
+class DashboardRenderer : public StreamSource {
+public:
+    // age: seconds since the snapshot was taken, negative if there is no sample yet
+    DashboardRenderer(const BatteryState &_state, long _age);
+
+    size_t read(char *buf, size_t max) override;
+
+private:
+    const BatteryState *state;
+    long age;
+    size_t token = 0;
+    size_t offset = 0; // already copied bytes of the current token
+    char value[48]{};
+    size_t valueLen = 0;
+    bool valueReady = false;
+
+    void formatSlot(uint8_t slot);
+};
+
+// the page template with its {{placeholders}}, in flash
+PGM_P dashboardTemplate();
@@ -0,0 +1,85 @@
+#pragma once
+#include "hal.h"
+#include "battery.h"
+
+// low power operation for a monitor that runs off the pack it watches, see
+// DUTY_CYCLE_S in config.h.
+//
+// Deep: every wake is a reset. The burst reads one sample with the radio off,
+// keeps it in RTC memory and sleeps until the next period. Only when the sample
+// moved past the mqtt deadbands since the last publish, or every
+// DUTY_PUBLISH_EVERY wakes, the next wake brings up the radio and publishes.
+// Light: wifi and the web server stay up, the radio dozes between beacons and
+// loop() sleeps instead of spinning once nothing is pending.
+//
+// Awake and sleeping time are accounted in both, across deep sleep in RTC
+// memory, and turned into an estimate of the monitor's own drain.
+class DutyCycle {
+public:
+    struct Report {
+        uint32_t cycles; // deep: wakes since power on, light: idle loop() passes
+        uint32_t radioCycles; // wakes with the radio on, all of them in light
+        uint32_t timeouts; // bursts that ran out of time before they were done
+        uint32_t lastAwakeMs;
+        uint32_t maxAwakeMs;
+        uint64_t awakeMs;
+        uint64_t radioAwakeMs;
+        uint64_t sleptMs;
+    };
+
+    // deep: loads RTC memory and decides whether this wake uses the radio.
+    // radio tells whether there is anything to bring it up for
+    void begin(uint32_t _cycleS, bool _deep, bool radio);
+
+    bool enabled() const { return cycleS != 0; }
+    bool deep() const { return isDeep; }
+    // the previous wake left its state behind
+    bool resumed() const { return restored; }
+    const BatteryState &cached() const { return rtc.state; }
+    // deep: this wake is meant to publish
+    bool radioOn() const { return radioNow; }
+
+    // deep: the burst had its time
+    bool burstExpired() const;
+
+    // deep: stores the state and sleeps until the next period, never returns.
+    // published: this wake got the sample to the broker
+    [[noreturn]] void sleep(const BatteryState &state, bool sampled, bool published);
+
+    // light: accounts the busy part of a loop() pass and sleeps DUTY_IDLE_MS
+    void idle(unsigned long passUs);
+
+    const Report &report() const { return rtc.report; }
+    // estimated average current in uA from the DUTY_*_MA/UA figures
+    uint32_t averageUa() const;
+    size_t formatReport(char *buf, size_t size) const;
+
+private:
+    // kept in RTC memory, a multiple of 4 bytes for the esp8266 accessors
+    struct RtcBlock {
+        uint32_t magic;
+        Report report;
+        BatteryState state; // newest sample
+        BatteryState published; // what went to the broker last
+        uint16_t sincePublish; // wakes since
+        uint8_t radioNext;
+        uint8_t hasState;
+        uint16_t pad;
+        uint16_t crc;
+    };
+    static_assert(sizeof(RtcBlock) % 4 == 0 && sizeof(RtcBlock) <= 256, "RtcBlock must fit the lower half of rtc user memory, FastBoot has the upper");
+
+    RtcBlock rtc{};
+    uint32_t cycleS = 0;
+    bool isDeep = false;
+    bool radio = false;
+    bool radioNow = false;
+    bool restored = false;
+    uint32_t busyUs = 0; // light: below one ms, carried to the next pass
+
+    uint16_t rtcCrc() const;
+    // platform part, src/duty_cycle.cpp on the esp, src/native/duty_cycle.cpp
+    bool loadRtc();
+    void storeRtc();
+    [[noreturn]] void powerDown(uint32_t ms, bool radioOnWake);
+};
@@ -0,0 +1,63 @@
+#pragma once
+#include "hal.h"
+#include "http_server.h"
+#include "battery.h"
+
+typedef HttpClient EventClient;
+
+// server-sent events for /events. Every new snapshot is encoded once into a
+// shared frame and fanned out to all subscribers, so bus traffic and encoding
+// cost do not grow with the number of viewers.
+//
+// Each subscriber has a queue of depth one: a client that is still busy with
+// a frame skips straight to the newest one when it is done, one that falls a
+// whole frame behind is dropped. Writes never exceed availableForWrite(), so
+// a slow client can not stall loop().
+class EventHub {
+public:
+    static const uint8_t maxClients = SSE_MAX_CLIENTS;
+
+    // writes the response head and takes over the connection, false if all slots are used
+    bool subscribe(EventClient client);
+
+    // call from loop(): encodes a new snapshot version and feeds the clients
+    void update(const BatteryState &state, uint32_t version, bool sampled);
+
+    uint8_t clientCount() const;
+    uint32_t framesEncoded() const { return encoded; }
+    uint32_t framesSent() const { return sent; }
+    // frames a client skipped because a newer one was already there
+    uint32_t framesSkipped() const { return skipped; }
+    // clients disconnected for being a whole frame behind
+    uint32_t clientsDropped() const { return dropped; }
+
+private:
+    static const size_t frameSize = 600;
+
+    struct Frame {
+        uint32_t version = 0;
+        uint16_t len = 0;
+        char text[frameSize];
+    };
+    struct Subscriber {
+        EventClient client;
+        bool active = false;
+        int8_t frame = -1; // frame being written, -1 when idle
+        uint16_t offset = 0;
+        uint32_t version = 0; // last frame written completely
+        unsigned long lastWrite = 0;
+    };
+
+    Frame frames[2];
+    uint8_t latest = 0;
+    Subscriber subscribers[maxClients];
+
+    uint32_t encoded = 0;
+    uint32_t sent = 0;
+    uint32_t skipped = 0;
+    uint32_t dropped = 0;
+
+    void encode(const BatteryState &state, uint32_t version, bool sampled);
+    void feed(Subscriber &sub, unsigned long now);
+    void release(Subscriber &sub);
+};
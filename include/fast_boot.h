@@ -0,0 +1,75 @@
+#pragma once
+#include "hal.h"
+#include "battery.h"
+
+// quick start after a watchdog reset or a deep sleep wake, both keep RTC
+// memory. The station reconnects on the cached channel and bssid with the
+// cached dhcp lease (or STATIC_IP) while loop() already polls the bus, and the
+// last sample of each pack is served, marked BATTERY_ERR_RESTORED and not
+// sampled, until the first fresh one. A power on starts cold.
+class FastBoot {
+public:
+    // what the last association used, addresses in IPAddress byte order
+    struct WifiCache {
+        uint8_t bssid[6];
+        uint8_t channel;
+        uint8_t valid;
+        uint32_t ip;
+        uint32_t gateway;
+        uint32_t netmask;
+        uint32_t dns;
+    };
+    // packs whose last sample fits the block, the first ones of BATTERY_ADDRESSES
+    static const int cachedPacks = BATTERY_PACKS < 3 ? BATTERY_PACKS : 3;
+
+    // loads RTC memory, first thing in setup()
+    void begin();
+
+    // the last sample of the pack from before the reset, false on a cold start
+    bool restore(int pack, BatteryState &state) const;
+    // keeps a sample of the pack for the next boot, from BatteryPoller::onSample()
+    void store(int pack, const BatteryState &state);
+
+    // nullptr on a cold start or after forgetWifi()
+    const WifiCache *wifi() const { return rtc.wifi.valid ? &rtc.wifi : nullptr; }
+    void storeWifi(const WifiCache &cache);
+    // the cached parameters did not get us on the network
+    void forgetWifi();
+
+    enum WifiStart : uint8_t {
+        BOOT_WIFI_CONNECTING = 0,
+        BOOT_WIFI_CACHED, // associated with the cached parameters
+        BOOT_WIFI_SCANNED, // full scan, a cold start or the cache did not work
+        BOOT_WIFI_ACCESS_POINT, // CREATE_APN
+        BOOT_WIFI_NONE, // host build
+    };
+
+    // boot milestones for /api/boot, millis() since the reset
+    void wifiUp(WifiStart how);
+    void sampled();
+    size_t formatReport(char *buf, size_t size) const;
+
+private:
+    // kept in RTC memory behind the DutyCycle block, a multiple of 4 bytes
+    struct RtcBlock {
+        uint32_t magic;
+        WifiCache wifi;
+        uint8_t hasState; // bit per pack
+        uint8_t pad[3];
+        BatteryState states[cachedPacks];
+        uint16_t boots; // resets that found the block
+        uint16_t crc;
+    };
+    static_assert(sizeof(RtcBlock) % 4 == 0 && sizeof(RtcBlock) <= 256, "RtcBlock must fit the upper half of rtc user memory");
+
+    RtcBlock rtc{};
+    bool warm = false;
+    WifiStart wifiStart = BOOT_WIFI_CONNECTING;
+    unsigned long wifiMs = 0;
+    unsigned long sampleMs = 0;
+
+    uint16_t rtcCrc() const;
+    // platform part, src/fast_boot.cpp on the esp, src/native/fast_boot.cpp
+    bool loadRtc();
+    void storeRtc();
+};
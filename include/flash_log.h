@@ -0,0 +1,120 @@
+#pragma once
+#include "hal.h"
+#include "battery.h"
+#include "stream_source.h"
+#ifdef NATIVE
+#include "native/fs_shim.h"
+#else
+#include <LittleFS.h>
+#endif
+
+// one persisted sample, written as is (both targets are little endian)
+struct LogRecord {
+    uint32_t time; // log clock, see FlashLog::now()
+    uint16_t boot;
+    int16_t status;
+    int16_t remaining_capacity_perc;
+    int16_t remaining_capacity;
+    int16_t voltage; // 10 mV
+    int16_t current; // 10 mA
+    int8_t temp_zone0, temp_zone1;
+    int16_t cells[10]; // mV
+    uint16_t crc; // crc16 of everything before it
+};
+static_assert(sizeof(LogRecord) == 40, "LogRecord is part of the on-flash format");
+
+// append-only sample log on LittleFS.
+//
+// Samples go to /log/<seq> segment files of fixed size: a 16 byte header
+// (magic, version, record size, sequence, time of the first record) followed
+// by fixed size records. Records of a segment are sorted by time, so its time
+// range is the header plus one read of the last record, and a range query
+// binary searches inside the segment. Records are batched in RAM and written
+// FLASH_LOG_BATCH at a time, the oldest segment is deleted once
+// FLASH_LOG_SEGMENTS exist. A torn tail (partial or corrupt last record) is
+// cut off in begin().
+class FlashLog {
+public:
+    struct Segment {
+        uint32_t seq;
+        uint32_t start;
+        uint32_t end;
+        uint16_t count;
+    };
+
+    // mounts the filesystem, indexes and repairs the segments. Without a
+    // filesystem the log stays disabled.
+    bool begin();
+
+    // stores one sample every FLASH_LOG_INTERVAL_S
+    void add(const BatteryState &state);
+
+    // writes the batched records
+    void flush();
+
+    // seconds, continues from the newest record after a reset so time stays
+    // monotonic across reboots (time spent powered off is not counted)
+    uint32_t now() const { return base + millis() / 1000; }
+
+    uint16_t bootCount() const { return boot; }
+
+    // crc16/ccitt over len bytes
+    static uint16_t crc16(const uint8_t *data, size_t len);
+
+    class Cursor {
+    public:
+        bool next(LogRecord &record);
+
+    private:
+        friend class FlashLog;
+        const FlashLog *log = nullptr;
+        uint32_t seq = 0;
+        uint32_t index = 0;
+        uint32_t to = 0;
+        File file;
+    };
+
+    // records with from <= time <= to, oldest first
+    Cursor query(uint32_t from, uint32_t to) const;
+
+private:
+    static const uint32_t magic = 0x474C424E; // "NBLG"
+    static const uint8_t version = 1;
+    static const size_t headerSize = 16;
+    static const uint32_t recordsPerSegment = (FLASH_LOG_SEGMENT_BYTES - headerSize) / sizeof(LogRecord);
+
+    bool mounted = false;
+    Segment segments[FLASH_LOG_SEGMENTS]{}; // oldest first
+    int segmentCount = 0;
+    LogRecord pending[FLASH_LOG_BATCH]{};
+    int pendingCount = 0;
+    uint32_t base = 0;
+    uint16_t boot = 0;
+    uint32_t lastStored = 0;
+    bool stored = false;
+
+    static String segmentPath(uint32_t seq);
+    static bool validRecord(const LogRecord &record);
+
+    const Segment *findSegment(uint32_t seq) const;
+
+    // reads the header and the last record, cuts a torn tail, false if the segment is unusable
+    bool loadSegment(uint32_t seq, Segment &segment);
+
+    bool startSegment(uint32_t start);
+};
+
+// /api/log body: {"now":..,"boot":..,"rows":[[time,boot,status,perc,rem,voltage,current,t0,t1,c0..c9],..]}
+class FlashLogSource : public RecordSource {
+public:
+    FlashLogSource(const FlashLog &log, uint32_t from, uint32_t to);
+
+protected:
+    size_t nextRecord(char *line, size_t size) override;
+
+private:
+    const FlashLog *flashLog;
+    FlashLog::Cursor cursor;
+    enum Part { PART_HEAD, PART_ROWS, PART_DONE } part = PART_HEAD;
+    bool firstRow = true;
+};
@@ -0,0 +1,88 @@
+#pragma once
+#include <stddef.h>
+#include <stdint.h>
+
+// 5A A5 len src dst cmd arg payload[len] crc_lo crc_hi
+struct NinebotFrame {
+    static const size_t overhead = 9;
+
+    const uint8_t *data = nullptr; // whole frame, header included
+    size_t len = 0;
+
+    uint8_t payloadLen() const { return data[2]; }
+    uint8_t src() const { return data[3]; }
+    uint8_t dst() const { return data[4]; }
+    uint8_t cmd() const { return data[5]; }
+    uint8_t arg() const { return data[6]; }
+    const uint8_t *payload() const { return data + 7; }
+};
+
+// request with a one byte payload, 5A A5 01 src dst cmd reg arg crc_lo crc_hi.
+// For a register read (cmd 0x01) arg is the number of bytes wanted.
+struct NinebotRequest {
+    static const size_t size = 10;
+    uint8_t bytes[size];
+};
+
+constexpr uint16_t ninebotRequestChecksum(uint8_t src, uint8_t dst, uint8_t cmd, uint8_t reg, uint8_t arg) {
+    return uint16_t(0xFFFF - (0x01 + src + dst + cmd + reg + arg));
+}
+
+// constexpr, so requests with constant arguments are built by the compiler, checksum included
+constexpr NinebotRequest ninebotRequest(uint8_t src, uint8_t dst, uint8_t cmd, uint8_t reg, uint8_t arg) {
+    return NinebotRequest{{0x5A, 0xA5, 0x01, src, dst, cmd, reg, arg,
+                           uint8_t(ninebotRequestChecksum(src, dst, cmd, reg, arg)),
+                           uint8_t(ninebotRequestChecksum(src, dst, cmd, reg, arg) >> 8)}};
+}
+
+// the status and cell requests the firmware used to carry as literal arrays
+static_assert(ninebotRequest(0x20, 0x22, 0x01, 0x30, 0x02).bytes[8] == 0x89 &&
+              ninebotRequest(0x20, 0x22, 0x01, 0x30, 0x02).bytes[9] == 0xFF, "checksum of get_status");
+static_assert(ninebotRequest(0x20, 0x22, 0x01, 0x40, 0x14).bytes[8] == 0x67, "checksum of get_cells_voltage");
+
+// constant memory ninebot frame parser, fed with arbitrary chunks of the byte
+// stream. Frames are handed out as views into the ring, nothing is copied.
+//
+// Every byte is stored twice (at i and i + capacity), so any window of up to
+// capacity bytes is contiguous in memory even when it wraps around the ring.
+class NinebotFrameParser {
+public:
+    static const size_t capacity = 128; // power of two, >= largest frame (255 + 9 does not fit, those are dropped)
+    static const size_t maxFrameLen = capacity;
+
+    // stores as many bytes as fit, returns how many were taken
+    size_t feed(const uint8_t *bytes, size_t len);
+
+    // looks for the next frame with a valid checksum, skipping garbage in front of it.
+    // The view stays valid until the next call to feed(), next() or reset().
+    bool next(NinebotFrame &frame);
+
+    void reset();
+
+    size_t buffered() const { return head - tail; }
+    size_t space() const { return capacity - buffered(); }
+
+    // bytes skipped while looking for a frame start
+    uint32_t resyncs() const { return skipped; }
+    // frames that were complete but failed the checksum
+    uint32_t crcErrors() const { return badCrc; }
+
+    // same sum as the one on the wire: 0xFFFF - (len + src + dst + cmd + arg + payload)
+    static uint16_t checksum(const uint8_t *frame, size_t payloadLen);
+
+private:
+    static const size_t mask = capacity - 1;
+
+    uint8_t ring[capacity * 2]{};
+    size_t head = 0; // free running write position
+    size_t tail = 0; // free running read position
+    size_t consumed = 0; // length of the frame handed out last, dropped lazily
+    uint32_t skipped = 0;
+    uint32_t badCrc = 0;
+
+    const uint8_t *at(size_t pos) const { return &ring[pos & mask]; }
+
+    void drop(size_t len);
+
+    void releaseConsumed();
+};
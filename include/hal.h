@@ -0,0 +1,7 @@
+#pragma once
+// thin hardware abstraction: the arduino core on the esp, posix shims for [env:native]
+#ifdef NATIVE
+#include "native/arduino_shim.h"
+#else
+#include <Arduino.h>
+#endif
@@ -0,0 +1,26 @@
+#pragma once
+#include "hal.h"
+
+// fixed memory latency histogram with power of two buckets: bucket i counts
+// durations up to 128 us << i, the last one everything slower than ~1 s.
+// observe() is a count-leading-zeros and two adds.
+class LatencyHistogram {
+public:
+    static const uint8_t buckets = 14; // finite bounds, +Inf comes on top
+
+    void observe(uint32_t us);
+
+    // not cumulative, i == buckets is the +Inf overflow
+    uint32_t bucket(uint8_t i) const { return counts[i]; }
+    uint32_t count() const { return total; }
+    uint64_t sumUs() const { return sum; }
+    uint32_t maxUs() const { return peak; }
+
+    static uint32_t boundUs(uint8_t i) { return uint32_t(128) << i; }
+
+private:
+    uint32_t counts[buckets + 1]{};
+    uint32_t total = 0;
+    uint64_t sum = 0;
+    uint32_t peak = 0;
+};
@@ -0,0 +1,119 @@
+#pragma once
+#include "hal.h"
+#include "battery.h"
+#include "stream_source.h"
+
+// ring of fixed size blocks holding delta encoded records of int16 channels.
+// A block starts from zero, every record stores the time delta, a bitmask of
+// the changed channels and their zigzag varint deltas. Appending never
+// allocates, a full ring evicts its oldest block.
+class DeltaLog {
+public:
+    static const uint8_t maxChannels = 64; // 16 cell rollups
+    static const size_t blockSize = 256;
+
+    DeltaLog(uint8_t *_storage, size_t size, uint8_t _channels);
+
+    void append(uint32_t t, const int16_t values[]);
+
+    uint8_t channelCount() const { return channels; }
+
+    // walks the records from old to new, stays valid while records are appended
+    class Cursor {
+    public:
+        bool next(uint32_t &t, int16_t values[]);
+
+    private:
+        friend class DeltaLog;
+        const DeltaLog *log = nullptr;
+        uint32_t block = 0; // sequence number, not the ring index
+        size_t pos = 0;
+        uint32_t since = 0;
+        uint32_t t = 0;
+        int16_t prev[maxChannels]{};
+
+        void enter(uint32_t seq);
+    };
+
+    // cursor positioned on the first record newer than since, whole blocks are skipped by their start time
+    Cursor read(uint32_t since) const;
+
+private:
+    static const size_t headerSize = 6; // uint32 start time + uint16 used bytes
+
+    uint8_t *storage;
+    size_t blocks;
+    uint8_t channels;
+    uint32_t written = 0; // blocks ever started, the newest one is written - 1
+    uint32_t lastT = 0;
+    int16_t last[maxChannels]{};
+
+    uint8_t *blockAt(uint32_t seq) const { return storage + (seq % blocks) * blockSize; }
+    uint32_t oldest() const { return written > blocks ? written - blocks : 0; }
+    static uint32_t blockStart(const uint8_t *block);
+    static uint16_t blockUsed(const uint8_t *block);
+
+    void startBlock(uint32_t t);
+};
+
+// keeps the sample history of the pack in three resolutions
+class TelemetryHistory {
+public:
+    enum Resolution {
+        RES_SAMPLE = 0, // every poll
+        RES_MINUTE = 1,
+        RES_QUARTER = 2,
+    };
+    // voltage, current (10 mV / 10 mA), soc, temp zone 0/1, the cells (mV)
+    static const uint8_t channels = 5 + BATTERY_CELLS;
+    static const uint8_t rollupChannels = channels * 3; // min, max, avg per channel
+    static_assert(rollupChannels <= DeltaLog::maxChannels, "rollups do not fit a DeltaLog record");
+
+    TelemetryHistory();
+
+    void add(const BatteryState &state);
+
+    const DeltaLog &log(Resolution res) const;
+
+    static const char *channelName(uint8_t channel);
+
+private:
+    struct Rollup {
+        uint32_t period = 0;
+        uint16_t count = 0;
+        int16_t min[channels]{};
+        int16_t max[channels]{};
+        int32_t sum[channels]{};
+
+        void add(const int16_t values[]);
+        void flush(DeltaLog &log, uint32_t periodSeconds);
+    };
+
+    uint8_t rawStorage[HISTORY_RAW_BYTES]{};
+    uint8_t minuteStorage[HISTORY_MINUTE_BYTES]{};
+    uint8_t quarterStorage[HISTORY_QUARTER_BYTES]{};
+    DeltaLog raw;
+    DeltaLog minutes;
+    DeltaLog quarters;
+    Rollup minute;
+    Rollup quarter;
+
+    void rollup(Rollup &acc, DeltaLog &log, uint32_t periodSeconds, uint32_t t, const int16_t values[]);
+};
+
+// /api/history body: {"res":..,"columns":[..],"rows":[[t,..],..]}
+class HistorySource : public RecordSource {
+public:
+    HistorySource(const TelemetryHistory &history, TelemetryHistory::Resolution _res, uint32_t since);
+
+protected:
+    size_t nextRecord(char *line, size_t size) override;
+
+private:
+    TelemetryHistory::Resolution res;
+    DeltaLog::Cursor cursor;
+    uint8_t channels;
+    uint8_t column = 0;
+    enum Part { PART_HEAD, PART_COLUMNS, PART_ROWS, PART_DONE } part = PART_HEAD;
+    bool firstRow = true;
+};
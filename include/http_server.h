@@ -0,0 +1,216 @@
+#pragma once
+#include <new>
+#include <utility>
+#include "hal.h"
+#include "config.h"
+#include "stream_source.h"
+#ifndef NATIVE
+#include <ESPAsyncTCP.h>
+#endif
+
+#define CONTENT_LENGTH_UNKNOWN ((size_t) -1)
+
+class HttpServer;
+
+// a connection a handler took over with HttpServer::client(), see /events.
+// Writes go through the connection's output buffer, availableForWrite() is the
+// room left in it. Copies refer to the same connection.
+class HttpClient {
+public:
+    bool connected() const;
+    size_t availableForWrite() const;
+    size_t write(const uint8_t *data, size_t len);
+    void setNoDelay(bool noDelay);
+    void stop();
+
+private:
+    friend class HttpServer;
+    HttpServer *server = nullptr;
+    uint8_t slot = 0;
+    uint16_t generation = 0; // of the slot when the handle was made, a reused slot is not ours
+};
+
+// event driven HTTP/1.1 server for the routes in site.hpp, on ESPAsyncTCP on
+// the esp and non-blocking posix sockets natively.
+//
+// HTTP_MAX_CLIENTS connections are served side by side, each with a fixed
+// output buffer. update() parses what arrived, runs the handler of every
+// complete request and moves response bytes only as fast as each client takes
+// them, so a slow client holds its own slot and nothing else. Handlers keep
+// the ESP8266WebServer style: read args, set headers, send(). Larger bodies
+// are StreamSources built in place with sendStream() and pulled whenever the
+// buffer has room; up to HTTP_STREAMS of them run at once, further requests
+// wait for a free one. Connections are kept alive unless the client says close.
+class HttpServer {
+public:
+    typedef void (*Handler)();
+
+    explicit HttpServer(uint16_t _port);
+
+    void on(const __FlashStringHelper *uri, Handler handler);
+    void onNotFound(Handler handler);
+    // request headers handlers can read with header(), all others are skipped
+    void collectHeaders(const char *keys[], size_t count);
+    void begin();
+
+    // call from loop(): accepts, dispatches complete requests and moves response bytes
+    void update();
+
+    // the request being handled
+    String uri() const;
+    bool hasArg(const __FlashStringHelper *name) const;
+    String arg(const __FlashStringHelper *name) const;
+    String header(const __FlashStringHelper *name) const;
+    // takes the connection over, the server writes nothing more to it
+    HttpClient client();
+
+    // response of the request being handled, headers go before send()
+    void sendHeader(const __FlashStringHelper *name, const String &value, bool first = false);
+    void send(int code, const char *contentType = nullptr, const String &content = String());
+    void send(int code, const char *contentType, const char *content, size_t len);
+    // body stays in flash and is copied out as the client reads it
+    void send_P(int code, PGM_P contentType, PGM_P content, size_t len);
+
+    // chunked response with a Source(args...) body, built in one of the HTTP_STREAMS slots
+    template <typename Source, typename... Args>
+    void sendStream(int code, const char *contentType, Args &&...args) {
+        static_assert(sizeof(Source) <= HTTP_STREAM_SIZE, "body too large for a stream slot, raise HTTP_STREAM_SIZE");
+        if (current == nullptr || responded) return;
+        int8_t slot = claimStream();
+        if (slot < 0) {
+            send(503, "text/plain", "503: busy");
+            return;
+        }
+        startStream(code, contentType, slot, new (streams[slot].storage) Source(std::forward<Args>(args)...));
+    }
+
+    uint32_t requests() const { return served; }
+    // connections closed right away because every slot was taken
+    uint32_t rejected() const { return refused; }
+    // connections closed for being idle or for not taking their response
+    uint32_t timeouts() const { return expired; }
+    uint8_t connections() const;
+
+private:
+    friend class HttpClient;
+
+    static const uint8_t maxRoutes = 24;
+    static const uint8_t maxCollected = 2;
+    static const size_t targetSize = 128;
+    static const size_t headerValueSize = 48;
+    static const size_t fieldSize = 24;
+
+    enum ConnState : uint8_t {
+        CONN_FREE = 0,
+        CONN_REQUEST, // reading the request head
+        CONN_READY, // complete, waiting for dispatch
+        CONN_RESPONSE, // response bytes pending
+        CONN_EVENTS, // taken over by a handler
+        CONN_CLOSING, // closed by us, waiting for the transport to let go
+    };
+    enum ParseState : uint8_t {
+        PARSE_METHOD = 0,
+        PARSE_TARGET,
+        PARSE_VERSION,
+        PARSE_NAME, // start of a header line
+        PARSE_VALUE,
+        PARSE_SKIP, // rest of a header line nobody wants
+    };
+
+    struct Connection {
+        ConnState state = CONN_FREE;
+        uint16_t generation = 0;
+        bool gone = false; // the transport is closed, free once nothing refers to it
+        bool keepAlive = false;
+        bool noDelay = false;
+
+        // request, parsed byte by byte as it arrives
+        ParseState parse = PARSE_METHOD;
+        bool tooLong = false;
+        bool headOnly = false; // HEAD, the response goes without its body
+        uint16_t headBytes = 0;
+        uint8_t header = 0; // PARSE_VALUE: which one, maxCollected is Connection
+        char target[targetSize]{};
+        uint8_t targetLen = 0;
+        char field[fieldSize]{}; // version or header name
+        uint8_t fieldLen = 0;
+        char headerValues[maxCollected][headerValueSize]{};
+        uint8_t valueLen = 0;
+
+        // response
+        char out[HTTP_BUFFER_SIZE];
+        size_t outStart = 0;
+        size_t outEnd = 0;
+        int8_t stream = -1; // HTTP_STREAMS slot of the body
+        PGM_P flash = nullptr; // send_P() body
+        size_t flashLeft = 0;
+        unsigned long lastActivity = 0;
+
+        #ifdef NATIVE
+        int fd = -1;
+        #else
+        AsyncClient *tcp = nullptr;
+        #endif
+    };
+    struct Route {
+        const __FlashStringHelper *uri;
+        Handler handler;
+    };
+    struct Stream {
+        alignas(8) uint8_t storage[HTTP_STREAM_SIZE];
+        StreamSource *body = nullptr;
+    };
+
+    uint16_t port;
+    Route routes[maxRoutes]{};
+    uint8_t routeCount = 0;
+    Handler notFound = nullptr;
+    const char *collected[maxCollected]{};
+    uint8_t collectedCount = 0;
+
+    Connection conns[HTTP_MAX_CLIENTS];
+    Stream streams[HTTP_STREAMS];
+
+    // the request being handled and its response head
+    Connection *current = nullptr;
+    char headers[256]{};
+    size_t headersLen = 0;
+    bool responded = false;
+
+    uint32_t served = 0;
+    uint32_t refused = 0;
+    uint32_t expired = 0;
+
+    void dispatch(Connection &conn);
+    bool writeHead(int code, const char *contentType, size_t len);
+    bool appendOut(Connection &conn, const char *data, size_t len);
+    // replaces a response that did not fit the buffer, closes the connection after it
+    void sendTooLarge();
+    int8_t claimStream();
+    void startStream(int code, const char *contentType, int8_t slot, StreamSource *body);
+    void releaseStream(Connection &conn);
+    // refills the buffer from the body and hands it to the transport, true once all is out
+    bool pump(Connection &conn);
+    void finish(Connection &conn);
+    void reset(Connection &conn);
+    void parse(Connection &conn, const uint8_t *data, size_t len);
+    void endField(Connection &conn);
+    const char *query(const Connection &conn, const char *name, size_t &len) const;
+    Connection *handle(const HttpClient &client) const;
+
+    // platform part, src/http_server.cpp on the esp, src/native/http_server.cpp
+    #ifdef NATIVE
+    int listenFd = -1;
+    #else
+    AsyncServer *listener = nullptr;
+    #endif
+    void listen();
+    // native: accepts, reads and closes, on the esp the tcp callbacks do that
+    void poll();
+    // bytes the transport took
+    size_t transmit(Connection &conn, const char *data, size_t len);
+    void disconnect(Connection &conn, bool abort);
+    void applyNoDelay(Connection &conn);
+    // slot for a new transport connection, nullptr if every one is taken
+    Connection *claimConnection();
+};
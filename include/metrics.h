@@ -0,0 +1,35 @@
+#pragma once
+#include "hal.h"
+#include "battery.h"
+#include "histogram.h"
+#include "pack_stats.h"
+#include "stream_source.h"
+
+// /metrics body in the prometheus text format (version 0.0.4). Everything is
+// read from counters the bus code and the pack statistics keep anyway, one metric line per record.
+class MetricsSource : public RecordSource {
+public:
+    MetricsSource(const BatteryMonitor &_monitor, const BatteryPoller &_poller, const PackStats &_stats,
+                  const LatencyHistogram &_loopTime);
+
+protected:
+    size_t nextRecord(char *line, size_t size) override;
+
+private:
+    const BatteryMonitor *monitor;
+    const BatteryPoller *poller;
+    const PackStats *stats;
+    const LatencyHistogram *loopTime;
+
+    enum Part { PART_SCALARS, PART_ROUNDTRIP, PART_LOOP, PART_DONE } part = PART_SCALARS;
+    uint8_t item = 0;
+    uint8_t series = 0;
+    bool roundTripHeader = false; // written with the first series that has observations
+    uint8_t bucket = 0;
+    uint32_t cumulative = 0;
+
+    size_t writeScalar(char *line, size_t size, uint8_t index);
+    // one bucket line per call, sum and count after the last one. True once the histogram is done
+    bool writeHistogram(char *line, size_t size, int &len, const char *name, const char *help, const char *labels,
+                        const LatencyHistogram &histogram, bool header);
+};
@@ -0,0 +1,112 @@
+#pragma once
+#include "hal.h"
+#include "battery.h"
+#include "tcp_link.h"
+
+// publishes battery samples over mqtt 3.1.1 (qos 0) as <prefix>/<field>.
+//
+// A field is queued only when it moved past its deadband since it was last
+// published, the cells go out together as one json array. The queue holds
+// one slot per field, so a slow broker only ever sees the newest value.
+// Connecting, waiting for CONNACK and the retry backoff are all states of
+// update(), nothing in here waits.
+class MqttPublisher {
+public:
+    enum Field {
+        FIELD_STATUS = 0,
+        FIELD_PERC,
+        FIELD_REMAINING,
+        FIELD_VOLTAGE,
+        FIELD_CURRENT,
+        FIELD_POWER,
+        FIELD_TEMP0,
+        FIELD_TEMP1,
+        FIELD_CELLS,
+        FIELD_SERIAL,
+        FIELD_ERROR,
+        FIELD_COUNT,
+    };
+
+    // host is not copied, it has to outlive the publisher
+    void begin(const char *_host, uint16_t _port, const char *_clientId, const char *_prefix);
+
+    // queues the fields that changed past their deadband
+    void add(const BatteryState &state);
+
+    // call from loop(): connection state machine and sending of queued fields
+    void update();
+
+    // one message to <prefix>/<subtopic> right away, false if not connected or the link is full
+    bool publish(const char *subtopic, const char *payload);
+
+    // connected, nothing queued and every byte acked by the broker
+    bool flushed();
+
+    // true if any field of to moved past its deadband against from
+    static bool differs(const BatteryState &from, const BatteryState &to);
+
+    bool connected() const { return state == MQTT_CONNECTED; }
+    uint32_t messagesSent() const { return messages; }
+    uint32_t bytesSent() const { return bytes; }
+    uint32_t reconnects() const { return connects; }
+    // queued updates that were replaced by a newer value before they went out
+    uint32_t coalesced() const { return replaced; }
+
+private:
+    static const size_t publishPayloadMax = 256;
+
+    enum State {
+        MQTT_IDLE = 0, // waiting for the backoff to run out
+        MQTT_TCP_CONNECTING,
+        MQTT_WAIT_CONNACK,
+        MQTT_CONNECTED,
+    };
+
+    TcpLink link;
+    const char *host = nullptr;
+    uint16_t port = 1883;
+    const char *clientId = "battery";
+    const char *prefix = "battery";
+
+    State state = MQTT_IDLE;
+    unsigned long stateSince = 0;
+    unsigned long backoffMs = 0;
+    unsigned long lastSent = 0;
+    bool pingPending = false;
+
+    // deadband filter and the per-field queue
+    int32_t value[FIELD_COUNT]{};
+    int32_t published[FIELD_COUNT]{};
+    std::array<int16_t, BATTERY_CELLS> cells{};
+    std::array<int16_t, BATTERY_CELLS> publishedCells{};
+    char serial[sizeof(BatteryState::serial)]{};
+    BatteryError error = BATTERY_OK;
+    uint32_t dirty = 0;
+    uint32_t everPublished = 0;
+    unsigned long lastRefresh = 0;
+
+    // fixed header parser for what the broker sends us
+    uint8_t rxType = 0;
+    uint32_t rxRemaining = 0;
+    uint8_t rxBody[4]{};
+    uint8_t rxPos = 0;
+    bool rxInHeader = true;
+    uint8_t rxLenShift = 0;
+
+    uint32_t messages = 0;
+    uint32_t bytes = 0;
+    uint32_t connects = 0;
+    uint32_t replaced = 0;
+
+    void enter(State next);
+    void fail();
+    bool sendConnect();
+    bool sendPing();
+    bool sendPublish(const char *subtopic, const char *payload, size_t payloadLen);
+    bool sendField(Field field);
+    bool sendPacket(const uint8_t *packet, size_t len);
+    void receive();
+    void queue(Field field);
+    size_t formatField(Field field, char *buf, size_t size) const;
+    static void numericFields(const BatteryState &state, int32_t *out);
+};
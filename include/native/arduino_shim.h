@@ -0,0 +1,92 @@
+#pragma once
+// the subset of the arduino core the firmware uses, backed by the c/c++ runtime
+#include <math.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+typedef uint8_t byte;
+
+#define PROGMEM
+#define PGM_P const char *
+#define PSTR(s) (s)
+class __FlashStringHelper;
+#define FPSTR(p) (reinterpret_cast<const __FlashStringHelper *>(p))
+#define F(s) FPSTR(PSTR(s))
+
+#define memcpy_P memcpy
+#define strlen_P strlen
+#define strcmp_P strcmp
+#define strncmp_P strncmp
+#define strcasecmp_P strcasecmp
+#define snprintf_P snprintf
+#define pgm_read_byte(addr) (*reinterpret_cast<const uint8_t *>(addr))
+#define pgm_read_word(addr) (*reinterpret_cast<const uint16_t *>(addr))
+#define pgm_read_dword(addr) (*reinterpret_cast<const uint32_t *>(addr))
+#define pgm_read_ptr(addr) (*reinterpret_cast<const void *const *>(addr))
+#define strncpy_P strncpy
+
+// milliseconds / microseconds since the process started
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+// tools/replay runs the firmware on a clock of its own: once set, millis() and
+// micros() return it and delay() advances it instead of sleeping
+void setVirtualMicros(unsigned long us);
+void yield();
+[[noreturn]] void panic();
+
+// gpio writes are only printed, there is nothing to switch on the host
+#define INPUT 0
+#define OUTPUT 1
+#define LOW 0
+#define HIGH 1
+void pinMode(uint8_t pin, uint8_t mode);
+void digitalWrite(uint8_t pin, uint8_t value);
+
+class String {
+public:
+    String() = default;
+    String(const char *s) : str(s ? s : "") {}
+    String(const __FlashStringHelper *s) : str(reinterpret_cast<const char *>(s)) {}
+    explicit String(int value) : str(std::to_string(value)) {}
+    explicit String(unsigned int value) : str(std::to_string(value)) {}
+    explicit String(long value) : str(std::to_string(value)) {}
+    explicit String(unsigned long value) : str(std::to_string(value)) {}
+    explicit String(float value, unsigned char decimals = 2) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.*f", decimals, value);
+        str = buf;
+    }
+
+    const char *c_str() const { return str.c_str(); }
+    unsigned int length() const { return str.length(); }
+    bool reserve(unsigned int size) { str.reserve(size); return true; }
+    void replace(const String &find, const String &with) {
+        if (find.str.empty()) return;
+        for (size_t pos = str.find(find.str); pos != std::string::npos; pos = str.find(find.str, pos + with.str.size())) {
+            str.replace(pos, find.str.size(), with.str);
+        }
+    }
+    long toInt() const { return strtol(str.c_str(), nullptr, 10); }
+
+    String &operator+=(const String &other) { str += other.str; return *this; }
+    String &operator+=(const char *other) { str += other; return *this; }
+    String &operator+=(const __FlashStringHelper *other) { str += reinterpret_cast<const char *>(other); return *this; }
+
+    bool operator==(const String &other) const { return str == other.str; }
+    bool operator==(const char *other) const { return str == other; }
+    bool operator!=(const String &other) const { return str != other.str; }
+    bool operator!=(const char *other) const { return str != other; }
+
+    friend String operator+(String lhs, const String &rhs) { lhs += rhs; return lhs; }
+    friend String operator+(String lhs, const char *rhs) { lhs += rhs; return lhs; }
+    friend String operator+(const char *lhs, const String &rhs) { return String(lhs) + rhs; }
+
+private:
+    std::string str;
+};
@@ -0,0 +1,61 @@
+#pragma once
+// the LittleFS calls FlashLog uses, backed by a host directory (FLASH_FS_ROOT, default /tmp/flashfs)
+#include <memory>
+#include <vector>
+#include "native/arduino_shim.h"
+
+enum SeekMode {
+    SeekSet = 0,
+    SeekCur = 1,
+    SeekEnd = 2,
+};
+
+class File {
+public:
+    File() = default;
+    File(std::shared_ptr<FILE> _file, const String &_name) : file(_file), fileName(_name) {}
+
+    explicit operator bool() const { return file != nullptr; }
+    size_t write(const uint8_t *buf, size_t len);
+    size_t read(uint8_t *buf, size_t len);
+    bool seek(uint32_t pos, SeekMode mode = SeekSet);
+    size_t position() const;
+    size_t size() const;
+    bool truncate(uint32_t size);
+    void flush();
+    void close() { file.reset(); }
+    const char *name() const { return fileName.c_str(); }
+
+private:
+    std::shared_ptr<FILE> file;
+    String fileName;
+};
+
+class Dir {
+public:
+    Dir() = default;
+    explicit Dir(std::vector<String> _names) : names(_names) {}
+
+    bool next() { return ++pos < int(names.size()); }
+    String fileName() const { return names[pos]; }
+
+private:
+    std::vector<String> names;
+    int pos = -1;
+};
+
+class NativeFS {
+public:
+    bool begin();
+    File open(const String &path, const char *mode);
+    bool exists(const String &path);
+    bool remove(const String &path);
+    bool mkdir(const String &path);
+    Dir openDir(const String &path);
+
+private:
+    String root;
+    String full(const String &path) const { return root + path; }
+};
+
+extern NativeFS LittleFS;
@@ -0,0 +1,22 @@
+#pragma once
+#include "native/arduino_shim.h"
+
+// raw tty / pty with the Stream calls BatteryMonitor needs, stands in for
+// HardwareSerial in the native env
+class PosixSerial {
+public:
+    explicit PosixSerial(const char *_path);
+    ~PosixSerial();
+
+    // opens the device, a failed open leaves the port closed and every read empty
+    void begin(unsigned long baud);
+    void setTimeout(unsigned long) {}
+
+    int available();
+    int read();
+    size_t write(const uint8_t *buf, size_t len);
+
+private:
+    const char *path;
+    int fd = -1;
+};
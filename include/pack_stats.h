@@ -0,0 +1,101 @@
+#pragma once
+#include "hal.h"
+#include "battery.h"
+#include "stream_source.h"
+
+// running statistics of one pack, fed from its sample listener. Every update
+// is O(1) in time and memory, nothing is stored per sample.
+//
+// Cells: min, max, mean and variance (Welford) of every cell and of the
+// imbalance, the spread between the highest and the lowest cell. Charge: the
+// current is integrated between samples (trapezoid rule) into the charge that
+// went in and out of the pack. Current and power are smoothed by a time based
+// EWMA (STATS_EWMA_S) and turned into the time to empty or to full.
+//
+// All of it is integer arithmetic, the esp8266 has no FPU.
+//
+// Only fields read in the sweep are taken, a value carried over from an older
+// sweep would count twice.
+class PackStats {
+public:
+    struct Cell {
+        int16_t min; // mV
+        int16_t max;
+        int64_t mean; // uV << meanShift, see cellMeanUv()
+        int64_t m2; // sum of squared deviations from the mean, mV * uV
+    };
+    static const int meanShift = 16; // fraction bits of the means
+
+    PackStats(BatteryPoller &_poller);
+
+    // sample listener, see BatteryPoller::onSample()
+    void add(const BatteryState &state);
+
+    // samples with a full set of cell voltages
+    uint32_t cellSamples() const { return cellCount; }
+    const Cell &cell(uint8_t i) const { return cells[i]; }
+    // uV, the standard deviation 0 below two samples
+    int32_t cellMeanUv(uint8_t i) const;
+    int32_t cellStdDevUv(uint8_t i) const;
+
+    // mV, highest minus lowest cell of the newest sample
+    int16_t imbalance() const { return spread; }
+    int16_t maxImbalance() const { return spreadMax; }
+    int32_t meanImbalanceUv() const;
+    int32_t imbalanceStdDevUv() const;
+
+    // mAh since boot
+    int32_t chargedMah() const { return int32_t(charged / 3600000); }
+    int32_t dischargedMah() const { return int32_t(discharged / 3600000); }
+    // samples that came too late to integrate across, see STATS_MAX_GAP_S
+    uint32_t gaps() const { return skipped; }
+
+    bool hasAverage() const { return averaged; }
+    int32_t avgCurrentMa() const { return fromAvg(currentAvg); }
+    int32_t avgPowerMw() const { return fromAvg(powerAvg); }
+
+    // s at the smoothed current, -1 while it is below STATS_MIN_CURRENT_MA that way
+    int32_t timeToEmptyS() const;
+    int32_t timeToFullS() const;
+
+private:
+    BatteryPoller *poller;
+
+    uint32_t cellCount = 0;
+    Cell cells[BATTERY_CELLS]{};
+    int16_t spread = 0;
+    int16_t spreadMax = 0;
+    int64_t spreadMean = 0; // uV << meanShift
+    int64_t spreadM2 = 0; // mV * uV
+
+    bool averaged = false;
+    unsigned long lastUs = 0;
+    int32_t lastCurrent = 0;
+    int64_t charged = 0; // mA * ms
+    int64_t discharged = 0;
+    uint32_t skipped = 0;
+    // averages in 1/256 mA and mW
+    static const int avgShift = 8;
+    int32_t currentAvg = 0;
+    int32_t powerAvg = 0;
+    int16_t remaining = -1; // mAh, newest sample
+    int16_t capacity = -1;
+
+    static int32_t fromAvg(int32_t avg) { return (avg + (1 << (avgShift - 1))) >> avgShift; }
+
+    void addCells(const BatteryState &state);
+    void addCurrent(const BatteryState &state);
+};
+
+// /api/stats body, the pack figures and then one record per cell
+class StatsSource : public RecordSource {
+public:
+    StatsSource(const PackStats &_stats);
+
+protected:
+    size_t nextRecord(char *line, size_t size) override;
+
+private:
+    const PackStats *stats;
+    uint8_t item = 0;
+};
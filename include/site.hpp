@@ -1,146 +1,40 @@
 #pragma once
-#include <Arduino.h>
+#include "hal.h"
 #include "battery.h"
+#include "bus_capture.h"
+#include "charge_control.h"
+#include "dashboard.h"
+#include "duty_cycle.h"
+#include "event_hub.h"
+#include "fast_boot.h"
+#include "flash_log.h"
+#include "history.h"
+#include "metrics.h"
+#include "pack_stats.h"
+#include "state_cbor.h"
+#include "state_json.h"
+#include "trace.h"
+#include "web_index.h"
 
-#if defined(ESP32)
-  #include <WiFi.h>
-  #include <WebServer.h>
-  extern WebServer server;
-#elif defined(ESP8266)
-  #include <ESP8266WiFi.h>
-  #include <ESP8266WebServer.h>
-  extern ESP8266WebServer server;
-#endif
+#include "http_server.h"
+
+extern HttpServer server;
 extern BatteryMonitor batteryMonitor;
-extern BatteryState batteryState;
-
-String formatTime(long seconds) {
-    long h = seconds / 3600;
-    long m = (seconds % 3600) / 60;
-    long s = seconds % 60;
-    char buf[16];
-    snprintf(buf, sizeof(buf), "%02ld:%02ld:%02ld", h, m, s);
-    return String(buf);
-}
-
-String getHealthColor(int perc) {
-    if (perc > 50) return "#2ecc71"; // Green
-    if (perc > 20) return "#f1c40f"; // Yellow
-    return "#e74c3c"; // Red
-}
-
-String getBatteryHTML(BatteryState &state) {
-    String statusText = (state.status == 1) ? "Charging" : (state.status == 0 ? "Discharging" : "Idle");
-    String uptimeStr = formatTime(state.uptime);
-    String barColor = getHealthColor(state.remaining_capacity_perc);
-    int soh = (state.factory_capacity > 0) ? (state.actual_capacity * 100 / state.factory_capacity) : 0;
-
-    String html = R"rawliteral(<!DOCTYPE html>
-<html>
-<head>
-  <meta charset="UTF-8">
-  <meta name="viewport" content="width=device-width, initial-scale=1">
-  <title>BMS Monitor</title>
-  <style>
-    :root { --bg:#121212; --card:#1e1e1e; --text:#ddd; --accent:#3498db; --border:#333; }
-    body { font-family:sans-serif; background:var(--bg); color:var(--text); margin:0; padding:10px; }
-    h2 { color:var(--accent); text-align:center; margin:10px 0; }
-    .grid { display:grid; grid-template-columns:repeat(auto-fit, minmax(300px, 1fr)); gap:10px; }
-    .card { background:var(--card); border:1px solid var(--border); border-radius:8px; padding:15px; }
-    .head { border-bottom:1px solid var(--border); padding-bottom:5px; margin-bottom:10px; color:#888; text-transform:uppercase; font-size:0.85rem; letter-spacing:1px; }
-    .row { display:flex; justify-content:space-between; margin-bottom:8px; font-size:0.9rem; }
-    .val { font-family:monospace; font-weight:bold; font-size:1.1rem; }
-    .bar-bg { background:#333; height:24px; border-radius:12px; overflow:hidden; margin:15px 0; position:relative; }
-    .bar-fill { height:100%; text-align:center; line-height:24px; color:#000; font-weight:bold; font-size:0.8rem; transition:width 0.3s; }
-    .cells { display:grid; grid-template-columns:repeat(5, 1fr); gap:5px; text-align:center; }
-    .c-box { background:#252525; padding:4px; border-radius:4px; font-size:0.9rem; }
-    .c-lbl { display:block; font-size:0.6rem; color:#666; }
-    .err { background:#e74c3c33; color:#e74c3c; padding:10px; border-radius:5px; text-align:center; display:{{SHOW_ERR}}; margin-top:10px; border:1px solid #e74c3c; }
-    .btn { display:block; width:100%; padding:12px; background:var(--accent); color:#fff; border:none; border-radius:5px; margin-top:15px; cursor:pointer; font-size:1rem; }
-  </style>
-</head>
-<body>
-  <h2>Battery Monitor</h2>
-  <div class="card">
-    <div class="head">Overview</div>
-    <div class="bar-bg">
-      <div class="bar-fill" style="width:{{PERC}}%; background:{{COLOR}};">{{PERC}}%</div>
-    </div>
-    <div class="row"><span>Status</span><span class="val">{{STATUS}}</span></div>
-    <div class="row"><span>Capacity</span><span class="val">{{REM}} / {{ACT}} mAh</span></div>
-    <div class="row"><span>Health (SOH)</span><span class="val">{{SOH}}%</span></div>
-  </div>
-  <br>
-  <div class="grid">
-    <div class="card">
-      <div class="head">Power Metrics</div>
-      <div class="row"><span>Voltage</span><span class="val">{{VOLT}} V</span></div>
-      <div class="row"><span>Current</span><span class="val">{{CURR}} A</span></div>
-      <div class="row"><span>Power</span><span class="val">{{POW}} W</span></div>
-    </div>
-    <div class="card">
-      <div class="head">System & Temp</div>
-      <div class="row"><span>Serial</span><span class="val">{{SER}}</span></div>
-      <div class="row"><span>Uptime</span><span class="val">{{UP}}</span></div>
-      <div class="row"><span>Temp Z0</span><span class="val">{{T0}} &deg;C</span></div>
-      <div class="row"><span>Temp Z1</span><span class="val">{{T1}} &deg;C</span></div>
-    </div>
-  </div>
-  <br>
-  <div class="card">
-    <div class="head">Cell Voltages (mV)</div>
-    <div class="cells">
-      <div class="c-box"><span class="c-lbl">1</span>{{C0}}</div>
-      <div class="c-box"><span class="c-lbl">2</span>{{C1}}</div>
-      <div class="c-box"><span class="c-lbl">3</span>{{C2}}</div>
-      <div class="c-box"><span class="c-lbl">4</span>{{C3}}</div>
-      <div class="c-box"><span class="c-lbl">5</span>{{C4}}</div>
-      <div class="c-box"><span class="c-lbl">6</span>{{C5}}</div>
-      <div class="c-box"><span class="c-lbl">7</span>{{C6}}</div>
-      <div class="c-box"><span class="c-lbl">8</span>{{C7}}</div>
-      <div class="c-box"><span class="c-lbl">9</span>{{C8}}</div>
-      <div class="c-box"><span class="c-lbl">10</span>{{C9}}</div>
-    </div>
-  </div>
-  <div class="err">⚠️ {{ERR_MSG}}</div>
-  <button class="btn" onclick="location.reload()">Refresh Data</button>
-</body>
-</html>)rawliteral";
-
-    html.replace("{{PERC}}", String(state.remaining_capacity_perc));
-    html.replace("{{COLOR}}", barColor);
-    html.replace("{{STATUS}}", statusText);
-    html.replace("{{REM}}", String(state.remaining_capacity));
-    html.replace("{{ACT}}", String(state.actual_capacity));
-    html.replace("{{SOH}}", String(soh));
-    html.replace("{{VOLT}}", String(state.voltage, 2));
-    html.replace("{{CURR}}", String(state.current, 2));
-    html.replace("{{POW}}", String(state.power, 2));
-    html.replace("{{SER}}", state.serial);
-    html.replace("{{UP}}", uptimeStr);
-    html.replace("{{T0}}", String(state.temp_zone0));
-    html.replace("{{T1}}", String(state.temp_zone1));
-    html.replace("{{C0}}", String(state.cell_voltage_cell0));
-    html.replace("{{C1}}", String(state.cell_voltage_cell1));
-    html.replace("{{C2}}", String(state.cell_voltage_cell2));
-    html.replace("{{C3}}", String(state.cell_voltage_cell3));
-    html.replace("{{C4}}", String(state.cell_voltage_cell4));
-    html.replace("{{C5}}", String(state.cell_voltage_cell5));
-    html.replace("{{C6}}", String(state.cell_voltage_cell6));
-    html.replace("{{C7}}", String(state.cell_voltage_cell7));
-    html.replace("{{C8}}", String(state.cell_voltage_cell8));
-    html.replace("{{C9}}", String(state.cell_voltage_cell9));
-
-    if (state.error.length() > 0 && state.error != "None") {
-        html.replace("{{SHOW_ERR}}", "block");
-        html.replace("{{ERR_MSG}}", state.error);
-    }
-    else {
-        html.replace("{{SHOW_ERR}}", "none");
-        html.replace("{{ERR_MSG}}", "");
-    }
-    return html;
-}
+extern BatteryState packStates[BATTERY_PACKS];
+extern BatteryPoller packPollers[BATTERY_PACKS];
+extern BatteryState &batteryState;
+extern BatteryPoller &batteryPoller;
+extern TelemetryHistory telemetryHistory;
+extern FlashLog flashLog;
+extern EventHub eventHub;
+extern LatencyHistogram loopTime;
+extern ChargeController chargeController;
+extern DutyCycle dutyCycle;
+extern FastBoot fastBoot;
+extern PackStats packStats;
+#ifdef BUS_CAPTURE_BYTES
+extern BusCapture busCapture;
+#endif
 
 void initWithFakeData(BatteryState& batteryState) {
 
@@ -148,38 +42,240 @@ void initWithFakeData(BatteryState& batteryState) {
     
     batteryState.remaining_capacity_perc = -1;
     batteryState.status = -1;
-    batteryState.serial = "----------";
+    strcpy(batteryState.serial, "----------");
     batteryState.factory_capacity = -1;
     batteryState.actual_capacity = -1;
     batteryState.remaining_capacity = -1;
-    batteryState.voltage = -1;
-    batteryState.current = -1;
-    batteryState.power = -1;
+    batteryState.voltage_mv = -1000;
+    batteryState.current_ma = -1000;
+    batteryState.power_mw = -1000;
     batteryState.temp_zone0 = -1;
     batteryState.temp_zone1 = -1;
-    batteryState.error = F("Fake Error - Testing");
+    batteryState.error = BATTERY_ERR_NO_DATA;
     
-    batteryState.cell_voltage_cell0 = -1;
-    batteryState.cell_voltage_cell1 = -1;
-    batteryState.cell_voltage_cell2 = -1;
-    batteryState.cell_voltage_cell3 = -1;
-    batteryState.cell_voltage_cell4 = -1;
-    batteryState.cell_voltage_cell5 = -1;
-    batteryState.cell_voltage_cell6 = -1;
-    batteryState.cell_voltage_cell7 = -1;
-    batteryState.cell_voltage_cell8 = -1;
-    batteryState.cell_voltage_cell9 = -1;
+    batteryState.cells.fill(-1);
 }
 
 
+// request headers the handlers look at, see server.collectHeaders() in setup()
+const char *collectedHeaders[] = {"If-None-Match"};
+
+// drawn in setup(). The snapshot versions start over at every reset, the etags
+// of one boot must not match the ones a client kept from the last
+uint32_t bootNonce = 0;
+
+// answers 304 if the client already has this etag, otherwise sets it on the response
+bool notModified(const String &etag) {
+    server.sendHeader(F("ETag"), etag);
+    if (server.header(F("If-None-Match")) == etag) {
+        server.send(304);
+        return true;
+    }
+    return false;
+}
+
+// static dashboard shell, fills itself from /api/state
 void handleRoot() {
-    batteryMonitor.readBatteryState(batteryState);
+    server.sendHeader(F("Cache-Control"), F("max-age=86400"));
+    if (notModified(F(WEB_INDEX_ETAG))) return;
 
-    String htmlPage = getBatteryHTML(batteryState);
-    
-    server.send(200, "text/html", htmlPage);
+    server.sendHeader(F("Content-Encoding"), F("gzip"));
+    server.send_P(200, PSTR("text/html"), (PGM_P)web_index_gz, sizeof(web_index_gz));
+}
+
+// ?pack=<index into BATTERY_ADDRESSES>, pack 0 without it. -1 after a 404 was
+// sent, or when the snapshot did not change since the client's copy
+int stateRequest() {
+    int pack = server.hasArg(F("pack")) ? int(server.arg(F("pack")).toInt()) : 0;
+    if (pack < 0 || pack >= BATTERY_PACKS) {
+        server.send(404, "text/plain", "404: no such pack");
+        return -1;
+    }
+
+    // X-Uptime lets the page work out the age of the snapshot, also on a 304
+    server.sendHeader(F("X-Uptime"), String(millis() / 1000));
+    server.sendHeader(F("Cache-Control"), F("no-cache"));
+    char etag[32];
+    snprintf_P(etag, sizeof(etag), PSTR("\"%08x-%d-%u\""), unsigned(bootNonce), pack, unsigned(packPollers[pack].version()));
+    if (notModified(etag)) return -1;
+
+    return pack;
+}
+
+void handleApiState() {
+    int pack = stateRequest();
+    if (pack < 0) return;
+    const BatteryPoller &poller = packPollers[pack];
+
+    char json[512];
+    size_t len = writeStateJson(json, sizeof(json), packStates[pack], poller.hasSample());
+    if (len == 0) {
+        server.send(500, "text/plain", "500: state too large");
+        return;
+    }
+    server.send(200, "application/json", json);
+}
+
+// ?keys=<bitmask of StateCborKey> picks the map entries, see state_cbor.h
+void handleApiStateCbor() {
+    int pack = stateRequest();
+    if (pack < 0) return;
+
+    uint16_t keys = cborAllKeys;
+    if (server.hasArg(F("keys"))) keys = uint16_t(strtoul(server.arg(F("keys")).c_str(), nullptr, 0));
+    uint8_t cbor[80 + 3 * BATTERY_CELLS];
+    size_t len = writeStateCbor(cbor, sizeof(cbor), packStates[pack], packPollers[pack].hasSample(), keys);
+    if (len == 0) {
+        server.send(500, "text/plain", "500: state too large");
+        return;
+    }
+    server.send(200, "application/cbor", reinterpret_cast<const char *>(cbor), len);
+}
+
+// every pack on the bus, the state objects are the same as /api/state
+void handleApiPacks() {
+    server.sendStream<PacksSource>(200, "application/json", batteryMonitor, packStates, packPollers);
+}
+
+// ?res=raw|1m|15m&since=<uptime seconds>, rows at or after since
+void handleApiHistory() {
+    TelemetryHistory::Resolution res = TelemetryHistory::RES_SAMPLE;
+    String resArg = server.arg(F("res"));
+    if (resArg == "1m") res = TelemetryHistory::RES_MINUTE;
+    else if (resArg == "15m") res = TelemetryHistory::RES_QUARTER;
+    uint32_t since = server.hasArg(F("since")) ? uint32_t(server.arg(F("since")).toInt()) : 0;
+
+    server.sendStream<HistorySource>(200, "application/json", telemetryHistory, res, since);
+}
+
+// ?from=&to= in log clock seconds (see "now" in the reply), persisted samples only
+void handleApiLog() {
+    uint32_t from = server.hasArg(F("from")) ? uint32_t(server.arg(F("from")).toInt()) : 0;
+    uint32_t to = server.hasArg(F("to")) ? uint32_t(server.arg(F("to")).toInt()) : UINT32_MAX;
+
+    server.sendStream<FlashLogSource>(200, "application/json", flashLog, from, to);
+}
+
+// ?pack=, full register dump of the pack in a few block reads, decoded with
+// the register table. The body waits for the poller to run the dump.
+void handleApiRegisters() {
+    int pack = server.hasArg(F("pack")) ? int(server.arg(F("pack")).toInt()) : 0;
+    if (pack < 0 || pack >= BATTERY_PACKS) {
+        server.send(404, "text/plain", "404: no such pack");
+        return;
+    }
+
+    BatteryPoller &poller = packPollers[pack];
+    server.sendHeader(F("Cache-Control"), F("no-cache"));
+    server.sendStream<RegistersSource>(200, "application/json", batteryMonitor, poller, poller.requestDump());
+}
+
+#ifdef BUS_CAPTURE_BYTES
+// raw bus trace for tools/replay, ?clear starts a fresh one. Nothing is
+// recorded while the download runs.
+void handleApiCapture() {
+    if (server.hasArg(F("clear"))) {
+        busCapture.clear();
+        server.send(204);
+        return;
+    }
+    server.sendHeader(F("Content-Disposition"), F("attachment; filename=\"capture.bin\""));
+    server.sendStream<CaptureSource>(200, "application/octet-stream", busCapture);
+}
+#endif
+
+#ifdef TRACE_SPANS
+// the last spans of loop() phases and bus transactions, open in ui.perfetto.dev
+void handleTrace() {
+    server.sendHeader(F("Cache-Control"), F("no-cache"));
+    server.sendStream<TraceSource>(200, "application/json", traceRing);
+}
+#endif
+
+// server-sent events, one frame per snapshot, fed from loop() by eventHub.update()
+void handleEvents() {
+    if (!eventHub.subscribe(server.client())) {
+        server.sendHeader(F("Retry-After"), F("30"));
+        server.send(503, "text/plain", "503: too many event clients");
+    }
+}
+
+// prometheus scrape target, streamed from the live counters
+void handleMetrics() {
+    server.sendStream<MetricsSource>(200, "text/plain; version=0.0.4", batteryMonitor, batteryPoller, packStats, loopTime);
+}
+
+// charge limit state and how quickly it reacts, latencies in microseconds
+void handleApiCharge() {
+    const LatencyHistogram &latency = chargeController.latency();
+    char json[384];
+    snprintf_P(json, sizeof(json),
+               PSTR("{\"enabled\":%s,\"charging\":%s,\"reason\":\"%s\",\"stop_perc\":%d,\"resume_perc\":%d,"
+                    "\"cell_max_mv\":%d,\"cell_resume_mv\":%d,\"deadline_ms\":%lu,\"decisions\":%lu,"
+                    "\"latency_max_us\":%lu,\"latency_avg_us\":%lu,\"worst_gap_ms\":%lu,\"deadline_misses\":%lu,"
+                    "\"watchdog_trips\":%lu,\"relay_faults\":%lu}"),
+               chargeController.enabled() ? "true" : "false", chargeController.charging() ? "true" : "false",
+               ChargeController::reasonText(chargeController.reason()), CHARGE_STOP_PERC, CHARGE_RESUME_PERC,
+               CHARGE_CELL_MAX_MV, CHARGE_CELL_RESUME_MV, (unsigned long)CHARGE_DEADLINE_MS,
+               (unsigned long)latency.count(), (unsigned long)latency.maxUs(),
+               (unsigned long)(latency.count() ? latency.sumUs() / latency.count() : 0),
+               chargeController.worstGapMs(), (unsigned long)chargeController.deadlineMisses(),
+               (unsigned long)chargeController.watchdogTrips(), (unsigned long)chargeController.relayFaults());
+    server.send(200, "application/json", json);
+}
+
+// awake time per cycle and the estimated drain of the monitor itself
+void handleApiDuty() {
+    char json[320];
+    dutyCycle.formatReport(json, sizeof(json));
+    server.send(200, "application/json", json);
+}
+
+// how quickly this boot got going: warm start, restored packs, wifi and first sample times
+void handleApiBoot() {
+    char json[160];
+    fastBoot.formatReport(json, sizeof(json));
+    server.send(200, "application/json", json);
+}
+
+// running cell statistics, charge counters and time to empty/full of pack 0
+void handleApiStats() {
+    server.sendStream<StatsSource>(200, "application/json", packStats);
+}
+
+// server rendered page for clients without javascript
+void handleDashboard() {
+    // only render the cached snapshot, the bus is polled from loop()
+    long age = batteryPoller.hasSample() ? long(batteryPoller.ageMs() / 1000) : -1;
+    server.sendStream<DashboardRenderer>(200, "text/html", batteryState, age);
 }
 
 void handleNotFound() {
     server.send(404, "text/plain", "404: Not Found");
 }
+
+void setupRoutes() {
+    server.on(F("/"), handleRoot);
+    server.on(F("/api/state"), handleApiState);
+    server.on(F("/api/state.cbor"), handleApiStateCbor);
+    server.on(F("/api/packs"), handleApiPacks);
+    server.on(F("/api/history"), handleApiHistory);
+    server.on(F("/api/log"), handleApiLog);
+    server.on(F("/api/registers"), handleApiRegisters);
+    #ifdef BUS_CAPTURE_BYTES
+    server.on(F("/api/capture"), handleApiCapture);
+    #endif
+    server.on(F("/events"), handleEvents);
+    server.on(F("/metrics"), handleMetrics);
+    server.on(F("/api/charge"), handleApiCharge);
+    server.on(F("/api/duty"), handleApiDuty);
+    server.on(F("/api/boot"), handleApiBoot);
+    server.on(F("/api/stats"), handleApiStats);
+    server.on(F("/dashboard"), handleDashboard);
+    #ifdef TRACE_SPANS
+    server.on(F("/trace"), handleTrace);
+    #endif
+    server.collectHeaders(collectedHeaders, sizeof(collectedHeaders) / sizeof(collectedHeaders[0]));
+
+    server.onNotFound(handleNotFound);
+}
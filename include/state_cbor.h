@@ -0,0 +1,32 @@
+#pragma once
+#include "hal.h"
+#include "battery.h"
+
+// binary snapshot for collectors polling several times a second, served as
+// /api/state.cbor. One CBOR map (RFC 8949) with small integer keys and the raw
+// fixed-point integers of BatteryState, no floats and no key strings, so a full
+// sample of a 10 cell pack is about 95 bytes. Keys never change meaning, new
+// ones are appended. Values of fields not read yet are -1 like in /api/state.
+enum StateCborKey : uint8_t {
+    CBOR_SAMPLED = 0, // bool, false until the first sweep finished
+    CBOR_UPTIME, // s, when the sample was taken
+    CBOR_STATUS, // 0=Discharge, 1=Charge, 2=Idle
+    CBOR_SERIAL, // text
+    CBOR_PERC, // remaining capacity in %
+    CBOR_REMAINING, // mAh
+    CBOR_FACTORY, // mAh
+    CBOR_ACTUAL, // mAh
+    CBOR_CURRENT, // mA, negative while discharging
+    CBOR_VOLTAGE, // mV
+    CBOR_POWER, // mW
+    CBOR_TEMP, // array of the two zones in degrees C
+    CBOR_CELLS, // array of BATTERY_CELLS voltages in mV
+    CBOR_ERROR, // BatteryError code, 0 = ok
+    CBOR_KEY_COUNT,
+};
+static const uint16_t cborAllKeys = (1 << CBOR_KEY_COUNT) - 1;
+
+// encodes the keys set in mask (bit per StateCborKey), returns the length or 0
+// if buf is too small. 80 + 3 * BATTERY_CELLS bytes always do.
+size_t writeStateCbor(uint8_t *buf, size_t size, const BatteryState &state, bool sampled,
+                      uint16_t mask = cborAllKeys);
@@ -0,0 +1,28 @@
+#pragma once
+#include "hal.h"
+#include "battery.h"
+#include "stream_source.h"
+
+// writes a milli scaled integer with 1..3 decimals, rounded half away from
+// zero ("-1.51" for -1510, 2). Returns the length like snprintf.
+int formatFixed(char *buf, size_t size, int32_t milli, uint8_t decimals);
+
+// compact json of a snapshot as served by /api/state, returns the length
+// written (without the terminating zero) or 0 if buf is too small
+size_t writeStateJson(char *buf, size_t size, const BatteryState &state, bool sampled);
+
+// /api/packs: every pack on the bus with its poller timing, the state objects
+// are the same as /api/state
+class PacksSource : public RecordSource {
+public:
+    PacksSource(const BatteryMonitor &_monitor, const BatteryState *_states, const BatteryPoller *_pollers);
+
+protected:
+    size_t nextRecord(char *line, size_t size) override;
+
+private:
+    const BatteryMonitor *monitor;
+    const BatteryState *states;
+    const BatteryPoller *pollers;
+    uint8_t item = 0;
+};
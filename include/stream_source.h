@@ -0,0 +1,35 @@
+#pragma once
+#include "hal.h"
+
+// pull-style body producer: the web layer asks for the next chunk and sends
+// it, so responses never have to be built up in RAM as a whole
+class StreamSource {
+public:
+    virtual ~StreamSource() = default;
+
+    // copies up to max bytes of the body into buf, returns 0 once everything was read
+    virtual size_t read(char *buf, size_t max) = 0;
+
+    // false while the body waits for data (a read on the bus), read() is not called until then
+    virtual bool ready() const { return true; }
+};
+
+// StreamSource for bodies made of many small records (json rows, metric lines),
+// each record is formatted into a line buffer and copied out from there
+class RecordSource : public StreamSource {
+public:
+    size_t read(char *buf, size_t max) override;
+
+protected:
+    static const size_t lineSize = 384;
+
+    // formats the next record into line (at most lineSize bytes), returns its length.
+    // Returns 0 once the body is complete.
+    virtual size_t nextRecord(char *line, size_t size) = 0;
+
+private:
+    char line[lineSize]{};
+    size_t lineLen = 0;
+    size_t linePos = 0;
+    bool finished = false;
+};
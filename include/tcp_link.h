@@ -0,0 +1,46 @@
+#pragma once
+#include "hal.h"
+#ifndef NATIVE
+#include <ESPAsyncTCP.h>
+#endif
+
+// non-blocking tcp connection with a poll-style interface. On the esp it
+// wraps ESPAsyncTCP (connect and dns run in the background), natively a
+// non-blocking posix socket.
+class TcpLink {
+public:
+    TcpLink();
+    ~TcpLink();
+
+    // starts connecting and returns right away, false if it could not even start
+    bool connect(const char *host, uint16_t port);
+
+    bool connecting();
+    bool connected();
+
+    // bytes write() accepts right now, 0 while the send buffer is full
+    size_t space();
+    size_t write(const uint8_t *data, size_t len);
+    // everything written so far was acked by the peer
+    bool flushed();
+
+    size_t available();
+    size_t read(uint8_t *buf, size_t len);
+
+    void close();
+
+private:
+#ifdef NATIVE
+    int fd = -1;
+    bool pending = false;
+#else
+    static const size_t rxSize = 64;
+    AsyncClient client;
+    uint8_t rx[rxSize]{};
+    size_t rxHead = 0;
+    size_t rxTail = 0;
+    size_t unacked = 0;
+    bool open = false;
+    bool pending = false;
+#endif
+};
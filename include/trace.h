@@ -0,0 +1,96 @@
+#pragma once
+#include "hal.h"
+#include "config.h"
+#include "stream_source.h"
+
+// what a span measured, the names live in flash, see TraceSource
+enum TraceName : uint8_t {
+    TRACE_LOOP = 0, // one loop() pass
+    TRACE_POLLER, // BatteryPoller::update() of all packs
+    TRACE_HTTP, // HttpServer::update()
+    TRACE_HANDLER, // a route handler, arg: index in setupRoutes() order
+    TRACE_BODY, // one chunk of a streamed body
+    TRACE_EVENTS, // eventHub.update()
+    TRACE_MQTT,
+    TRACE_CHARGE,
+    TRACE_MDNS,
+    TRACE_BUS, // request to reply or error, arg: register | TransactionError << 8
+    TRACE_NAME_COUNT,
+};
+
+// track a span is drawn on: loop() or the bus transactions of one pack
+static const uint8_t traceLoopTrack = 0;
+inline uint8_t traceBusTrack(int pack) { return uint8_t(1 + pack); }
+
+struct TraceSpan {
+    uint32_t startUs;
+    uint32_t durationUs;
+    uint16_t arg;
+    TraceName name;
+    uint8_t track;
+};
+
+#ifdef TRACE_SPANS
+
+// the last TRACE_SPANS spans, shorter ones than TRACE_MIN_US are not kept so
+// the ring reaches back past a stall instead of holding the last few idle loops
+class TraceRing {
+public:
+    void add(TraceName name, uint32_t startUs, uint32_t durationUs, uint16_t arg = 0, uint8_t track = traceLoopTrack) {
+        if (durationUs < TRACE_MIN_US) return;
+        spans[written % TRACE_SPANS] = TraceSpan{startUs, durationUs, arg, name, track};
+        written++;
+    }
+
+    // spans ever added, the span of sequence number seq is at(seq) while seq >= oldest()
+    uint32_t added() const { return written; }
+    uint32_t oldest() const { return written > TRACE_SPANS ? written - TRACE_SPANS : 0; }
+    const TraceSpan &at(uint32_t seq) const { return spans[seq % TRACE_SPANS]; }
+
+private:
+    TraceSpan spans[TRACE_SPANS]{};
+    uint32_t written = 0;
+};
+
+extern TraceRing traceRing;
+
+// adds a span from its construction to the end of the scope
+class TraceScope {
+public:
+    explicit TraceScope(TraceName _name, uint16_t _arg = 0) : name(_name), arg(_arg), started(micros()) {}
+    ~TraceScope() { traceRing.add(name, started, micros() - started, arg); }
+
+private:
+    TraceName name;
+    uint16_t arg;
+    uint32_t started;
+};
+
+#define TRACE_JOIN2(a, b) a##b
+#define TRACE_JOIN(a, b) TRACE_JOIN2(a, b)
+#define TRACE_SCOPE(...) TraceScope TRACE_JOIN(traceScope, __LINE__)(__VA_ARGS__)
+#define TRACE_SPAN(...) traceRing.add(__VA_ARGS__)
+
+// /trace: the ring in chrome trace_event json, for ui.perfetto.dev or chrome://tracing.
+// Spans added while it streams are left out, overwritten ones are skipped.
+class TraceSource : public RecordSource {
+public:
+    explicit TraceSource(const TraceRing &_ring);
+
+protected:
+    size_t nextRecord(char *line, size_t size) override;
+
+private:
+    const TraceRing *ring;
+    uint32_t seq;
+    uint32_t end;
+    uint32_t origin; // startUs of the oldest span, the trace starts at 0
+    uint8_t item = 0;
+};
+
+#else
+
+#define TRACE_SCOPE(...) do {} while (0)
+#define TRACE_SPAN(...) do {} while (0)
+
+#endif
@@ -0,0 +1,144 @@
+// generated by scripts/embed_web.py from web/index.html, do not edit
+#pragma once
+#include "hal.h"
+
+#define WEB_INDEX_ETAG "\"83cfe6a91b60132b\""
+
+static const uint8_t web_index_gz[] PROGMEM = {
+    0x1f, 0x8b, 0x08, 0x00, 0x00, 0x00, 0x00, 0x00, 0x02, 0x03, 0x95, 0x18, 0xdb, 0x72, 0xdb, 0x36,
+    0xf6, 0x3d, 0x5f, 0x81, 0x2a, 0x4d, 0x49, 0x4d, 0x44, 0x89, 0x92, 0x2f, 0x75, 0x69, 0x49, 0x9d,
+    0xc6, 0x71, 0x27, 0xd9, 0x89, 0xe3, 0xce, 0x2a, 0x4d, 0xbb, 0xbb, 0xdd, 0x07, 0x88, 0x04, 0x45,
+    0x34, 0x24, 0xc1, 0x01, 0x40, 0xc9, 0xde, 0x4c, 0xfe, 0x7d, 0xcf, 0x01, 0x28, 0x0a, 0xba, 0x39,
+    0x8a, 0x35, 0x23, 0x93, 0x07, 0xe7, 0x7e, 0x87, 0xc6, 0xdf, 0xbd, 0xbe, 0xbf, 0xf9, 0xf0, 0xaf,
+    0xdf, 0x6e, 0x49, 0xa6, 0x8b, 0x7c, 0xfa, 0x6c, 0xbc, 0xfe, 0xc7, 0x68, 0x32, 0x7d, 0x46, 0xc8,
+    0xb8, 0x60, 0x9a, 0x92, 0x38, 0xa3, 0x52, 0x31, 0x3d, 0xe9, 0xfc, 0xfe, 0xe1, 0xd7, 0xe0, 0xaa,
+    0xb3, 0x39, 0x28, 0x69, 0xc1, 0x26, 0x9d, 0x25, 0x67, 0xab, 0x4a, 0x48, 0xdd, 0x21, 0xb1, 0x28,
+    0x35, 0x2b, 0x01, 0x71, 0xc5, 0x13, 0x9d, 0x4d, 0x12, 0xb6, 0xe4, 0x31, 0x0b, 0xcc, 0x4b, 0x8f,
+    0xf0, 0x92, 0x6b, 0x4e, 0xf3, 0x40, 0xc5, 0x34, 0x67, 0x93, 0xa1, 0x65, 0xa3, 0xb9, 0xce, 0xd9,
+    0xf4, 0xd5, 0xdd, 0x8c, 0xdc, 0x09, 0x38, 0x17, 0x72, 0x3c, 0xb0, 0x20, 0x3c, 0x54, 0xfa, 0xd1,
+    0x3e, 0x11, 0x12, 0x49, 0x21, 0x34, 0xf9, 0x4c, 0x82, 0x60, 0xbe, 0x88, 0x9e, 0x0f, 0x47, 0xf8,
+    0xb9, 0x86, 0xb7, 0x98, 0xca, 0x04, 0xde, 0x19, 0x7e, 0xf0, 0x5d, 0xb3, 0x07, 0x1d, 0x3d, 0x4f,
+    0x92, 0x04, 0x5f, 0x68, 0x1c, 0x83, 0x36, 0xd1, 0xf3, 0xb3, 0xf3, 0x9f, 0xae, 0x92, 0x39, 0x42,
+    0xe6, 0x42, 0x26, 0x4c, 0x02, 0xe4, 0xec, 0xec, 0x9a, 0x7c, 0x31, 0x9c, 0xe7, 0x22, 0x79, 0x04,
+    0xc6, 0x29, 0xa8, 0x1e, 0xa4, 0xb4, 0xe0, 0xf9, 0x63, 0xa4, 0x68, 0xa9, 0x02, 0xc5, 0x24, 0x4f,
+    0xaf, 0xc9, 0x9c, 0xc6, 0x9f, 0x16, 0x52, 0xd4, 0x65, 0x12, 0x2d, 0xa9, 0xf4, 0x51, 0x7e, 0xf7,
+    0x1a, 0x0c, 0xcd, 0x85, 0x6c, 0x00, 0x28, 0x12, 0x40, 0x05, 0x95, 0x0b, 0x5e, 0x46, 0xe1, 0x35,
+    0xa9, 0x68, 0x92, 0xf0, 0x72, 0x11, 0x0d, 0xc3, 0xea, 0x61, 0x2d, 0x25, 0x1b, 0x81, 0x0c, 0x97,
+    0xca, 0xea, 0x06, 0x74, 0x48, 0x1e, 0xd0, 0x9c, 0x2f, 0xca, 0x08, 0x21, 0x4c, 0xb6, 0xac, 0x90,
+    0x9e, 0x84, 0x6b, 0x0e, 0xfd, 0x85, 0xe4, 0x09, 0x30, 0x49, 0xb8, 0xaa, 0x72, 0xfa, 0x18, 0xe1,
+    0xeb, 0x35, 0xc1, 0x6f, 0xd0, 0xa0, 0x00, 0x90, 0x66, 0x01, 0x08, 0xa8, 0x8b, 0x52, 0x45, 0x92,
+    0x55, 0x8c, 0x6a, 0x9f, 0xd6, 0x5a, 0x04, 0x29, 0xd7, 0x3d, 0x52, 0xf0, 0xb2, 0xa0, 0x0f, 0xfe,
+    0x59, 0x08, 0x2c, 0x7b, 0x64, 0x98, 0xca, 0x2e, 0x48, 0x5e, 0xd0, 0x6a, 0x4b, 0xc7, 0x3e, 0x3a,
+    0x13, 0x24, 0xec, 0x99, 0x8c, 0x70, 0xc0, 0x6f, 0x9c, 0x37, 0x04, 0xad, 0x94, 0xc8, 0x41, 0x99,
+    0xc6, 0x21, 0x06, 0xdc, 0x9e, 0x07, 0x92, 0x26, 0xbc, 0x56, 0xd1, 0x15, 0x32, 0x6e, 0x5d, 0x71,
+    0xe1, 0x88, 0xc1, 0xe4, 0x42, 0x31, 0x16, 0x7d, 0x2e, 0xb4, 0x16, 0xc5, 0x71, 0xae, 0x0d, 0x8b,
+    0x35, 0x9e, 0x61, 0x64, 0x1d, 0xd4, 0x92, 0x1a, 0x1b, 0xac, 0x73, 0x9f, 0x5f, 0x5d, 0x5d, 0x35,
+    0x3e, 0xd5, 0x12, 0xc2, 0x98, 0x0a, 0x59, 0x44, 0x75, 0x55, 0x31, 0x19, 0x53, 0x05, 0x19, 0x62,
+    0xc2, 0xac, 0xf8, 0xff, 0x58, 0x14, 0xf6, 0xaf, 0x2e, 0x24, 0x2b, 0xae, 0x49, 0xce, 0x34, 0x78,
+    0x3d, 0x50, 0x15, 0x8d, 0x8d, 0xaa, 0x8e, 0xa6, 0x52, 0xac, 0x1c, 0x8f, 0xa7, 0x39, 0x83, 0xa3,
+    0xbf, 0x6b, 0xa5, 0x79, 0xfa, 0x18, 0x34, 0xb9, 0x1e, 0x21, 0x1d, 0x0b, 0xe6, 0x4c, 0xaf, 0x18,
+    0x2b, 0x77, 0x55, 0x33, 0x4e, 0x70, 0x65, 0xfe, 0x64, 0x44, 0x36, 0xec, 0x97, 0x34, 0xdf, 0xc9,
+    0xbc, 0x42, 0x94, 0xc2, 0x30, 0x6c, 0xa8, 0x56, 0x8c, 0x2f, 0x32, 0x1d, 0xcd, 0x45, 0x9e, 0xb8,
+    0x7c, 0x86, 0xfd, 0xa1, 0xcb, 0x67, 0x4e, 0xc1, 0x8d, 0x8b, 0xed, 0xc8, 0xd9, 0x14, 0xcf, 0x2c,
+    0xfd, 0xe8, 0x1c, 0xf5, 0xd8, 0x8e, 0xcf, 0x70, 0x84, 0x30, 0xb1, 0x64, 0x32, 0xcd, 0xc5, 0x2a,
+    0xca, 0x78, 0x92, 0x6c, 0xf4, 0x37, 0x01, 0xc3, 0xdc, 0xab, 0x84, 0x82, 0xaa, 0x15, 0x25, 0xa4,
+    0x14, 0x64, 0x18, 0x5f, 0xb2, 0x2d, 0xa1, 0x29, 0xcf, 0xd1, 0x82, 0x46, 0xca, 0x30, 0x0c, 0x5f,
+    0x1c, 0xcc, 0xe7, 0x9c, 0x97, 0x2c, 0xd8, 0x52, 0xa5, 0x09, 0x56, 0x18, 0x86, 0x4f, 0x1b, 0x0a,
+    0x41, 0x32, 0x86, 0x9a, 0x58, 0x5a, 0x45, 0x4c, 0x37, 0x21, 0x61, 0xff, 0x4c, 0x6d, 0xf2, 0x96,
+    0xe5, 0xb9, 0xfa, 0xb6, 0xd2, 0xb8, 0xb0, 0x55, 0x60, 0x8b, 0xc0, 0xe4, 0xd4, 0x01, 0xbd, 0xd7,
+    0xec, 0x21, 0x9a, 0x0f, 0x3b, 0xde, 0x1d, 0x5d, 0xe0, 0x67, 0x93, 0xe0, 0x07, 0x1c, 0x7c, 0xfe,
+    0x64, 0xec, 0xe3, 0x20, 0x9f, 0xe7, 0x8e, 0xce, 0xf3, 0x5c, 0xc4, 0x9f, 0xb6, 0xf1, 0x2f, 0x0d,
+    0x7e, 0xe3, 0xaa, 0xcb, 0xcb, 0xcb, 0x96, 0x96, 0x49, 0xb9, 0xa3, 0x0e, 0xfb, 0xf1, 0x3c, 0x3e,
+    0x8b, 0x31, 0xe2, 0x0d, 0xba, 0x05, 0xec, 0xf6, 0xa2, 0x6d, 0x05, 0x8f, 0x99, 0xbd, 0x56, 0xa9,
+    0x14, 0x25, 0x6b, 0x13, 0x5a, 0x8b, 0x6a, 0x8b, 0x89, 0x53, 0xb0, 0xad, 0xb0, 0x75, 0x66, 0xe8,
+    0x72, 0xdf, 0x30, 0x13, 0xb6, 0x26, 0x45, 0x5a, 0xa5, 0x4c, 0x0a, 0xee, 0xb5, 0x9b, 0xb6, 0x35,
+    0x36, 0xb6, 0xa4, 0x69, 0xda, 0x4a, 0xb5, 0x3a, 0x1d, 0xb0, 0xc3, 0x55, 0xd3, 0x00, 0xe2, 0x5a,
+    0x2a, 0xa0, 0xae, 0x04, 0xb7, 0x56, 0x39, 0xd5, 0xd3, 0xc6, 0x61, 0x3c, 0x68, 0x46, 0xcc, 0x78,
+    0x60, 0x27, 0xde, 0x18, 0xa7, 0x81, 0x99, 0x3d, 0xd9, 0x68, 0xfa, 0x8a, 0x62, 0x63, 0x78, 0xdc,
+    0x4c, 0x26, 0x80, 0xe1, 0x51, 0xc2, 0x97, 0x24, 0xce, 0xa9, 0x52, 0x93, 0x0e, 0x76, 0xc6, 0x8e,
+    0x9d, 0x50, 0x2e, 0x18, 0x99, 0x75, 0xa6, 0xf7, 0x50, 0x5b, 0x38, 0x1b, 0xc7, 0x03, 0x38, 0xda,
+    0x47, 0xb2, 0x55, 0xdb, 0x50, 0xef, 0x1f, 0x61, 0x6d, 0x75, 0x08, 0x4f, 0xcc, 0x5b, 0x87, 0x18,
+    0x45, 0x9b, 0xc1, 0x1a, 0x81, 0x13, 0x3b, 0xd3, 0x20, 0x78, 0xe1, 0x72, 0x3e, 0x2c, 0x04, 0x3a,
+    0x58, 0x67, 0x3a, 0x86, 0x96, 0x52, 0x4e, 0x67, 0x9a, 0xea, 0x5a, 0x81, 0xc9, 0xf8, 0x62, 0x40,
+    0x6b, 0x24, 0xe8, 0x43, 0x56, 0x92, 0x32, 0x28, 0xc8, 0x7a, 0x8d, 0xf6, 0x55, 0xae, 0x37, 0x14,
+    0xfb, 0xa6, 0x7e, 0x3c, 0xc6, 0xb7, 0x81, 0x20, 0x77, 0x70, 0xbb, 0xc3, 0x9a, 0x0c, 0xc8, 0xe6,
+    0x88, 0xc6, 0xda, 0x3d, 0x2a, 0x7e, 0xc9, 0x4e, 0x56, 0xe0, 0x0d, 0xa3, 0x39, 0x34, 0x04, 0x7f,
+    0x76, 0xff, 0xa6, 0xfb, 0xb4, 0x71, 0x22, 0x6b, 0x9c, 0x76, 0x22, 0xe7, 0x77, 0x54, 0x69, 0x52,
+    0x57, 0x09, 0xb4, 0x8f, 0x27, 0x19, 0xd3, 0x05, 0xeb, 0x4c, 0x4b, 0x06, 0xd1, 0xde, 0x65, 0xbd,
+    0x79, 0x98, 0xcb, 0xdd, 0xd4, 0xc1, 0xf6, 0x74, 0x20, 0x75, 0x9c, 0x8c, 0x3a, 0x94, 0x53, 0xbf,
+    0x89, 0x15, 0x93, 0xe4, 0x8e, 0x69, 0xc9, 0x63, 0xe5, 0x98, 0x70, 0xd4, 0x88, 0x8f, 0x22, 0xd7,
+    0xa0, 0xe0, 0x09, 0xe1, 0x59, 0x02, 0xa6, 0x1b, 0x84, 0x8f, 0xfb, 0x8e, 0x3a, 0x9e, 0x05, 0xb5,
+    0x94, 0x50, 0xb3, 0x27, 0x48, 0x81, 0xb2, 0x94, 0xae, 0x94, 0x5f, 0xbe, 0x41, 0x8a, 0x31, 0xfe,
+    0x04, 0x19, 0x15, 0x92, 0x6c, 0x44, 0xfc, 0x71, 0x20, 0xe2, 0x87, 0x83, 0xff, 0x15, 0xe7, 0xcf,
+    0x1e, 0x15, 0xcc, 0x13, 0xf2, 0x03, 0xf9, 0x00, 0x53, 0xe5, 0x14, 0x85, 0x67, 0xb0, 0x43, 0xd2,
+    0xfc, 0xe9, 0xac, 0x64, 0xf2, 0x70, 0xbd, 0x1d, 0x65, 0xfa, 0x7b, 0xa5, 0x79, 0xf1, 0x74, 0x46,
+    0xd6, 0xd5, 0x37, 0xf2, 0x44, 0x83, 0xc8, 0xbf, 0xc3, 0x13, 0x7c, 0xab, 0x43, 0xd7, 0xb5, 0x3f,
+    0x24, 0x6c, 0x71, 0x7d, 0xf3, 0xcd, 0x82, 0x86, 0xa7, 0x08, 0x1a, 0x9e, 0x22, 0xe8, 0xa4, 0x52,
+    0x7b, 0xb2, 0x4b, 0xdf, 0xc0, 0xf2, 0x40, 0x9a, 0x2a, 0x51, 0xc4, 0x2f, 0x3e, 0x76, 0x8f, 0x25,
+    0x07, 0x6e, 0x19, 0xd6, 0xbf, 0xf6, 0xf1, 0x50, 0x9d, 0x3b, 0xf8, 0x30, 0xa5, 0x2d, 0x36, 0x3e,
+    0x38, 0xb8, 0xf3, 0x1a, 0x56, 0xc3, 0xd6, 0x6a, 0x18, 0x96, 0x1d, 0x22, 0xca, 0x38, 0xe7, 0xf1,
+    0x27, 0x6c, 0x91, 0xa9, 0x64, 0x2a, 0xf3, 0xbb, 0x9d, 0xe9, 0x3f, 0xed, 0x23, 0x79, 0x4d, 0x35,
+    0x1d, 0x0f, 0x2c, 0x91, 0xbd, 0x15, 0xc5, 0x92, 0x57, 0xda, 0xea, 0x07, 0x4b, 0x28, 0xf4, 0xa8,
+    0xef, 0xc9, 0x04, 0x04, 0x91, 0xc9, 0x94, 0x24, 0x22, 0xae, 0x0b, 0x28, 0xc4, 0xfe, 0x82, 0xe9,
+    0xdb, 0x9c, 0xe1, 0xe3, 0xab, 0xc7, 0xb7, 0x89, 0xcf, 0x61, 0x7f, 0x77, 0x08, 0x60, 0x00, 0x03,
+    0x49, 0x89, 0x14, 0x33, 0xe8, 0x24, 0xe5, 0xc2, 0x2f, 0xbb, 0x7d, 0x00, 0xc2, 0x88, 0x90, 0xda,
+    0x1f, 0xf5, 0x88, 0x17, 0x7a, 0x5b, 0x04, 0x59, 0xa1, 0x80, 0x40, 0x21, 0x01, 0xa0, 0xf9, 0x77,
+    0x54, 0x67, 0x7d, 0x58, 0x1b, 0x85, 0xf4, 0x15, 0xf4, 0xf1, 0xb3, 0xcb, 0x30, 0xec, 0x76, 0xc9,
+    0x4b, 0xe2, 0x45, 0x1e, 0x7c, 0xef, 0x61, 0xbc, 0x30, 0x18, 0x80, 0x78, 0xb9, 0x8b, 0x86, 0x67,
+    0x00, 0x74, 0x45, 0xa5, 0xfc, 0x01, 0x44, 0x2d, 0x51, 0xd4, 0xfb, 0xba, 0x98, 0x33, 0xe9, 0x2f,
+    0xbb, 0x7d, 0x2d, 0x7e, 0xe5, 0x0f, 0x2c, 0xf1, 0x47, 0x0d, 0xea, 0x60, 0x00, 0x3e, 0x63, 0x04,
+    0xf7, 0x32, 0x58, 0xed, 0x09, 0xc6, 0xa3, 0x47, 0x74, 0xc6, 0x80, 0x69, 0xfc, 0x89, 0xe0, 0x94,
+    0x07, 0x6e, 0x05, 0xc4, 0x73, 0xc5, 0x61, 0x36, 0xe0, 0x41, 0xca, 0x25, 0x30, 0xc7, 0x01, 0xc7,
+    0x0c, 0x87, 0xb4, 0x2e, 0x63, 0xdc, 0x27, 0x0d, 0xed, 0x2b, 0xf1, 0xc0, 0x14, 0xf8, 0x80, 0x7c,
+    0x6e, 0xb2, 0x17, 0xee, 0x04, 0xe6, 0x46, 0x0c, 0x9a, 0x78, 0xde, 0x75, 0x03, 0x84, 0xbb, 0x04,
+    0xf1, 0xf1, 0x84, 0x03, 0x18, 0x16, 0x57, 0x4e, 0xc6, 0x04, 0x36, 0x66, 0xfe, 0xf2, 0x65, 0xd7,
+    0x22, 0xbf, 0x04, 0xec, 0xad, 0x8c, 0xc1, 0xc5, 0xb1, 0xb3, 0x9d, 0xe5, 0x66, 0xef, 0xeb, 0x4c,
+    0xd1, 0x01, 0x3e, 0x87, 0xaf, 0xa1, 0x71, 0xc8, 0x56, 0x3d, 0x98, 0x0c, 0x43, 0x04, 0x3c, 0xf7,
+    0xf6, 0x2a, 0xb9, 0xd5, 0xe7, 0x7b, 0xdf, 0x33, 0x89, 0xe8, 0x75, 0xfb, 0xbc, 0x2c, 0x99, 0x7c,
+    0xf3, 0xe1, 0xee, 0x1d, 0x68, 0x86, 0xaa, 0x58, 0x14, 0xbb, 0x8f, 0x6d, 0x0c, 0x1c, 0xa2, 0xa7,
+    0xb7, 0xad, 0x87, 0xae, 0x0d, 0x9b, 0x94, 0xaf, 0x7a, 0xa4, 0x14, 0xab, 0x8d, 0xfd, 0x36, 0x14,
+    0x66, 0xff, 0xc2, 0xb8, 0xf7, 0xf1, 0xfe, 0x44, 0xa6, 0xe4, 0x22, 0x24, 0x3f, 0x13, 0xef, 0xf9,
+    0x88, 0xc5, 0xf1, 0x8f, 0x43, 0x8f, 0x44, 0xc4, 0x6f, 0x8f, 0x46, 0xf6, 0x28, 0x1d, 0xc6, 0xe7,
+    0x61, 0x8a, 0x47, 0x5e, 0xb3, 0x16, 0xae, 0x13, 0xc9, 0xe8, 0x0b, 0xab, 0x0c, 0x68, 0x6b, 0x76,
+    0x99, 0xbe, 0x5d, 0xe4, 0x5b, 0xee, 0x60, 0xea, 0x0b, 0xef, 0x08, 0xea, 0x66, 0x45, 0x04, 0x7c,
+    0xa3, 0xd5, 0x1e, 0x22, 0xee, 0xb1, 0x37, 0xf6, 0x4a, 0x76, 0x9c, 0xa7, 0xdd, 0x6f, 0x0e, 0x60,
+    0xdb, 0x03, 0x32, 0x99, 0x90, 0x21, 0x9a, 0x71, 0x93, 0x99, 0x6d, 0x72, 0xd1, 0x98, 0xb8, 0x39,
+    0x35, 0x46, 0xbe, 0xe6, 0x2a, 0x76, 0x10, 0xbc, 0xb7, 0x49, 0xce, 0xb6, 0xac, 0x84, 0x45, 0xe7,
+    0x80, 0x0c, 0xdc, 0x3a, 0x37, 0x38, 0xb0, 0xf1, 0x1c, 0xc0, 0x01, 0xa8, 0xab, 0xae, 0xc8, 0x0e,
+    0xe9, 0x2a, 0xb2, 0x3d, 0xc3, 0xa0, 0x77, 0x1d, 0xc2, 0xa4, 0x70, 0xf9, 0x61, 0x09, 0xe8, 0xec,
+    0x43, 0x74, 0xc9, 0x14, 0x61, 0xb5, 0x99, 0x1e, 0x00, 0x82, 0x92, 0x36, 0xd0, 0xa0, 0x05, 0x9a,
+    0x4c, 0x24, 0x74, 0x21, 0xd0, 0x2a, 0x3c, 0x6e, 0x0f, 0xba, 0x68, 0xa6, 0xd9, 0x70, 0x5c, 0xa1,
+    0xb8, 0x30, 0xec, 0x49, 0x85, 0xf2, 0x05, 0xba, 0xa5, 0xed, 0xa7, 0xae, 0x53, 0x70, 0xf0, 0x1f,
+    0xc1, 0x8e, 0xed, 0xf6, 0xe0, 0x62, 0xc3, 0x08, 0x3f, 0x82, 0x5c, 0xe1, 0x12, 0xe0, 0xa2, 0xc2,
+    0x04, 0x3d, 0x64, 0xbb, 0x19, 0xbd, 0x0e, 0x5a, 0x5d, 0xed, 0x61, 0x6d, 0xd9, 0xe8, 0xa0, 0xea,
+    0xf0, 0x00, 0x43, 0xbc, 0x49, 0xfe, 0x27, 0xfc, 0xaf, 0x8b, 0x36, 0x3c, 0x86, 0x36, 0x6c, 0xd1,
+    0x78, 0x4a, 0x7c, 0xa7, 0x4e, 0xe3, 0x8c, 0xe7, 0x09, 0xd8, 0xda, 0xcf, 0x59, 0xb9, 0x80, 0xec,
+    0xff, 0x0e, 0x49, 0xcc, 0x61, 0x03, 0xe9, 0x3a, 0xe5, 0xba, 0x73, 0xb2, 0x66, 0xb9, 0x06, 0x43,
+    0x3b, 0xba, 0xa5, 0x71, 0xe6, 0xfb, 0x71, 0x8f, 0xf0, 0x2e, 0xf6, 0x4b, 0x14, 0x64, 0xfa, 0xc6,
+    0xae, 0x5a, 0xb1, 0x6b, 0x1d, 0x93, 0x9b, 0xc2, 0x6a, 0x2e, 0x69, 0x46, 0x73, 0x80, 0x43, 0xb5,
+    0x43, 0x7e, 0x9b, 0x1b, 0x9b, 0xc9, 0x6c, 0xbc, 0x6d, 0x79, 0x7b, 0xa4, 0xdb, 0xbc, 0xbd, 0xbf,
+    0xea, 0xd1, 0x25, 0x0d, 0xff, 0xaa, 0x53, 0x16, 0xa6, 0x04, 0xc5, 0x37, 0xac, 0xd6, 0x3d, 0x68,
+    0xdd, 0xb0, 0x4b, 0x11, 0xc4, 0xa0, 0x2f, 0x83, 0x9e, 0x03, 0xa3, 0x9e, 0xe3, 0x5a, 0xdd, 0xf4,
+    0xe7, 0xb7, 0x69, 0xf0, 0x1e, 0x24, 0x05, 0x30, 0x34, 0xe2, 0xac, 0x47, 0xa0, 0x37, 0x65, 0xb4,
+    0x5c, 0x40, 0xe2, 0x9a, 0x76, 0x0d, 0x05, 0xaf, 0xb4, 0x22, 0x94, 0x9c, 0x85, 0xe7, 0xbb, 0xcd,
+    0xab, 0x99, 0x96, 0x6d, 0xdf, 0x4a, 0x19, 0x70, 0xf0, 0xbd, 0x01, 0xad, 0xf8, 0xc0, 0x10, 0x7b,
+    0x3d, 0xf2, 0xd9, 0x48, 0x35, 0xd6, 0x58, 0x05, 0xbc, 0x2f, 0xdd, 0x06, 0x1d, 0x2e, 0xab, 0x30,
+    0x1b, 0x4a, 0x5f, 0xa2, 0xf7, 0x64, 0xff, 0x6f, 0x25, 0x4a, 0xbf, 0x6b, 0x41, 0x66, 0xd6, 0x6d,
+    0xba, 0x63, 0x33, 0x8a, 0xa4, 0xf9, 0xf1, 0x8a, 0x49, 0x85, 0x03, 0xd6, 0xf7, 0xfe, 0x0c, 0xec,
+    0x32, 0xe6, 0x75, 0xf1, 0x6f, 0xc3, 0x34, 0x46, 0x43, 0x7c, 0xdf, 0x04, 0xe5, 0xf3, 0x97, 0xae,
+    0xdb, 0x8d, 0xc1, 0x11, 0x55, 0xad, 0x32, 0x34, 0xce, 0x54, 0xa7, 0x22, 0xa9, 0x14, 0x05, 0x19,
+    0x40, 0x71, 0x95, 0x60, 0xa5, 0x64, 0x10, 0x8f, 0x18, 0xe6, 0x98, 0xc8, 0x73, 0xe8, 0x2f, 0xbd,
+    0xf5, 0x43, 0x33, 0xce, 0xb0, 0x11, 0x62, 0x4e, 0xe1, 0x44, 0x53, 0x5a, 0x32, 0x5a, 0x10, 0x8e,
+    0x44, 0x69, 0xad, 0x58, 0xf2, 0x6c, 0x3d, 0xb9, 0x90, 0x06, 0x43, 0xca, 0xf4, 0x5b, 0xbc, 0xfb,
+    0x82, 0xb7, 0xfd, 0xc6, 0x55, 0x3d, 0xe8, 0xd3, 0xe1, 0x7a, 0xde, 0xb6, 0xee, 0xb3, 0xaf, 0x98,
+    0xaa, 0x2b, 0x5e, 0x26, 0x62, 0xd5, 0xbf, 0x45, 0x65, 0x66, 0xa2, 0x96, 0x31, 0xdb, 0x9d, 0x09,
+    0x8d, 0x9e, 0xb0, 0x3d, 0xb0, 0x15, 0x71, 0xf0, 0xc0, 0xe9, 0xf6, 0x68, 0xd3, 0x09, 0xed, 0x7b,
+    0x5f, 0x94, 0xa0, 0xb9, 0x82, 0x6e, 0x00, 0x44, 0xcc, 0x78, 0xa4, 0x75, 0x54, 0x9c, 0x33, 0x2a,
+    0x5b, 0x1d, 0x51, 0xed, 0x96, 0x78, 0x2d, 0x0f, 0x45, 0xfd, 0x63, 0x76, 0xff, 0x1e, 0xd6, 0x13,
+    0xa9, 0x98, 0x0f, 0x29, 0x0b, 0xfb, 0x90, 0x83, 0xb5, 0x09, 0xd1, 0x5e, 0x25, 0x7f, 0xd9, 0x53,
+    0xc4, 0xa6, 0xf8, 0x84, 0x34, 0x91, 0x69, 0x99, 0xa0, 0xe9, 0x0d, 0x12, 0xf8, 0x34, 0x79, 0x9c,
+    0x99, 0xbc, 0x9b, 0x40, 0xc3, 0x77, 0x2c, 0xec, 0xdf, 0xbc, 0xbb, 0x9f, 0xdd, 0xbe, 0xee, 0x3a,
+    0x74, 0x5f, 0xb1, 0x80, 0x9c, 0x1a, 0x89, 0x4d, 0x7a, 0xb4, 0x5a, 0x37, 0x3f, 0x4f, 0x34, 0xbb,
+    0x1e, 0x2c, 0x80, 0xe6, 0x87, 0x89, 0xf1, 0xc0, 0xfe, 0x40, 0xff, 0x7f, 0x1c, 0xec, 0xb8, 0x0d,
+    0xb8, 0x17, 0x00, 0x00,
+};
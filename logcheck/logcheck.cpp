@@ -0,0 +1,232 @@
+// host check of the FlashLog format: segment rotation, repair of a torn or
+// corrupt tail in begin(), the binary searched range query and a cursor that
+// outlives the segment it started in. Runs on the directory backed LittleFS
+// shim in a fresh temporary directory and on the virtual clock.
+//
+//   pio run -e logcheck && .pio/build/logcheck/program
+//
+// Prints one line per failed check and exits 1 if there was one.
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <algorithm>
+#include <vector>
+#include "config.h"
+#include "flash_log.h"
+
+namespace {
+
+const uint32_t perSegment = (FLASH_LOG_SEGMENT_BYTES - 16) / sizeof(LogRecord);
+
+int failures = 0;
+String root;
+
+#define CHECK(cond, ...)                     \
+    do {                                     \
+        if (!(cond)) {                       \
+            fprintf(stderr, __VA_ARGS__);    \
+            fputc('\n', stderr);             \
+            failures++;                      \
+        }                                    \
+    } while (0)
+
+// sample n of a run, remaining_capacity tells them apart in the log
+BatteryState sample(uint32_t n) {
+    BatteryState state{};
+    state.status = 0;
+    state.remaining_capacity_perc = int16_t(n % 100);
+    state.remaining_capacity = int16_t(n);
+    state.voltage_mv = 38000 + int32_t(n % 500);
+    state.current_ma = -1200;
+    state.temp_zone0 = 21;
+    state.temp_zone1 = 22;
+    for (size_t i = 0; i < state.cells.size(); i++) state.cells[i] = int16_t(3800 + i);
+    return state;
+}
+
+// one add() per log interval, samples first .. first + count - 1
+void addSamples(FlashLog &log, uint32_t first, uint32_t count) {
+    for (uint32_t n = first; n < first + count; n++) {
+        log.add(sample(n));
+        delay(FLASH_LOG_INTERVAL_S * 1000UL);
+    }
+    log.flush();
+}
+
+std::vector<LogRecord> readRange(const FlashLog &log, uint32_t from, uint32_t to) {
+    std::vector<LogRecord> records;
+    FlashLog::Cursor cursor = log.query(from, to);
+    LogRecord record;
+    while (cursor.next(record)) records.push_back(record);
+    return records;
+}
+
+std::vector<uint32_t> segmentFiles() {
+    std::vector<uint32_t> seqs;
+    Dir dir = LittleFS.openDir("/log");
+    while (dir.next()) seqs.push_back(strtoul(dir.fileName().c_str(), nullptr, 16));
+    std::sort(seqs.begin(), seqs.end());
+    return seqs;
+}
+
+String segmentFile(uint32_t seq) {
+    char name[32];
+    snprintf(name, sizeof(name), "/log/%08lx", (unsigned long)seq);
+    return root + name;
+}
+
+long fileSize(const String &path) {
+    FILE *f = fopen(path.c_str(), "rb");
+    if (f == nullptr) return -1;
+    fseek(f, 0, SEEK_END);
+    long size = ftell(f);
+    fclose(f);
+    return size;
+}
+
+// a reset comes back with millis() at 0
+void reboot(FlashLog &log) {
+    log = FlashLog();
+    setVirtualMicros(0);
+    CHECK(log.begin(), "begin() failed");
+}
+
+// the records of a run starting at sample 0 that the newest FLASH_LOG_SEGMENTS segments hold
+uint32_t firstKept(uint32_t total) {
+    uint32_t segments = (total + perSegment - 1) / perSegment;
+    return segments > FLASH_LOG_SEGMENTS ? (segments - FLASH_LOG_SEGMENTS) * perSegment : 0;
+}
+
+void checkRotation(FlashLog &log, uint32_t total) {
+    addSamples(log, 0, total);
+
+    std::vector<uint32_t> seqs = segmentFiles();
+    CHECK(seqs.size() == FLASH_LOG_SEGMENTS, "%zu segment files after rotation", seqs.size());
+
+    std::vector<LogRecord> all = readRange(log, 0, UINT32_MAX);
+    uint32_t first = firstKept(total);
+    CHECK(all.size() == total - first, "%zu records kept of %u, expected %u", all.size(), total, total - first);
+    for (size_t i = 0; i < all.size(); i++) {
+        if (all[i].remaining_capacity != int16_t(first + i) || all[i].time != (first + i) * FLASH_LOG_INTERVAL_S) {
+            CHECK(false, "record %zu is sample %d at %u", i, all[i].remaining_capacity, all[i].time);
+            break;
+        }
+    }
+}
+
+void checkRanges(const FlashLog &log, uint32_t total) {
+    uint32_t first = firstKept(total);
+    uint32_t seed = 0x9e3779b9;
+    for (int i = 0; i < 200; i++) {
+        seed ^= seed << 13;
+        seed ^= seed >> 17;
+        seed ^= seed << 5;
+        // bounds between and on records, before the oldest and past the newest
+        uint32_t from = seed % ((total + 20) * FLASH_LOG_INTERVAL_S);
+        uint32_t to = from + (seed >> 16) % (300 * FLASH_LOG_INTERVAL_S);
+
+        uint32_t lo = std::max(first, (from + FLASH_LOG_INTERVAL_S - 1) / FLASH_LOG_INTERVAL_S);
+        uint32_t hi = std::min(total, to / FLASH_LOG_INTERVAL_S + 1);
+        size_t expected = hi > lo ? hi - lo : 0;
+
+        std::vector<LogRecord> got = readRange(log, from, to);
+        bool ok = got.size() == expected && (expected == 0 || got[0].remaining_capacity == int16_t(lo));
+        CHECK(ok, "query(%u, %u) gave %zu records from sample %d, expected %zu from %u", from, to, got.size(),
+              got.empty() ? -1 : got[0].remaining_capacity, expected, lo);
+    }
+}
+
+void checkRepair(FlashLog &log, uint32_t total) {
+    uint32_t newest = segmentFiles().back();
+    String path = segmentFile(newest);
+    long size = fileSize(path);
+
+    // the last record with a bad crc and half a record behind it
+    FILE *f = fopen(path.c_str(), "r+b");
+    fseek(f, size - 2, SEEK_SET);
+    int crc = fgetc(f);
+    fseek(f, size - 2, SEEK_SET);
+    fputc(crc ^ 0xFF, f);
+    fseek(f, 0, SEEK_END);
+    uint8_t torn[sizeof(LogRecord) / 2] = {0xAB};
+    fwrite(torn, 1, sizeof(torn), f);
+    fclose(f);
+
+    reboot(log);
+    CHECK(fileSize(path) == size - long(sizeof(LogRecord)), "torn tail left the segment at %ld bytes, expected %ld",
+          fileSize(path), size - long(sizeof(LogRecord)));
+    std::vector<LogRecord> all = readRange(log, 0, UINT32_MAX);
+    CHECK(!all.empty() && all.back().remaining_capacity == int16_t(total - 2), "newest record after the repair is sample %d",
+          all.empty() ? -1 : all.back().remaining_capacity);
+    CHECK(log.bootCount() == 1, "boot count %u after one reset", log.bootCount());
+    CHECK(log.now() == (total - 2) * FLASH_LOG_INTERVAL_S + 1, "log clock at %u after the reset", log.now());
+
+    // appends go on right behind the cut
+    uint32_t before = all.size();
+    addSamples(log, total, 5);
+    all = readRange(log, 0, UINT32_MAX);
+    CHECK(all.size() == before + 5 && all.back().remaining_capacity == int16_t(total + 4) && all.back().boot == 1,
+          "%zu records after appending 5 to %u", all.size(), before);
+
+    // a segment with a foreign header is dropped, the others stay
+    String junk = segmentFile(segmentFiles().front());
+    f = fopen(junk.c_str(), "r+b");
+    fputs("NOPE", f);
+    fclose(f);
+    reboot(log);
+    CHECK(fileSize(junk) < 0, "segment with a bad header was kept");
+    CHECK(readRange(log, 0, UINT32_MAX).size() == before + 5 - perSegment, "%zu records after dropping a full segment",
+          readRange(log, 0, UINT32_MAX).size());
+}
+
+void checkCursorAcrossRotation(FlashLog &log, uint32_t total) {
+    FlashLog::Cursor cursor = log.query(0, UINT32_MAX);
+    LogRecord record;
+    uint32_t last = 0;
+    for (int i = 0; i < 5 && cursor.next(record); i++) last = record.time;
+
+    // rotates the segment the cursor is in, and the one after it, away
+    addSamples(log, total, 2 * perSegment);
+    uint32_t oldest = readRange(log, 0, UINT32_MAX).front().time;
+
+    bool first = true;
+    uint32_t read = 0;
+    while (cursor.next(record)) {
+        if (first) CHECK(record.time == oldest, "cursor went on at %u, the oldest record is at %u", record.time, oldest);
+        if (record.time <= last) {
+            CHECK(false, "cursor went back from %u to %u", last, record.time);
+            break;
+        }
+        first = false;
+        last = record.time;
+        read++;
+    }
+    CHECK(read > 0 && last == readRange(log, 0, UINT32_MAX).back().time, "cursor stopped at %u after %u records", last, read);
+}
+
+}
+
+int main() {
+    char dir[] = "/tmp/logcheck.XXXXXX";
+    if (mkdtemp(dir) == nullptr) return 1;
+    root = dir;
+    setenv("FLASH_FS_ROOT", dir, 1);
+    setVirtualMicros(0);
+
+    // a bit over FLASH_LOG_SEGMENTS segments and a partial one
+    uint32_t total = (FLASH_LOG_SEGMENTS + 2) * perSegment + perSegment / 3;
+    FlashLog log;
+    CHECK(log.begin(), "begin() failed");
+    checkRotation(log, total);
+    checkRanges(log, total);
+    checkRepair(log, total);
+    checkCursorAcrossRotation(log, total + 5);
+
+    for (uint32_t seq : segmentFiles()) unlink(segmentFile(seq).c_str());
+    rmdir((root + "/log").c_str());
+    rmdir(dir);
+
+    printf("{\"suite\":\"bms-logcheck\",\"records\":%u,\"per_segment\":%u,\"segments\":%d,\"failures\":%d}\n", total,
+           perSegment, FLASH_LOG_SEGMENTS, failures);
+    return failures > 0 ? 1 : 0;
+}
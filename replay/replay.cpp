@@ -0,0 +1,238 @@
+// replays a bus trace from /api/capture into BatteryMonitor, for comparing
+// protocol path changes against real traffic. Every captured request is issued
+// again at its time, the captured bytes are fed back at theirs.
+//
+//   curl -o capture.bin http://battery.local/api/capture
+//   pio run -e replay && .pio/build/replay/program capture.bin --speed 0 > after.json
+//
+// --speed 1 (default) keeps the original pace, 10 runs ten times faster, 0 as
+// fast as it goes. The monitor runs on a virtual clock following the trace, so
+// the results are the same at any speed; the bytes reach it through a pty.
+#include <fcntl.h>
+#include <stdlib.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+#include "battery.h"
+#include "bus_capture.h"
+#include "config.h"
+
+namespace {
+
+typedef std::chrono::steady_clock Clock;
+
+// virtual time the trace starts at, deadlines before it would wrap
+const unsigned long startUs = 1000000;
+
+struct Totals {
+    uint32_t records = 0;
+    uint32_t rxBytes = 0;
+    uint32_t txFrames = 0;
+    uint32_t transactions = 0;
+    uint32_t done = 0;
+    uint32_t crc = 0;
+    uint32_t timeouts = 0;
+    uint32_t abandoned = 0; // the trace sent the next request while the replay still waited
+    uint32_t foreign = 0; // captured writes to no configured pack
+    std::vector<uint32_t> latencyUs;
+    double monitorNs = 0;
+};
+
+struct Outstanding {
+    bool pending = false;
+    unsigned long startedUs = 0;
+};
+
+std::vector<uint8_t> load(const char *path) {
+    std::vector<uint8_t> data;
+    FILE *f = fopen(path, "rb");
+    if (f == nullptr) return data;
+    uint8_t buf[4096];
+    size_t n;
+    while ((n = fread(buf, 1, sizeof(buf), f)) > 0) data.insert(data.end(), buf, buf + n);
+    fclose(f);
+    return data;
+}
+
+// checks the header, returns the offset of the first record or 0
+size_t readHeader(const std::vector<uint8_t> &trace, const BatteryMonitor &monitor) {
+    if (trace.size() < 6 || memcmp(trace.data(), "NBCP", 4) != 0 || trace[4] != CaptureSource::version) {
+        fprintf(stderr, "not a capture of this version\n");
+        return 0;
+    }
+    uint8_t packs = trace[5];
+    size_t first = 6 + packs + 4;
+    if (trace.size() < first) return 0;
+
+    bool same = packs == monitor.packCount();
+    for (uint8_t i = 0; same && i < packs; i++) same = trace[6 + i] == monitor.packAddress(i);
+    if (!same) fprintf(stderr, "captured with other BATTERY_ADDRESSES, requests to unknown packs are skipped\n");
+    uint32_t baud = 0;
+    for (int i = 0; i < 4; i++) baud |= uint32_t(trace[6 + packs + i]) << (8 * i);
+    if (baud != SERIAL_BAUDRATE) fprintf(stderr, "captured at %u baud\n", baud);
+
+    return first;
+}
+
+int packOf(const BatteryMonitor &monitor, const BusCapture::Record &record) {
+    if (record.len < 7 || record.data[0] != 0x5A || record.data[1] != 0xA5) return -1;
+    for (int pack = 0; pack < monitor.packCount(); pack++) {
+        if (monitor.packAddress(pack) == record.data[4]) return pack;
+    }
+    return -1;
+}
+
+uint32_t percentile(std::vector<uint32_t> values, int p) {
+    if (values.empty()) return 0;
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, values.size() * p / 100)];
+}
+
+}
+
+int main(int argc, char **argv) {
+    const char *path = nullptr;
+    double speed = 1.0;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--speed") == 0 && i + 1 < argc) speed = atof(argv[++i]);
+        else path = argv[i];
+    }
+    if (path == nullptr) {
+        fprintf(stderr, "usage: %s capture.bin [--speed n]\n", argv[0]);
+        return 2;
+    }
+    std::vector<uint8_t> trace = load(path);
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0) {
+        fprintf(stderr, "no pty\n");
+        return 1;
+    }
+    fcntl(master, F_SETFL, O_NONBLOCK);
+    static char slavePath[64];
+    strncpy(slavePath, ptsname(master), sizeof(slavePath) - 1);
+
+    setVirtualMicros(startUs);
+    PosixSerial serial(slavePath);
+    BatteryMonitor monitor(serial, false);
+    // second handle on the slave, to see when written bytes have arrived there
+    int probe = open(slavePath, O_RDONLY | O_NOCTTY | O_NONBLOCK);
+
+    size_t pos = readHeader(trace, monitor);
+    if (pos == 0 || probe < 0) return 1;
+
+    Totals totals;
+    Outstanding outstanding[BATTERY_PACKS];
+    unsigned long now = startUs;
+
+    auto buffered = [&]() {
+        int count = 0;
+        return ioctl(probe, FIONREAD, &count) == 0 ? count : 0;
+    };
+    // polls every open transaction once at the current time, books the finished ones
+    auto pollOpen = [&]() {
+        bool pending = false;
+        for (int pack = 0; pack < BATTERY_PACKS; pack++) {
+            if (!outstanding[pack].pending) continue;
+            auto started = Clock::now();
+            BatteryMonitor::TransactionStatus status = monitor.poll(pack);
+            totals.monitorNs += std::chrono::duration<double, std::nano>(Clock::now() - started).count();
+            if (status == BatteryMonitor::TX_PENDING) {
+                pending = true;
+                continue;
+            }
+            outstanding[pack].pending = false;
+            if (status == BatteryMonitor::TX_DONE) {
+                totals.done++;
+                totals.latencyUs.push_back(uint32_t(now - outstanding[pack].startedUs));
+            } else if (monitor.lastError(pack) == BatteryMonitor::ERR_CRC) {
+                totals.crc++;
+            } else {
+                totals.timeouts++;
+            }
+        }
+        // the requests the monitor writes are not needed, the trace has them
+        uint8_t sink[256];
+        while (read(master, sink, sizeof(sink)) > 0) {
+        }
+        return pending;
+    };
+    // moves the virtual clock to until, in the 1 ms steps of the firmware loop while
+    // something is outstanding, so deadlines expire on time
+    auto advance = [&](unsigned long until) {
+        while (now < until) {
+            now = pollOpen() ? std::min(until, now + 1000) : until;
+            setVirtualMicros(now);
+        }
+        pollOpen();
+    };
+
+    auto wallStart = Clock::now();
+    BusCapture::Record record;
+    bool first = true;
+    while (BusCapture::parse(trace.data(), trace.size(), pos, record)) {
+        unsigned long at = first ? now : now + record.dtUs;
+        first = false;
+        if (speed > 0) {
+            std::this_thread::sleep_until(wallStart + std::chrono::microseconds(uint64_t((at - startUs) / speed)));
+        }
+        advance(at);
+        totals.records++;
+
+        if (record.dir == BusCapture::CAPTURE_RX) {
+            int before = buffered();
+            if (write(master, record.data, record.len) != ssize_t(record.len)) fprintf(stderr, "short pty write\n");
+            for (int spins = 0; buffered() < before + int(record.len) && spins < 100000; spins++) {
+                std::this_thread::yield();
+            }
+            totals.rxBytes += record.len;
+            // the firmware reads a chunk per loop, the rest of it goes in the same pass here
+            for (int passes = 0; passes < 64 && buffered() > 0 && pollOpen(); passes++) {
+            }
+            continue;
+        }
+
+        totals.txFrames++;
+        int pack = packOf(monitor, record);
+        if (pack < 0) {
+            totals.foreign++;
+            continue;
+        }
+        if (outstanding[pack].pending) {
+            outstanding[pack].pending = false;
+            totals.abandoned++;
+        }
+        auto started = Clock::now();
+        monitor.begin(record.data, int(record.len), RESPONSE_TIMEOUT_MS, pack);
+        totals.monitorNs += std::chrono::duration<double, std::nano>(Clock::now() - started).count();
+        totals.transactions++;
+        outstanding[pack] = {true, now};
+    }
+    if (pos != trace.size()) fprintf(stderr, "truncated record at byte %zu\n", pos);
+    advance(now + RESPONSE_TIMEOUT_MS * 1000UL + 1000);
+    double wallMs = std::chrono::duration<double, std::milli>(Clock::now() - wallStart).count();
+
+    uint32_t n = totals.transactions ? totals.transactions : 1;
+    uint64_t latencySum = 0;
+    for (uint32_t us : totals.latencyUs) latencySum += us;
+    printf("{\"suite\":\"bms-replay\",\"trace\":\"%s\",\"speed\":%g,\"trace_ms\":%.1f,\"wall_ms\":%.1f,\"records\":%u,"
+           "\"rx_bytes\":%u,\"tx_frames\":%u,\"foreign_tx\":%u,\n",
+           path, speed, (now - startUs) / 1000.0, wallMs, totals.records, totals.rxBytes, totals.txFrames,
+           totals.foreign);
+    printf("\"transactions\":%u,\"done\":%u,\"crc_errors\":%u,\"timeouts\":%u,\"abandoned\":%u,\"decode_rate\":%.4f,"
+           "\"crc_rate\":%.4f,\"timeout_rate\":%.4f,\n",
+           totals.transactions, totals.done, totals.crc, totals.timeouts, totals.abandoned, double(totals.done) / n,
+           double(totals.crc) / n, double(totals.timeouts) / n);
+    printf("\"latency_us\":{\"p50\":%u,\"p90\":%u,\"p99\":%u,\"max\":%u,\"avg\":%.0f},\n",
+           percentile(totals.latencyUs, 50), percentile(totals.latencyUs, 90), percentile(totals.latencyUs, 99),
+           percentile(totals.latencyUs, 100), totals.latencyUs.empty() ? 0.0 : double(latencySum) / totals.latencyUs.size());
+    printf("\"monitor\":{\"frames_sent\":%u,\"replies\":%u,\"timeouts\":%u,\"crc_errors\":%u,\"resyncs\":%u,\"strays\":%u,"
+           "\"ns_per_transaction\":%.0f}}\n",
+           monitor.framesSent(), monitor.replies(), monitor.timeouts(), monitor.crcErrors(), monitor.resyncs(),
+           monitor.strays(), totals.monitorNs / n);
+
+    return 0;
+}
@@ -0,0 +1,46 @@
+# Embeds web/index.html gzipped into include/web_index.h.
+#
+# Runs as PlatformIO pre-script (extra_scripts = pre:scripts/embed_web.py) and
+# can be called by hand: python3 scripts/embed_web.py
+import gzip
+import hashlib
+import os
+
+try:
+    Import("env")  # noqa: F821 - provided by PlatformIO/SCons
+    root = env["PROJECT_DIR"]  # noqa: F821
+except NameError:
+    root = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+
+source = os.path.join(root, "web", "index.html")
+target = os.path.join(root, "include", "web_index.h")
+
+with open(source, "rb") as f:
+    html = f.read()
+
+# mtime=0 keeps the output byte-identical between builds
+payload = gzip.compress(html, compresslevel=9, mtime=0)
+etag = hashlib.sha1(html).hexdigest()[:16]
+
+lines = [
+    "// generated by scripts/embed_web.py from web/index.html, do not edit",
+    "#pragma once",
+    "#include \"hal.h\"",
+    "",
+    '#define WEB_INDEX_ETAG "\\"%s\\""' % etag,
+    "",
+    "static const uint8_t web_index_gz[] PROGMEM = {",
+]
+for i in range(0, len(payload), 16):
+    lines.append("    " + " ".join("0x%02x," % b for b in payload[i:i + 16]))
+lines.append("};")
+lines.append("")
+content = "\n".join(lines)
+
+old = None
+if os.path.exists(target):
+    with open(target) as f:
+        old = f.read()
+if old != content:
+    with open(target, "w") as f:
+        f.write(content)
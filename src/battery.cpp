@@ -1,29 +1,125 @@
-#include <SoftwareSerial.h>
-#include <HardwareSerial.h>
 #include "battery.h"
+#include "bus_capture.h"
 #include "config.h"
+#include "trace.h"
 
 struct BatteryState;
 
+static const char errorNone[] PROGMEM = "";
+static const char errorNoData[] PROGMEM = "no data yet";
+static const char errorSerial[] PROGMEM = "error reading serial";
+static const char errorFactoryCapacity[] PROGMEM = "error reading factory_capacity";
+static const char errorActualCapacity[] PROGMEM = "error reading actual_capacity";
+static const char errorStatus[] PROGMEM = "error reading status";
+static const char errorRemainingCapacity[] PROGMEM = "error reading remaining_capacity";
+static const char errorRemainingCapacityPerc[] PROGMEM = "error reading remaining_capacity_perc";
+static const char errorCurrent[] PROGMEM = "error reading current";
+static const char errorVoltage[] PROGMEM = "error reading voltage";
+static const char errorTemperature[] PROGMEM = "error reading temperature";
+static const char errorCellsVoltage[] PROGMEM = "error reading cells_voltage";
+static const char errorRestored[] PROGMEM = "restored from before the reset, not read yet";
+
+// indexed by BatteryError
+static const char *const errorTexts[BATTERY_ERROR_COUNT] PROGMEM = {
+    errorNone, errorNoData, errorSerial, errorFactoryCapacity, errorActualCapacity, errorStatus,
+    errorRemainingCapacity, errorRemainingCapacityPerc, errorCurrent, errorVoltage, errorTemperature,
+    errorCellsVoltage, errorRestored,
+};
+
+PGM_P batteryErrorText(BatteryError error) {
+    if (error >= BATTERY_ERROR_COUNT) return errorNone;
+    return reinterpret_cast<PGM_P>(pgm_read_ptr(&errorTexts[error]));
+}
+
+// source address of our requests
+static const byte hostAddress = 0x20;
+
+// sorted by register, planReads() relies on it
+const BatteryMonitor::RegisterField BatteryMonitor::registerTable[FIELD_COUNT] = {
+    {BMS_REG_SERIAL, 14, FIELD_SERIAL, REFRESH_ONCE},
+    {BMS_REG_FACTORY_CAPACITY, 2, FIELD_FACTORY_CAPACITY, REFRESH_ONCE},
+    {BMS_REG_ACTUAL_CAPACITY, 2, FIELD_ACTUAL_CAPACITY, REFRESH_SLOW},
+    {BMS_REG_STATUS, 2, FIELD_STATUS, REFRESH_LIVE},
+    {BMS_REG_REMAINING_CAPACITY, 2, FIELD_REMAINING_CAPACITY, REFRESH_LIVE},
+    {BMS_REG_REMAINING_CAPACITY_PERC, 2, FIELD_REMAINING_CAPACITY_PERC, REFRESH_LIVE},
+    {BMS_REG_CURRENT, 2, FIELD_CURRENT, REFRESH_LIVE},
+    {BMS_REG_VOLTAGE, 2, FIELD_VOLTAGE, REFRESH_LIVE},
+    {BMS_REG_TEMPERATURE, 2, FIELD_TEMPERATURE, REFRESH_DETAIL},
+    {BMS_REG_CELLS, BATTERY_CELLS * 2, FIELD_CELLS_VOLTAGE, REFRESH_DETAIL},
+};
+
+// the dump requests of every pack, addresses and ranges are known at compile time
+struct DumpRequests {
+    NinebotRequest frames[BATTERY_PACKS][registerDumpBlocks];
+};
+
+static constexpr DumpRequests buildDumpRequests() {
+    DumpRequests requests{};
+    const byte addresses[] = BATTERY_ADDRESSES;
+    for (int pack = 0; pack < BATTERY_PACKS; pack++) {
+        for (int block = 0; block < registerDumpBlocks; block++) {
+            int first = block * registerDumpBlockWords;
+            int words = registerDumpWords - first < registerDumpBlockWords ? registerDumpWords - first : registerDumpBlockWords;
+            requests.frames[pack][block] =
+                ninebotRequest(hostAddress, addresses[pack], 0x01, byte(registerDumpFirst + first), byte(words * 2));
+        }
+    }
+    return requests;
+}
+
+static constexpr DumpRequests dumpRequests PROGMEM = buildDumpRequests();
+
+BatteryMonitor::RefreshClass BatteryMonitor::refreshClass(FieldId id) {
+    // the table is indexed by FieldId as well
+    return registerTable[id].refresh;
+}
+
 
 BatteryMonitor::BatteryMonitor(SERIAL_TYPE &_serial, bool debugEnabled){
     batterySerial = &_serial;
     batterySerial->begin(SERIAL_BAUDRATE);
     batterySerial->setTimeout(2000);
     debug = debugEnabled;
+
+    const byte addresses[] = BATTERY_ADDRESSES;
+    static_assert(sizeof(addresses) == BATTERY_PACKS, "BATTERY_PACKS has to match BATTERY_ADDRESSES");
+    for (int i = 0; i < BATTERY_PACKS; i++) {
+        slots[i].address = addresses[i];
+    }
 }
 
-bool BatteryMonitor::sendCommand(const byte *cmd, int cmdLen) {
-    if (debug) printBytes("BatteryMonitor request", cmd, cmdLen);
+void BatteryMonitor::planReads(PackSlot &slot, uint16_t fields) {
+    slot.blocks = 0;
+    for (int i = 0; i < FIELD_COUNT; i++) {
+        if (!(fields & (1 << i))) continue;
+        const RegisterField &field = registerTable[i];
+        if (slot.blocks > 0) {
+            ReadBlock &last = slot.plan[slot.blocks - 1];
+            int lastEnd = last.reg + (last.len + 1) / 2; // first register after the block
+            int mergedLen = (field.reg - last.reg) * 2 + field.len;
+            if (field.reg <= lastEnd + batchMaxGap && mergedLen <= batchMaxLen) {
+                if (mergedLen > last.len) last.len = mergedLen;
+                // unwanted fields in between are inside the block anyway, decode them too
+                last.fieldCount = i - last.firstField + 1;
+                continue;
+            }
+        }
+        slot.plan[slot.blocks++] = {field.reg, field.len, byte(i), 1};
+    }
+}
 
+bool BatteryMonitor::sendCommand(const byte *cmd, int cmdLen, int pack) {
     int maxAtt = 1;
     for(int att = 1; att <=maxAtt; att++) {
-        batterySerial->write(cmd, cmdLen);
-        if(receiving()) {
+        begin(cmd, cmdLen, RESPONSE_TIMEOUT_MS, pack);
+        TransactionStatus result;
+        while ((result = poll(pack)) == TX_PENDING) {
+            yield();
+        }
+        if (result == TX_DONE) {
 
             return true;
         }
-        delay(500);
         #ifdef DEBUG
         if(debug) Serial.printf("failed (%d/%d)...\n", att, maxAtt);
         #endif
@@ -32,214 +128,285 @@ bool BatteryMonitor::sendCommand(const byte *cmd, int cmdLen) {
     return false;
 }
 
-bool BatteryMonitor::receiving() {
-    unsigned long started = millis();
-    while(!batterySerial->available()) {
-        if(millis() - started >= 500) {
-            #ifdef DEBUG
-            if(debug) Serial.println("receive timeout");
-            #endif
+void BatteryMonitor::begin(const byte *cmd, int cmdLen, unsigned long timeoutMs, int pack) {
+    PackSlot &slot = slots[pack];
+    if (cmdLen > maxRequest) cmdLen = maxRequest;
+    memcpy(slot.request, cmd, cmdLen);
+    slot.requestLen = cmdLen;
+    slot.reg = cmdLen > 6 ? cmd[6] : 0;
+    // read register is answered with 0x04, the writes with 0x05
+    slot.replyCmd = cmdLen > 5 && cmd[5] == 0x01 ? 0x04 : 0x05;
+    slot.timeout = timeoutMs;
+    slot.status = TX_PENDING;
+    slot.error = ERR_NONE;
+    slot.queued = true;
+
+    if (inFlight() < BUS_PIPELINE_DEPTH) send(slot);
+}
 
-            return false;
+void BatteryMonitor::send(PackSlot &slot) {
+    if (inFlight() == 0) {
+        // nothing is expected, whatever is still buffered belongs to an abandoned response
+        byte stale[32];
+        size_t len = 0;
+        while (batterySerial->available()) {
+            stale[len++] = batterySerial->read();
+            if (len == sizeof(stale) || !batterySerial->available()) {
+                if (capture != nullptr) capture->add(BusCapture::CAPTURE_RX, stale, len);
+                len = 0;
+            }
         }
+        parser.reset();
+        crcErrorsSeen = parser.crcErrors();
+    }
+    if (debug) printBytes("BatteryMonitor request", slot.request, slot.requestLen);
+
+    batterySerial->write(slot.request, slot.requestLen);
+    if (capture != nullptr) capture->add(BusCapture::CAPTURE_TX, slot.request, slot.requestLen);
+    sent++;
+    slot.queued = false;
+    slot.startedUs = micros();
+    slot.started = millis();
+}
+
+int BatteryMonitor::inFlight() const {
+    int count = 0;
+    for (const PackSlot &slot : slots) {
+        if (slot.status == TX_PENDING && !slot.queued) count++;
+    }
+    return count;
+}
+
+void BatteryMonitor::finish(PackSlot &slot, TransactionStatus status, TransactionError _error) {
+    TRACE_SPAN(TRACE_BUS, slot.startedUs, micros() - slot.startedUs, uint16_t(slot.reg | _error << 8),
+               traceBusTrack(int(&slot - slots)));
+    slot.status = status;
+    slot.error = _error;
+}
+
+void BatteryMonitor::endSweep(PackSlot &slot) {
+    slot.running = false;
+    for (const PackSlot &other : slots) {
+        if (other.running) return;
+    }
+    lastRoundMs = millis() - roundStarted;
+}
+
+void BatteryMonitor::pump() {
+    // only what is already buffered, never waits for more bytes
+    byte chunk[32];
+    size_t len = 0;
+    while (len < sizeof(chunk) && len < parser.space() && batterySerial->available()) {
+        chunk[len++] = batterySerial->read();
     }
-    memset(response, 0, responseSize);
-    responsePos = 0;
-    state = STATE_NONE;
-
-    while (batterySerial->available()) {
-        int currentByte = batterySerial->read();
-        response[responsePos] = currentByte;
-
-        bool save = true;
-        switch (state) {
-            case STATE_NONE:
-                if (currentByte == 0x5A) {
-                    state = STATE_HEADER2;
-                    break;
-                }
-
-                #ifdef DEBUG
-                if(debug) Serial.println("invalid state at header 1");
-                if(debug) printBytes("bytes", response, 10);
-                #endif
-
-                //hack to fix not receiving last byte
-                return receiving();
-            case STATE_HEADER2:
-                if (currentByte != 0xA5) {
-                    #ifdef DEBUG
-                    if(debug) Serial.println("invalid state at header 2");
-                    if (debug) printBytes("bytes", response, 10);
-                    #endif
-
-                    save = false;
-                    break;
-                }
-
-                state = STATE_LEN;
-                break;
-            case STATE_LEN:
-                expectedLen = currentByte;
-                state = STATE_SRCADDR;
-                break;
-            case STATE_SRCADDR:
-                state = STATE_DSTADDR;
-                break;
-            case STATE_DSTADDR:
-                state = STATE_CMD;
-                break;
-            case STATE_CMD:
-                state = STATE_ARG;
-                break;
-            case STATE_ARG:
-                //arg = currentByte
-                state = STATE_PAYLOAD;
-                payloadPos = 0;
-                break;
-            case STATE_PAYLOAD:
-                state = STATE_PAYLOAD;
-                payloadPos++;
-                if (payloadPos >= expectedLen) {
-                    state = STATE_CRC;
-                    break;
-                }
-                break;
-            case STATE_CRC:
-                if (responsePos + 1 >= expectedLen + 9) {
-                    if (debug) printBytes("stop by len " + String(expectedLen + 9), response, 40);
-
-                    state = STATE_READY;
-                    break;
-                }
-                break;
-            default:
-                #ifdef DEBUG
-                Serial.printf("unknown state %d\n", state);
-                #endif
-                panic();
+    if (len > 0 && capture != nullptr) capture->add(BusCapture::CAPTURE_RX, chunk, len);
+    parser.feed(chunk, len);
+
+    // replies from a pack to us, anything else on the bus (our own echo) is skipped
+    while (parser.next(frame)) {
+        PackSlot *slot = nullptr;
+        bool known = false;
+        for (PackSlot &candidate : slots) {
+            if (frame.src() != candidate.address) continue;
+            known = true;
+            if (candidate.status == TX_PENDING && !candidate.queued && frame.cmd() == candidate.replyCmd &&
+                frame.arg() == candidate.reg) {
+                slot = &candidate;
+            }
         }
-        if (!save) {
-            memset(response, 0, responseSize);
-            responsePos = 0;
-            state = STATE_NONE;
+        if (slot == nullptr) {
+            // late reply to a request that already timed out
+            if (known) unmatched++;
             continue;
         }
-        if (state == STATE_READY) {
 
-            return verifyCrc();
-        }
+        if (debug) printBytes("would parse", frame.data, frame.len);
+        received++;
+        int series = 0;
+        while (series < seriesUsed && seriesRegister[series] != slot->reg) series++;
+        if (series == seriesUsed && seriesUsed < latencySeries - 1) seriesRegister[seriesUsed++] = slot->reg;
+        roundTrip[series].observe(micros() - slot->startedUs);
 
-        responsePos++;
-        if (responsePos >= responseSize) {
-            if (debug) printBytes("invalid response size", response, 11);
-            state = STATE_NONE;
-            memset(response, 0, responseSize);
-            responsePos = 0;
+        slot->replyLen = frame.payloadLen() < batchMaxLen ? frame.payloadLen() : batchMaxLen;
+        memcpy(slot->reply, frame.payload(), slot->replyLen);
+        finish(*slot, TX_DONE, ERR_NONE);
+    }
 
-            return false;
+    if (parser.crcErrors() != crcErrorsSeen) {
+        crcErrorsSeen = parser.crcErrors();
+        #ifdef DEBUG
+        if(debug) Serial.println("invalid crc");
+        #endif
+
+        // the sender of a broken frame is unknown, replies come in request order
+        // more often than not, so the oldest request takes the blame
+        PackSlot *oldest = nullptr;
+        for (PackSlot &slot : slots) {
+            if (slot.status != TX_PENDING || slot.queued) continue;
+            if (oldest == nullptr || long(slot.started - oldest->started) < 0) oldest = &slot;
         }
+        if (oldest != nullptr) finish(*oldest, TX_ERROR, ERR_CRC);
     }
 
-    //hack to fix not receiving last byte
-    if (state == STATE_CRC) {
-        response[expectedLen + 9 - 1] = 0xFF;
+    unsigned long now = millis();
+    for (PackSlot &slot : slots) {
+        if (slot.status != TX_PENDING || slot.queued || now - slot.started < slot.timeout) continue;
+        #ifdef DEBUG
+        if(debug) Serial.println("receive timeout");
+        #endif
 
-        return verifyCrc();
+        timedOut++;
+        finish(slot, TX_ERROR, ERR_TIMEOUT);
     }
 
-    if (debug) printBytes("not processing", response, 11);
+    for (int i = 0; i < BATTERY_PACKS && inFlight() < BUS_PIPELINE_DEPTH; i++) {
+        PackSlot &slot = slots[(nextSend + i) % BATTERY_PACKS];
+        if (slot.status != TX_PENDING || !slot.queued) continue;
+        send(slot);
+        nextSend = (nextSend + i + 1) % BATTERY_PACKS;
+    }
+}
 
-    return false;
+BatteryMonitor::TransactionStatus BatteryMonitor::poll(int pack) {
+    if (slots[pack].status != TX_PENDING) return slots[pack].status;
+    pump();
+
+    return slots[pack].status;
 }
 
-bool BatteryMonitor::readBatteryState(BatteryState &state) {
+void BatteryMonitor::beginBlock(int pack) {
+    PackSlot &slot = slots[pack];
+    NinebotRequest request = ninebotRequest(hostAddress, slot.address, 0x01, slot.plan[slot.block].reg,
+                                            slot.plan[slot.block].len);
+    begin(request.bytes, request.size, RESPONSE_TIMEOUT_MS, pack);
+}
 
-    if(!sendCommand(get_status, sizeof(get_status))) {
-        state.error = F("error reading status");
-        return false;
-    } else{
-        state.status = convertBytesToInt(response[8], response[7]);
-    }
+void BatteryMonitor::beginDump(int block, int pack) {
+    NinebotRequest request;
+    memcpy_P(&request, &dumpRequests.frames[pack][block], sizeof(request));
+    begin(request.bytes, request.size, RESPONSE_TIMEOUT_MS, pack);
+}
 
-    if(!sendCommand(get_serial, sizeof(get_serial))) {
-        state.error = F("error reading serial");
-        return false;
-    } else {
-        byte serial[15] = {};
-        memcpy(&serial, &response[7], 14 * sizeof(response[0])); serial[14] = 0x00;
-        state.serial = String((char*)serial);
-    }
+size_t BatteryMonitor::copyReply(byte *out, size_t max, int pack) const {
+    const PackSlot &slot = slots[pack];
+    size_t len = slot.replyLen < max ? slot.replyLen : max;
+    memcpy(out, slot.reply, len);
+    return len;
+}
 
-    if(!sendCommand(get_remaining_capacity_perc, sizeof(get_remaining_capacity_perc))) {
-        state.error = F("error reading remaining_capacity_perc");
-        return false;
-    } else {
-        state.remaining_capacity_perc = convertBytesToInt(response[8], response[7]);
-    }
+bool BatteryMonitor::decodeBlock(const PackSlot &slot, BatteryState &state) {
+    const ReadBlock &plan = slot.plan[slot.block];
+    // the register was matched with the request already
+    if (slot.replyLen < plan.len) return false;
 
-    if(!sendCommand(get_remaining_capacity, sizeof(get_remaining_capacity))) {
-        state.error = F("error reading remaining_capacity");
-        return false;
-    } else {
-        state.remaining_capacity = convertBytesToInt(response[8], response[7]);
+    for (int i = plan.firstField; i < plan.firstField + plan.fieldCount; i++) {
+        const RegisterField &field = registerTable[i];
+        decodeField(field.id, slot.reply + (field.reg - plan.reg) * 2, state);
     }
 
-    if(!sendCommand(get_factory_capacity, sizeof(get_factory_capacity))) {
-        state.error = F("error reading factory_capacity");
-        return false;
-    } else {
-        state.factory_capacity = convertBytesToInt(response[8], response[7]);
+    return true;
+}
+
+void BatteryMonitor::decodeField(FieldId id, const byte data[], BatteryState &state) {
+    switch (id) {
+        case FIELD_SERIAL:
+            memcpy(state.serial, data, sizeof(state.serial) - 1);
+            state.serial[sizeof(state.serial) - 1] = '\0';
+            break;
+        case FIELD_FACTORY_CAPACITY:
+            state.factory_capacity = convertBytesToInt(data[1], data[0]);
+            break;
+        case FIELD_ACTUAL_CAPACITY:
+            state.actual_capacity = convertBytesToInt(data[1], data[0]);
+            break;
+        case FIELD_STATUS:
+            state.status = convertBytesToInt(data[1], data[0]);
+            break;
+        case FIELD_REMAINING_CAPACITY:
+            state.remaining_capacity = convertBytesToInt(data[1], data[0]);
+            break;
+        case FIELD_REMAINING_CAPACITY_PERC:
+            state.remaining_capacity_perc = convertBytesToInt(data[1], data[0]);
+            break;
+        case FIELD_CURRENT:
+            state.current_ma = int32_t(convertBytesToInt(data[1], data[0])) * 10;
+            break;
+        case FIELD_VOLTAGE:
+            state.voltage_mv = int32_t(convertBytesToInt(data[1], data[0])) * 10;
+            break;
+        case FIELD_TEMPERATURE:
+            state.temp_zone0 = data[0] - 20;
+            state.temp_zone1 = data[1] - 20;
+            break;
+        case FIELD_CELLS_VOLTAGE:
+            for (size_t i = 0; i < state.cells.size(); i++) {
+                state.cells[i] = convertBytesToInt(data[i * 2 + 1], data[i * 2]);
+            }
+            break;
+        default:
+            break;
     }
+}
 
-    if(!sendCommand(get_actual_capacity, sizeof(get_actual_capacity))) {
-        state.error = F("error reading actual_capacity");
-        return false;
-    } else {
-        state.actual_capacity = convertBytesToInt(response[8], response[7]);
+void BatteryMonitor::beginRead(uint16_t fields, int pack) {
+    PackSlot &slot = slots[pack];
+    bool idle = true;
+    for (const PackSlot &other : slots) {
+        if (other.running) idle = false;
     }
+    if (idle) roundStarted = millis();
 
-    if(!sendCommand(get_current, sizeof(get_current))) {
-        state.error = F("error reading current");
-        return false;
-    } else {
-        state.current = double(convertBytesToInt(response[8], response[7])) * 10 / 1000;
+    planReads(slot, fields);
+    slot.block = 0;
+    slot.running = slot.blocks > 0;
+    if (slot.running) beginBlock(pack);
+}
+
+BatteryMonitor::TransactionStatus BatteryMonitor::pollRead(BatteryState &state, int pack) {
+    PackSlot &slot = slots[pack];
+    if (!slot.running) return TX_IDLE;
+
+    TransactionStatus result = poll(pack);
+    if (result == TX_PENDING) return TX_PENDING;
+
+    if (result != TX_DONE || !decodeBlock(slot, state)) {
+        endSweep(slot);
+        state.error = BatteryError(BATTERY_ERR_READ_SERIAL + registerTable[slot.plan[slot.block].firstField].id);
+        return TX_ERROR;
     }
 
-    if(!sendCommand(get_voltage, sizeof(get_voltage))) {
-        state.error = F("error reading voltage");
-        return false;
-    } else {
-        state.voltage = double(convertBytesToInt(response[8], response[7])) * 10 / 1000;
+    if (++slot.block < slot.blocks) {
+        beginBlock(pack);
+        return TX_PENDING;
     }
-    state.power = double (state.current * state.voltage);
 
-    if(!sendCommand(get_temperature, sizeof(get_temperature))) {
-        state.error = F("error reading temperature");
-        return false;
-    } else {
-        state.temp_zone0 = response[7] - 20;
-        state.temp_zone1 = response[8] - 20;
+    slot.fields = 0;
+    for (int i = 0; i < slot.blocks; i++) {
+        for (int f = slot.plan[i].firstField; f < slot.plan[i].firstField + slot.plan[i].fieldCount; f++) {
+            slot.fields |= 1 << f;
+        }
     }
+    // both are multiples of 10, the product of the raw 10 mA / 10 mV values fits
+    state.power_mw = (state.current_ma / 10) * (state.voltage_mv / 10) / 10;
+    state.uptime = millis() / 1000;
+    endSweep(slot);
 
-    if(!sendCommand(get_cells_voltage, sizeof(get_cells_voltage))) {
-        state.error = F("error reading cells_voltage");
-        return false;
-    } else {
-        state.cell_voltage_cell0 = convertBytesToInt(response[8], response[7]);
-        state.cell_voltage_cell1 = convertBytesToInt(response[10], response[9]);
-        state.cell_voltage_cell2 = convertBytesToInt(response[12], response[11]);
-        state.cell_voltage_cell3 = convertBytesToInt(response[14], response[13]);
-        state.cell_voltage_cell4 = convertBytesToInt(response[16], response[15]);
-        state.cell_voltage_cell5 = convertBytesToInt(response[18], response[17]);
-        state.cell_voltage_cell6 = convertBytesToInt(response[20], response[19]);
-        state.cell_voltage_cell7 = convertBytesToInt(response[22], response[21]);
-        state.cell_voltage_cell8 = convertBytesToInt(response[24], response[23]);
-        state.cell_voltage_cell9 = convertBytesToInt(response[26], response[25]);
+    return TX_DONE;
+}
+
+bool BatteryMonitor::readBatteryState(BatteryState &state, int pack) {
+    beginRead(allFields, pack);
+    TransactionStatus result;
+    while ((result = pollRead(state, pack)) == TX_PENDING) {
+        yield();
     }
-    state.uptime = long(millis() / 1000);
 
-    return true;
+    return result == TX_DONE;
+}
+
+int BatteryMonitor::latencyRegister(int series) const {
+    if (series < seriesUsed) return seriesRegister[series];
+    return -1;
 }
 
 int16_t BatteryMonitor::convertBytesToInt(byte byte1, byte byte2) {
@@ -263,17 +430,165 @@ void BatteryMonitor::printBytes(const String &tag, const byte bytes[], int len)
     #endif
 }
 
-bool BatteryMonitor::verifyCrc() {
-    unsigned int cs = 0;
-    for (int i = 2; i <= expectedLen + 6; i++) {
-        cs = cs + response[i];
+BatteryPoller::BatteryPoller(BatteryMonitor &_monitor, BatteryState &_snapshot, int _pack) {
+    attach(_monitor, _snapshot, _pack);
+}
+
+void BatteryPoller::attach(BatteryMonitor &_monitor, BatteryState &_snapshot, int _pack) {
+    monitor = &_monitor;
+    snapshot = &_snapshot;
+    packIndex = _pack;
+}
+
+BatteryPoller::Mode BatteryPoller::mode() const {
+    if (!sampled) return MODE_NORMAL;
+    int32_t current = abs(snapshot->current_ma);
+    if (snapshot->status == 1 || current >= POLL_HEAVY_MA) return MODE_ACTIVE;
+    if (current < POLL_IDLE_MA) return MODE_IDLE;
+
+    return MODE_NORMAL;
+}
+
+unsigned long BatteryPoller::fieldInterval(BatteryMonitor::FieldId id) const {
+    unsigned long interval;
+    switch (BatteryMonitor::refreshClass(id)) {
+        case BatteryMonitor::REFRESH_ONCE: return 0;
+        case BatteryMonitor::REFRESH_SLOW: return POLL_SLOW_MS;
+        case BatteryMonitor::REFRESH_LIVE: interval = POLL_LIVE_MS; break;
+        default: interval = POLL_DETAIL_MS; break;
+    }
+    switch (mode()) {
+        case MODE_IDLE: interval *= POLL_IDLE_FACTOR; break;
+        case MODE_ACTIVE: interval /= POLL_ACTIVE_DIVISOR; break;
+        default: break;
+    }
+    if ((requiredFields & (1 << id)) && requiredMs < interval) interval = requiredMs;
+
+    return interval;
+}
+
+void BatteryPoller::require(uint16_t fields, unsigned long intervalMs) {
+    requiredFields |= fields;
+    if (requiredMs == 0 || intervalMs < requiredMs) requiredMs = intervalMs;
+}
+
+void BatteryPoller::update() {
+    if (monitor == nullptr) return;
+    // the sweeps wait for a running dump
+    if (dumping) {
+        advanceDump();
+        return;
     }
-    if (((response[expectedLen + 9 - 1] << 8) | response[expectedLen + 9 - 2]) == 0xFFFF - cs) {
-        if (debug) printBytes("would parse", response, expectedLen + 9);
+    if (!reading) {
+        if (dumpWanted) {
+            dumpWanted = false;
+            dumping = true;
+            dumpBlock = 0;
+            dumpImage.blocksRead = 0;
+            dumpStarted = millis();
+            monitor->beginDump(dumpBlock, packIndex);
+            return;
+        }
+
+        unsigned long now = millis();
+        // after a failed sweep the bus gets one live interval before the next try
+        if (failed && now - lastPoll < fieldInterval(BatteryMonitor::FIELD_CURRENT)) return;
 
-        return true;
+        uint16_t due = 0;
+        for (int i = 0; i < BatteryMonitor::FIELD_COUNT; i++) {
+            unsigned long interval = fieldInterval(BatteryMonitor::FieldId(i));
+            bool known = readOnce & (1 << i);
+            if (!known || (interval > 0 && now - lastRead[i] >= interval)) due |= 1 << i;
+        }
+        // the required fields are used together, their own timers would drift apart with the loop
+        if (due & requiredFields) due |= requiredFields;
+        if (due == 0) return;
+        lastPoll = now;
+        if (failed) retriedSweeps++;
+
+        scratch = *snapshot;
+        sweepStarted = now;
+        sweepStartUs = micros();
+        monitor->beginRead(due, packIndex);
+        reading = true;
     }
-    if (debug) printBytes("invalid crc", response, expectedLen + 9);
 
-    return false;
+    BatteryMonitor::TransactionStatus result = monitor->pollRead(scratch, packIndex);
+    if (result == BatteryMonitor::TX_PENDING) return;
+    reading = false;
+    lastSweepMs = millis() - sweepStarted;
+
+    failed = result != BatteryMonitor::TX_DONE;
+    if (result == BatteryMonitor::TX_DONE) {
+        uint16_t fields = monitor->fieldsRead(packIndex);
+        for (int i = 0; i < BatteryMonitor::FIELD_COUNT; i++) {
+            if (fields & (1 << i)) lastRead[i] = sweepStarted;
+        }
+        readOnce |= fields;
+        sampleFields = fields;
+        sampleStartUs = sweepStartUs;
+        scratch.error = BATTERY_OK;
+        *snapshot = scratch;
+        lastSample = millis();
+        sampled = true;
+        okSweeps++;
+        snapshotVersion++;
+        for (int i = 0; i < listenerCount; i++) {
+            listeners[i](*snapshot);
+        }
+    } else {
+        // keep the last good values, only surface the error. A dead bus repeats
+        // the same one, that is no change for the etag and the event stream
+        if (snapshot->error != scratch.error) {
+            snapshot->error = scratch.error;
+            snapshotVersion++;
+        }
+        badSweeps++;
+    }
+}
+
+uint32_t BatteryPoller::requestDump() {
+    // a running dump may have read some blocks before the request came
+    uint32_t done = dumpsDone + (dumping ? 2 : 1);
+    dumpWanted = true;
+    return done;
+}
+
+void BatteryPoller::advanceDump() {
+    BatteryMonitor::TransactionStatus result = monitor->poll(packIndex);
+    if (result == BatteryMonitor::TX_PENDING) return;
+
+    if (result == BatteryMonitor::TX_DONE) {
+        byte reply[registerDumpBlockWords * 2];
+        size_t len = monitor->copyReply(reply, sizeof(reply), packIndex);
+        uint8_t first = dumpBlock * registerDumpBlockWords;
+        uint8_t words = registerDumpWords - first < registerDumpBlockWords ? registerDumpWords - first : registerDumpBlockWords;
+        if (len >= words * 2u) {
+            for (uint8_t i = 0; i < words; i++) {
+                dumpImage.words[first + i] = uint16_t(reply[i * 2] | (reply[i * 2 + 1] << 8));
+            }
+            dumpImage.blocksRead |= 1 << dumpBlock;
+        }
+    }
+    // a block that failed stays out of blocksRead, the others are still worth reading
+    if (++dumpBlock < registerDumpBlocks) {
+        monitor->beginDump(dumpBlock, packIndex);
+        return;
+    }
+
+    dumping = false;
+    dumpImage.finished = millis();
+    dumpImage.readMs = dumpImage.finished - dumpStarted;
+    dumpsDone++;
+}
+
+unsigned long BatteryPoller::ageMs() const {
+    return millis() - lastSample;
+}
+
+bool BatteryPoller::onSample(SampleListener listener) {
+    if (listenerCount >= maxListeners) return false;
+    listeners[listenerCount++] = listener;
+
+    return true;
 }
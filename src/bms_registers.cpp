@@ -0,0 +1,117 @@
+#include "bms_registers.h"
+#include "battery.h"
+
+// the monitored fields are checked against the packs, the others follow the
+// community register maps of the ES series and may differ by BMS firmware
+const RegisterInfo bmsRegisters[] PROGMEM = {
+    {"serial", BMS_REG_SERIAL, 7, REG_TEXT, 1, 0, ""},
+    {"firmware", BMS_REG_FIRMWARE, 1, REG_HEX, 1, 0, ""},
+    {"factory_capacity", BMS_REG_FACTORY_CAPACITY, 1, REG_UINT, 1, 0, "mAh"},
+    {"actual_capacity", BMS_REG_ACTUAL_CAPACITY, 1, REG_UINT, 1, 0, "mAh"},
+    {"charge_cycles", BMS_REG_CHARGE_CYCLES, 1, REG_UINT, 1, 0, ""},
+    {"charge_count", BMS_REG_CHARGE_COUNT, 1, REG_UINT, 1, 0, ""},
+    {"manufactured", BMS_REG_MANUFACTURED, 1, REG_HEX, 1, 0, ""}, // year - 2000 << 9 | month << 5 | day
+    {"status", BMS_REG_STATUS, 1, REG_HEX, 1, 0, ""},
+    {"remaining_capacity", BMS_REG_REMAINING_CAPACITY, 1, REG_UINT, 1, 0, "mAh"},
+    {"remaining_capacity_perc", BMS_REG_REMAINING_CAPACITY_PERC, 1, REG_UINT, 1, 0, "%"},
+    {"current", BMS_REG_CURRENT, 1, REG_INT, 10, 0, "mA"},
+    {"voltage", BMS_REG_VOLTAGE, 1, REG_UINT, 10, 0, "mV"},
+    {"temperature", BMS_REG_TEMPERATURE, 1, REG_BYTES, 1, -20, "C"},
+    {"health", BMS_REG_HEALTH, 1, REG_UINT, 1, 0, "%"},
+    {"cells_voltage", BMS_REG_CELLS, BATTERY_CELLS, REG_UINT, 1, 0, "mV"},
+};
+const uint8_t bmsRegisterCount = sizeof(bmsRegisters) / sizeof(bmsRegisters[0]);
+
+bool RegisterDump::has(uint8_t reg) const {
+    if (reg < registerDumpFirst || reg >= registerDumpFirst + registerDumpWords) return false;
+    return blocksRead & (1 << ((reg - registerDumpFirst) / registerDumpBlockWords));
+}
+
+RegistersSource::RegistersSource(const BatteryMonitor &_monitor, const BatteryPoller &_poller, uint32_t _wanted) {
+    monitor = &_monitor;
+    poller = &_poller;
+    wanted = _wanted;
+}
+
+bool RegistersSource::ready() const {
+    return int32_t(poller->dumps() - wanted) >= 0;
+}
+
+// value of one register entry as json, null unless every word of it was read
+static int formatRegister(char *buf, size_t size, const RegisterInfo &info, const RegisterDump &dump) {
+    for (uint8_t i = 0; i < info.words; i++) {
+        if (!dump.has(info.reg + i)) return snprintf_P(buf, size, PSTR("null"));
+    }
+
+    int len;
+    if (info.type == REG_TEXT) {
+        char text[2 * 16 + 1];
+        size_t n = 0;
+        for (uint8_t i = 0; i < info.words && n + 2 < sizeof(text); i++) {
+            uint16_t word = dump.word(info.reg + i);
+            for (char c : {char(word & 0xFF), char(word >> 8)}) {
+                if (c == '\0') continue;
+                text[n++] = c < 0x20 || c > 0x7e || c == '"' || c == '\\' ? '?' : c;
+            }
+        }
+        text[n] = '\0';
+        return snprintf_P(buf, size, PSTR("\"%s\""), text);
+    }
+    if (info.type == REG_HEX) return snprintf_P(buf, size, PSTR("\"0x%04x\""), dump.word(info.reg));
+
+    bool array = info.words > 1 || info.type == REG_BYTES;
+    len = array ? snprintf_P(buf, size, PSTR("[")) : 0;
+    for (uint8_t i = 0; i < info.words && len >= 0 && size_t(len) < size; i++) {
+        uint16_t word = dump.word(info.reg + i);
+        if (info.type == REG_BYTES) {
+            len += snprintf_P(buf + len, size - len, PSTR("%s%d,%d"), i == 0 ? "" : ",",
+                              (word & 0xFF) * info.scale + info.bias, (word >> 8) * info.scale + info.bias);
+        } else {
+            long raw = info.type == REG_INT ? long(int16_t(word)) : long(word);
+            len += snprintf_P(buf + len, size - len, PSTR("%s%ld"), i == 0 ? "" : ",", raw * info.scale + info.bias);
+        }
+    }
+    if (array && len >= 0 && size_t(len) < size) len += snprintf_P(buf + len, size - len, PSTR("]"));
+
+    return len;
+}
+
+size_t RegistersSource::nextRecord(char *line, size_t size) {
+    // head, one record per table entry, the raw words eight at a time, tail
+    static const uint8_t rawPerRecord = 8;
+    const RegisterDump &dump = poller->dump();
+    int len;
+    if (item == 0) {
+        len = snprintf_P(line, size,
+                         PSTR("{\"pack\":%d,\"address\":%u,\"first\":%u,\"read_ms\":%lu,\"age_ms\":%lu,\"blocks\":%u,"
+                              "\"blocks_read\":%u,\"registers\":["),
+                         poller->pack(), monitor->packAddress(poller->pack()), registerDumpFirst, dump.readMs,
+                         millis() - dump.finished, registerDumpBlocks, __builtin_popcount(dump.blocksRead));
+    } else if (item <= bmsRegisterCount) {
+        RegisterInfo info;
+        memcpy_P(&info, &bmsRegisters[item - 1], sizeof(info));
+        len = snprintf_P(line, size, PSTR("%s{\"name\":\"%s\",\"reg\":%u,\"value\":"), item == 1 ? "" : ",", info.name,
+                         info.reg);
+        if (len >= 0 && size_t(len) < size) len += formatRegister(line + len, size - len, info, dump);
+        if (len >= 0 && size_t(len) < size && info.unit[0] != '\0') {
+            len += snprintf_P(line + len, size - len, PSTR(",\"unit\":\"%s\""), info.unit);
+        }
+        if (len >= 0 && size_t(len) < size) len += snprintf_P(line + len, size - len, PSTR("}"));
+    } else if (word < registerDumpWords) {
+        len = word == 0 ? snprintf_P(line, size, PSTR("],\"raw\":[")) : 0;
+        for (uint8_t i = 0; i < rawPerRecord && word < registerDumpWords && len >= 0 && size_t(len) < size; i++, word++) {
+            const char *sep = word == 0 ? "" : ",";
+            uint8_t reg = registerDumpFirst + word;
+            if (dump.has(reg)) len += snprintf_P(line + len, size - len, PSTR("%s%u"), sep, dump.word(reg));
+            else len += snprintf_P(line + len, size - len, PSTR("%snull"), sep);
+        }
+        return len < 0 ? 0 : std::min(size_t(len), size - 1);
+    } else if (item == bmsRegisterCount + 1) {
+        len = snprintf_P(line, size, PSTR("]}"));
+    } else {
+        return 0;
+    }
+    item++;
+
+    return len < 0 ? 0 : std::min(size_t(len), size - 1);
+}
@@ -0,0 +1,133 @@
+#include "bus_capture.h"
+
+static size_t varintLen(uint32_t value) {
+    size_t len = 1;
+    while (value >= 0x80) {
+        value >>= 7;
+        len++;
+    }
+    return len;
+}
+
+BusCapture::BusCapture(uint8_t *_storage, size_t _size) {
+    storage = _storage;
+    size = _size;
+}
+
+void BusCapture::clear() {
+    head = 0;
+    fill = 0;
+    count = 0;
+    lastUs = micros();
+}
+
+void BusCapture::put(uint8_t value) {
+    storage[head] = value;
+    head = (head + 1) % size;
+    fill++;
+}
+
+size_t BusCapture::putVarint(uint32_t value) {
+    size_t len = 0;
+    while (value >= 0x80) {
+        put(uint8_t(value) | 0x80);
+        value >>= 7;
+        len++;
+    }
+    put(uint8_t(value));
+    return len + 1;
+}
+
+uint32_t BusCapture::varintAt(size_t &offset) const {
+    uint32_t value = 0;
+    for (uint8_t shift = 0; offset < fill && shift < 32; shift += 7) {
+        uint8_t b = at(offset++);
+        value |= uint32_t(b & 0x7F) << shift;
+        if (!(b & 0x80)) break;
+    }
+    return value;
+}
+
+void BusCapture::evictOldest() {
+    size_t offset = 0;
+    varintAt(offset);
+    offset += varintAt(offset) >> 1;
+    fill -= std::min(offset, fill);
+    count--;
+    dropped++;
+}
+
+void BusCapture::add(Direction dir, const uint8_t *data, size_t len) {
+    if (held > 0) {
+        skipped++;
+        return;
+    }
+    unsigned long now = micros();
+    uint32_t dt = uint32_t(now - lastUs);
+    uint32_t lenDir = uint32_t(len) << 1 | dir;
+    size_t need = varintLen(dt) + varintLen(lenDir) + len;
+    if (len == 0 || need > size) return;
+
+    while (size - fill < need) evictOldest();
+    putVarint(dt);
+    putVarint(lenDir);
+    for (size_t i = 0; i < len; i++) put(data[i]);
+    count++;
+    lastUs = now;
+}
+
+size_t BusCapture::copy(size_t offset, uint8_t *buf, size_t max) const {
+    size_t n = 0;
+    while (n < max && offset + n < fill) {
+        buf[n] = at(offset + n);
+        n++;
+    }
+    return n;
+}
+
+bool BusCapture::parse(const uint8_t *trace, size_t len, size_t &pos, Record &record) {
+    uint32_t values[2] = {0, 0};
+    for (uint32_t &value : values) {
+        for (uint8_t shift = 0;; shift += 7) {
+            if (pos >= len || shift >= 32) return false;
+            uint8_t b = trace[pos++];
+            value |= uint32_t(b & 0x7F) << shift;
+            if (!(b & 0x80)) break;
+        }
+    }
+    record.dtUs = values[0];
+    record.dir = Direction(values[1] & 1);
+    record.len = values[1] >> 1;
+    if (record.len > len - pos) return false;
+    record.data = trace + pos;
+    pos += record.len;
+
+    return true;
+}
+
+CaptureSource::CaptureSource(BusCapture &_capture) {
+    capture = &_capture;
+    capture->hold();
+
+    const uint8_t addresses[] = BATTERY_ADDRESSES;
+    size_t n = 0;
+    memcpy_P(header, PSTR("NBCP"), 4);
+    n += 4;
+    header[n++] = version;
+    header[n++] = BATTERY_PACKS;
+    for (uint8_t address : addresses) header[n++] = address;
+    for (int i = 0; i < 4; i++) header[n++] = uint8_t(uint32_t(SERIAL_BAUDRATE) >> (8 * i));
+}
+
+CaptureSource::~CaptureSource() {
+    capture->release();
+}
+
+size_t CaptureSource::read(char *buf, size_t max) {
+    size_t n = 0;
+    while (n < max && headerPos < sizeof(header)) buf[n++] = char(header[headerPos++]);
+    size_t copied = capture->copy(offset, reinterpret_cast<uint8_t *>(buf + n), max - n);
+    offset += copied;
+
+    return n + copied;
+}
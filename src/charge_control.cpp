@@ -0,0 +1,115 @@
+#include "charge_control.h"
+#include "config.h"
+
+static const char reasonNone[] PROGMEM = "no decision yet";
+static const char reasonBelowLimit[] PROGMEM = "below limit";
+static const char reasonPercLimit[] PROGMEM = "capacity limit";
+static const char reasonCellLimit[] PROGMEM = "cell voltage limit";
+static const char reasonHysteresis[] PROGMEM = "waiting for resume threshold";
+static const char reasonWatchdog[] PROGMEM = "no fresh sample, watchdog";
+
+// indexed by Reason
+static const char *const reasonTexts[] PROGMEM = {
+    reasonNone, reasonBelowLimit, reasonPercLimit, reasonCellLimit, reasonHysteresis, reasonWatchdog,
+};
+
+// the fields a decision needs, all from the same sample
+static const uint16_t controlFields = (1 << BatteryMonitor::FIELD_REMAINING_CAPACITY_PERC) |
+                                      (1 << BatteryMonitor::FIELD_CURRENT) |
+                                      (1 << BatteryMonitor::FIELD_CELLS_VOLTAGE);
+
+PGM_P ChargeController::reasonText(Reason reason) {
+    if (reason > REASON_WATCHDOG) return reasonNone;
+    return reinterpret_cast<PGM_P>(pgm_read_ptr(&reasonTexts[reason]));
+}
+
+ChargeController::ChargeController(BatteryPoller &_poller) {
+    poller = &_poller;
+}
+
+void ChargeController::begin(uint8_t _pin, bool _activeLow) {
+    pin = _pin;
+    activeLow = _activeLow;
+    active = true;
+    pinMode(pin, OUTPUT);
+    write(false);
+    lastDecision = millis();
+    poller->require(controlFields, CHARGE_CONTROL_MS);
+
+    #if defined(ESP32) || defined(ESP8266)
+    watchdog.once_ms(CHARGE_DEADLINE_MS, onWatchdog, this);
+    #endif
+}
+
+void ChargeController::add(const BatteryState &state) {
+    if (!active || (poller->lastFields() & controlFields) != controlFields) return;
+
+    int16_t maxCell = 0;
+    bool cellsValid = true;
+    for (int16_t mv : state.cells) {
+        if (mv <= 0) cellsValid = false;
+        if (mv > maxCell) maxCell = mv;
+    }
+
+    // charge current with the relay open since the last decision: welded contact or wrong wiring
+    if (decided && !closed && state.current_ma > CHARGE_FAULT_MA) faults++;
+
+    // the first decision after boot uses the stop limits only, so a pack between
+    // resume and stop charges right away instead of waiting to drain first
+    bool close;
+    Reason next;
+    if (!cellsValid || state.remaining_capacity_perc < 0) {
+        close = false;
+        next = REASON_NONE;
+    } else if (state.remaining_capacity_perc >= CHARGE_STOP_PERC) {
+        close = false;
+        next = REASON_PERC_LIMIT;
+    } else if (maxCell >= CHARGE_CELL_MAX_MV) {
+        close = false;
+        next = REASON_CELL_LIMIT;
+    } else if (closed || !decided ||
+               (state.remaining_capacity_perc <= CHARGE_RESUME_PERC && maxCell <= CHARGE_CELL_RESUME_MV)) {
+        close = true;
+        next = REASON_BELOW_LIMIT;
+    } else {
+        close = false;
+        next = why == REASON_WATCHDOG || why == REASON_NONE ? REASON_HYSTERESIS : why;
+    }
+
+    write(close);
+    why = next;
+    decideTime.observe(micros() - poller->sampleStartedUs());
+
+    unsigned long now = millis();
+    unsigned long gap = now - lastDecision;
+    if (gap > worstGap) worstGap = gap;
+    if (gap > CHARGE_DEADLINE_MS) missed++;
+    lastDecision = now;
+    decided = true;
+
+    #if defined(ESP32) || defined(ESP8266)
+    watchdog.once_ms(CHARGE_DEADLINE_MS, onWatchdog, this);
+    #endif
+}
+
+void ChargeController::update() {
+    #if !defined(ESP32) && !defined(ESP8266)
+    if (active && millis() - lastDecision > CHARGE_DEADLINE_MS) trip();
+    #endif
+}
+
+void ChargeController::write(bool close) {
+    closed = close;
+    digitalWrite(pin, close != activeLow ? HIGH : LOW);
+}
+
+void ChargeController::trip() {
+    if (why == REASON_WATCHDOG) return;
+    write(false);
+    why = REASON_WATCHDOG;
+    trips++;
+}
+
+void ChargeController::onWatchdog(ChargeController *self) {
+    self->trip();
+}
@@ -0,0 +1,292 @@
+#include "dashboard.h"
+#include "state_json.h"
+
+namespace {
+
+enum Slot : uint8_t {
+    SLOT_NONE = 0, // literal text
+    SLOT_PERC,
+    SLOT_COLOR,
+    SLOT_STATUS,
+    SLOT_REM,
+    SLOT_ACT,
+    SLOT_SOH,
+    SLOT_AGE,
+    SLOT_VOLT,
+    SLOT_CURR,
+    SLOT_POW,
+    SLOT_SER,
+    SLOT_UP,
+    SLOT_T0,
+    SLOT_T1,
+    SLOT_C0, SLOT_C1, SLOT_C2, SLOT_C3, SLOT_C4,
+    SLOT_C5, SLOT_C6, SLOT_C7, SLOT_C8, SLOT_C9,
+    SLOT_SHOW_ERR,
+    SLOT_ERR_MSG,
+    SLOT_COUNT,
+};
+
+// indexed by Slot, only used while tokenizing at compile time
+constexpr const char *slotNames[SLOT_COUNT] = {
+    "", "PERC", "COLOR", "STATUS", "REM", "ACT", "SOH", "AGE", "VOLT", "CURR", "POW", "SER", "UP", "T0", "T1",
+    "C0", "C1", "C2", "C3", "C4", "C5", "C6", "C7", "C8", "C9", "SHOW_ERR", "ERR_MSG",
+};
+
+constexpr char pageTemplate[] PROGMEM = R"rawliteral(<!DOCTYPE html>
+<html>
+<head>
+  <meta charset="UTF-8">
+  <meta name="viewport" content="width=device-width, initial-scale=1">
+  <title>BMS Monitor</title>
+  <style>
+    :root { --bg:#121212; --card:#1e1e1e; --text:#ddd; --accent:#3498db; --border:#333; }
+    body { font-family:sans-serif; background:var(--bg); color:var(--text); margin:0; padding:10px; }
+    h2 { color:var(--accent); text-align:center; margin:10px 0; }
+    .grid { display:grid; grid-template-columns:repeat(auto-fit, minmax(300px, 1fr)); gap:10px; }
+    .card { background:var(--card); border:1px solid var(--border); border-radius:8px; padding:15px; }
+    .head { border-bottom:1px solid var(--border); padding-bottom:5px; margin-bottom:10px; color:#888; text-transform:uppercase; font-size:0.85rem; letter-spacing:1px; }
+    .row { display:flex; justify-content:space-between; margin-bottom:8px; font-size:0.9rem; }
+    .val { font-family:monospace; font-weight:bold; font-size:1.1rem; }
+    .bar-bg { background:#333; height:24px; border-radius:12px; overflow:hidden; margin:15px 0; position:relative; }
+    .bar-fill { height:100%; text-align:center; line-height:24px; color:#000; font-weight:bold; font-size:0.8rem; transition:width 0.3s; }
+    .cells { display:grid; grid-template-columns:repeat(5, 1fr); gap:5px; text-align:center; }
+    .c-box { background:#252525; padding:4px; border-radius:4px; font-size:0.9rem; }
+    .c-lbl { display:block; font-size:0.6rem; color:#666; }
+    .err { background:#e74c3c33; color:#e74c3c; padding:10px; border-radius:5px; text-align:center; display:{{SHOW_ERR}}; margin-top:10px; border:1px solid #e74c3c; }
+    .btn { display:block; width:100%; padding:12px; background:var(--accent); color:#fff; border:none; border-radius:5px; margin-top:15px; cursor:pointer; font-size:1rem; }
+  </style>
+</head>
+<body>
+  <h2>Battery Monitor</h2>
+  <div class="card">
+    <div class="head">Overview</div>
+    <div class="bar-bg">
+      <div class="bar-fill" style="width:{{PERC}}%; background:{{COLOR}};">{{PERC}}%</div>
+    </div>
+    <div class="row"><span>Status</span><span class="val">{{STATUS}}</span></div>
+    <div class="row"><span>Capacity</span><span class="val">{{REM}} / {{ACT}} mAh</span></div>
+    <div class="row"><span>Health (SOH)</span><span class="val">{{SOH}}%</span></div>
+    <div class="row"><span>Last update</span><span class="val">{{AGE}}</span></div>
+  </div>
+  <br>
+  <div class="grid">
+    <div class="card">
+      <div class="head">Power Metrics</div>
+      <div class="row"><span>Voltage</span><span class="val">{{VOLT}} V</span></div>
+      <div class="row"><span>Current</span><span class="val">{{CURR}} A</span></div>
+      <div class="row"><span>Power</span><span class="val">{{POW}} W</span></div>
+    </div>
+    <div class="card">
+      <div class="head">System & Temp</div>
+      <div class="row"><span>Serial</span><span class="val">{{SER}}</span></div>
+      <div class="row"><span>Uptime</span><span class="val">{{UP}}</span></div>
+      <div class="row"><span>Temp Z0</span><span class="val">{{T0}} &deg;C</span></div>
+      <div class="row"><span>Temp Z1</span><span class="val">{{T1}} &deg;C</span></div>
+    </div>
+  </div>
+  <br>
+  <div class="card">
+    <div class="head">Cell Voltages (mV)</div>
+    <div class="cells">
+      <div class="c-box"><span class="c-lbl">1</span>{{C0}}</div>
+      <div class="c-box"><span class="c-lbl">2</span>{{C1}}</div>
+      <div class="c-box"><span class="c-lbl">3</span>{{C2}}</div>
+      <div class="c-box"><span class="c-lbl">4</span>{{C3}}</div>
+      <div class="c-box"><span class="c-lbl">5</span>{{C4}}</div>
+      <div class="c-box"><span class="c-lbl">6</span>{{C5}}</div>
+      <div class="c-box"><span class="c-lbl">7</span>{{C6}}</div>
+      <div class="c-box"><span class="c-lbl">8</span>{{C7}}</div>
+      <div class="c-box"><span class="c-lbl">9</span>{{C8}}</div>
+      <div class="c-box"><span class="c-lbl">10</span>{{C9}}</div>
+    </div>
+  </div>
+  <div class="err">⚠️ {{ERR_MSG}}</div>
+  <button class="btn" onclick="location.reload()">Refresh Data</button>
+</body>
+</html>)rawliteral";
+
+struct Token {
+    uint16_t offset;
+    uint16_t len;
+    uint8_t slot;
+};
+
+template <size_t N>
+struct TokenTable {
+    Token tokens[N];
+};
+
+constexpr size_t placeholderEnd(const char *s, size_t pos) {
+    while (s[pos] != '\0' && !(s[pos] == '}' && s[pos + 1] == '}')) pos++;
+    return pos;
+}
+
+constexpr uint8_t slotId(const char *s, size_t pos, size_t len) {
+    for (uint8_t id = 1; id < SLOT_COUNT; id++) {
+        const char *name = slotNames[id];
+        size_t i = 0;
+        while (i < len && name[i] != '\0' && name[i] == s[pos + i]) i++;
+        if (i == len && name[i] == '\0') return id;
+    }
+    return SLOT_NONE;
+}
+
+// walks the template the same way tokenize() does, visit(offset, len, slot) per token
+template <typename Visit>
+constexpr void scanTemplate(const char *s, Visit visit) {
+    size_t literal = 0;
+    size_t pos = 0;
+    while (s[pos] != '\0') {
+        if (s[pos] == '{' && s[pos + 1] == '{') {
+            if (pos > literal) visit(literal, pos - literal, SLOT_NONE);
+            size_t end = placeholderEnd(s, pos + 2);
+            visit(pos + 2, end - pos - 2, slotId(s, pos + 2, end - pos - 2));
+            pos = end + 2;
+            literal = pos;
+            continue;
+        }
+        pos++;
+    }
+    if (pos > literal) visit(literal, pos - literal, SLOT_NONE);
+}
+
+constexpr size_t countTokens(const char *s) {
+    size_t count = 0;
+    scanTemplate(s, [&count](size_t, size_t, uint8_t) { count++; });
+    return count;
+}
+
+constexpr bool placeholdersKnown(const char *s) {
+    bool known = true;
+    size_t pos = 0;
+    while (s[pos] != '\0') {
+        if (s[pos] == '{' && s[pos + 1] == '{') {
+            size_t end = placeholderEnd(s, pos + 2);
+            if (slotId(s, pos + 2, end - pos - 2) == SLOT_NONE) known = false;
+            pos = end;
+        }
+        pos++;
+    }
+    return known;
+}
+
+template <size_t N>
+constexpr TokenTable<N> tokenize(const char *s) {
+    TokenTable<N> table{};
+    size_t i = 0;
+    scanTemplate(s, [&table, &i](size_t offset, size_t len, uint8_t slot) {
+        table.tokens[i++] = {uint16_t(offset), uint16_t(len), slot};
+    });
+    return table;
+}
+
+static_assert(placeholdersKnown(pageTemplate), "unknown {{placeholder}} in dashboard template");
+
+constexpr size_t tokenCount = countTokens(pageTemplate);
+constexpr TokenTable<tokenCount> pageTokens PROGMEM = tokenize<tokenCount>(pageTemplate);
+
+size_t formatTime(char *buf, size_t size, long seconds) {
+    long h = seconds / 3600;
+    long m = (seconds % 3600) / 60;
+    long s = seconds % 60;
+    return snprintf(buf, size, "%02ld:%02ld:%02ld", h, m, s);
+}
+
+const char *getHealthColor(int perc) {
+    if (perc > 50) return "#2ecc71"; // Green
+    if (perc > 20) return "#f1c40f"; // Yellow
+    return "#e74c3c"; // Red
+}
+
+bool hasError(const BatteryState &state) {
+    return state.error != BATTERY_OK;
+}
+
+}
+
+
+PGM_P dashboardTemplate() {
+    return pageTemplate;
+}
+
+DashboardRenderer::DashboardRenderer(const BatteryState &_state, long _age) {
+    state = &_state;
+    age = _age;
+}
+
+void DashboardRenderer::formatSlot(uint8_t slot) {
+    const BatteryState &s = *state;
+    int len = 0;
+    switch (slot) {
+        case SLOT_PERC: len = snprintf(value, sizeof(value), "%d", s.remaining_capacity_perc); break;
+        case SLOT_COLOR: len = snprintf(value, sizeof(value), "%s", getHealthColor(s.remaining_capacity_perc)); break;
+        case SLOT_STATUS:
+            len = snprintf(value, sizeof(value), "%s", (s.status == 1) ? "Charging" : (s.status == 0 ? "Discharging" : "Idle"));
+            break;
+        case SLOT_REM: len = snprintf(value, sizeof(value), "%d", s.remaining_capacity); break;
+        case SLOT_ACT: len = snprintf(value, sizeof(value), "%d", s.actual_capacity); break;
+        case SLOT_SOH:
+            len = snprintf(value, sizeof(value), "%d", (s.factory_capacity > 0) ? (s.actual_capacity * 100 / s.factory_capacity) : 0);
+            break;
+        case SLOT_AGE:
+            if (age < 0) {
+                len = snprintf(value, sizeof(value), "never");
+            } else {
+                len = formatTime(value, sizeof(value), age);
+                len += snprintf(value + len, sizeof(value) - len, " ago");
+            }
+            break;
+        case SLOT_VOLT: len = formatFixed(value, sizeof(value), s.voltage_mv, 2); break;
+        case SLOT_CURR: len = formatFixed(value, sizeof(value), s.current_ma, 2); break;
+        case SLOT_POW: len = formatFixed(value, sizeof(value), s.power_mw, 2); break;
+        case SLOT_SER: len = snprintf(value, sizeof(value), "%s", s.serial); break;
+        case SLOT_UP: len = formatTime(value, sizeof(value), s.uptime); break;
+        case SLOT_T0: len = snprintf(value, sizeof(value), "%d", s.temp_zone0); break;
+        case SLOT_T1: len = snprintf(value, sizeof(value), "%d", s.temp_zone1); break;
+        case SLOT_C0: case SLOT_C1: case SLOT_C2: case SLOT_C3: case SLOT_C4:
+        case SLOT_C5: case SLOT_C6: case SLOT_C7: case SLOT_C8: case SLOT_C9:
+            // the page has room for 10 cells, smaller packs leave the rest empty
+            if (size_t(slot - SLOT_C0) < s.cells.size()) len = snprintf(value, sizeof(value), "%d", s.cells[slot - SLOT_C0]);
+            else len = snprintf(value, sizeof(value), "-");
+            break;
+        case SLOT_SHOW_ERR: len = snprintf(value, sizeof(value), "%s", hasError(s) ? "block" : "none"); break;
+        case SLOT_ERR_MSG:
+            strncpy_P(value, batteryErrorText(s.error), sizeof(value) - 1);
+            value[sizeof(value) - 1] = '\0';
+            len = strlen(value);
+            break;
+        default: break;
+    }
+    // snprintf reports the untruncated length
+    valueLen = (len < 0) ? 0 : std::min(size_t(len), sizeof(value) - 1);
+    valueReady = true;
+}
+
+size_t DashboardRenderer::read(char *buf, size_t max) {
+    size_t written = 0;
+    while (written < max && token < tokenCount) {
+        Token t;
+        memcpy_P(&t, &pageTokens.tokens[token], sizeof(t));
+
+        size_t n;
+        if (t.slot == SLOT_NONE) {
+            n = std::min(size_t(t.len) - offset, max - written);
+            memcpy_P(buf + written, pageTemplate + t.offset + offset, n);
+            offset += n;
+            written += n;
+            if (offset < t.len) break;
+        } else {
+            if (!valueReady) formatSlot(t.slot);
+            n = std::min(valueLen - offset, max - written);
+            memcpy(buf + written, value + offset, n);
+            offset += n;
+            written += n;
+            if (offset < valueLen) break;
+            valueReady = false;
+        }
+        token++;
+        offset = 0;
+    }
+
+    return written;
+}
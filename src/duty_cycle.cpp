@@ -0,0 +1,164 @@
+#include <stddef.h>
+#include "duty_cycle.h"
+#include "config.h"
+#include "flash_log.h"
+#include "mqtt_publisher.h"
+
+static const uint32_t rtcMagic = 0x44435931; // "DCY1", bump when RtcBlock changes
+
+void DutyCycle::begin(uint32_t _cycleS, bool _deep, bool _radio) {
+    cycleS = _cycleS;
+    isDeep = _deep;
+    radio = _radio;
+    if (!isDeep) {
+        radioNow = true;
+        return;
+    }
+
+    // power on or a block from another firmware: start over, first wake publishes
+    if (!loadRtc() || rtc.magic != rtcMagic || rtc.crc != rtcCrc()) {
+        rtc = RtcBlock{};
+        rtc.magic = rtcMagic;
+        rtc.radioNext = 1;
+    }
+    restored = rtc.hasState;
+    radioNow = radio && rtc.radioNext;
+}
+
+bool DutyCycle::burstExpired() const {
+    return millis() >= (radioNow ? DUTY_RADIO_BURST_MS : DUTY_BURST_MS);
+}
+
+void DutyCycle::sleep(const BatteryState &state, bool sampled, bool published) {
+    // the rom boot before millis() starts is not counted
+    uint32_t awake = millis();
+    Report &r = rtc.report;
+    r.cycles++;
+    r.awakeMs += awake;
+    r.lastAwakeMs = awake;
+    if (awake > r.maxAwakeMs) r.maxAwakeMs = awake;
+    if (radioNow) {
+        r.radioCycles++;
+        r.radioAwakeMs += awake;
+    }
+    if (!sampled || (radioNow && !published)) r.timeouts++;
+
+    if (sampled) {
+        rtc.state = state;
+        rtc.hasState = 1;
+    }
+    bool publishNow = false;
+    if (radioNow && published) {
+        rtc.published = rtc.state;
+        rtc.sincePublish = 0;
+        rtc.radioNext = 0;
+    } else {
+        if (rtc.sincePublish < UINT16_MAX) rtc.sincePublish++;
+        bool moved = sampled && MqttPublisher::differs(rtc.published, rtc.state);
+        rtc.radioNext = radio && (moved || rtc.sincePublish >= DUTY_PUBLISH_EVERY);
+        // a change found with the radio off goes out on an immediate wake, not a period later
+        publishNow = rtc.radioNext && !radioNow && moved;
+    }
+
+    uint32_t periodMs = cycleS * 1000;
+    uint32_t sleepMs = publishNow || awake >= periodMs ? 1 : periodMs - awake;
+    r.sleptMs += sleepMs;
+    rtc.crc = rtcCrc();
+    storeRtc();
+
+    #ifdef DEBUG
+    char text[320];
+    formatReport(text, sizeof(text));
+    Serial.println(text);
+    Serial.flush();
+    #endif
+    powerDown(sleepMs, rtc.radioNext);
+}
+
+void DutyCycle::idle(unsigned long passUs) {
+    Report &r = rtc.report;
+    busyUs += passUs;
+    uint32_t busyMs = busyUs / 1000;
+    busyUs %= 1000;
+    r.cycles++;
+    r.radioCycles++;
+    r.awakeMs += busyMs;
+    r.radioAwakeMs += busyMs;
+    r.lastAwakeMs = busyMs;
+    if (busyMs > r.maxAwakeMs) r.maxAwakeMs = busyMs;
+
+    // with wifi in light sleep mode the modem dozes for as long as this waits
+    unsigned long started = millis();
+    delay(DUTY_IDLE_MS);
+    r.sleptMs += millis() - started;
+}
+
+uint32_t DutyCycle::averageUa() const {
+    const Report &r = rtc.report;
+    uint64_t total = r.awakeMs + r.sleptMs;
+    if (total == 0) return 0;
+
+    // uA * ms
+    uint64_t charge = (r.awakeMs - r.radioAwakeMs) * DUTY_AWAKE_MA * 1000ULL +
+                      r.radioAwakeMs * DUTY_RADIO_MA * 1000ULL +
+                      r.sleptMs * uint64_t(isDeep ? DUTY_DEEP_SLEEP_UA : DUTY_LIGHT_SLEEP_UA);
+
+    return uint32_t(charge / total);
+}
+
+size_t DutyCycle::formatReport(char *buf, size_t size) const {
+    const Report &r = rtc.report;
+    uint64_t total = r.awakeMs + r.sleptMs;
+    int len = snprintf_P(buf, size,
+                         PSTR("{\"enabled\":%s,\"mode\":\"%s\",\"period_s\":%lu,\"cycles\":%lu,\"radio_cycles\":%lu,"
+                              "\"timeouts\":%lu,\"awake_ms_last\":%lu,\"awake_ms_max\":%lu,\"awake_ms_avg\":%lu,"
+                              "\"awake_s\":%lu,\"slept_s\":%lu,\"awake_ppm\":%lu,\"avg_ua\":%lu,\"always_on_ua\":%lu}"),
+                         enabled() ? "true" : "false", isDeep ? "deep" : "light", (unsigned long)cycleS,
+                         (unsigned long)r.cycles, (unsigned long)r.radioCycles, (unsigned long)r.timeouts,
+                         (unsigned long)r.lastAwakeMs, (unsigned long)r.maxAwakeMs,
+                         (unsigned long)(r.cycles ? r.awakeMs / r.cycles : 0), (unsigned long)(r.awakeMs / 1000),
+                         (unsigned long)(r.sleptMs / 1000), (unsigned long)(total ? r.awakeMs * 1000000 / total : 0),
+                         (unsigned long)averageUa(), (unsigned long)(DUTY_RADIO_MA * 1000UL));
+    if (len < 0) return 0;
+
+    return size_t(len) < size ? size_t(len) : size - 1;
+}
+
+uint16_t DutyCycle::rtcCrc() const {
+    return FlashLog::crc16(reinterpret_cast<const uint8_t *>(&rtc), offsetof(RtcBlock, crc));
+}
+
+#ifndef NATIVE
+#if defined(ESP32)
+#include <esp_sleep.h>
+RTC_DATA_ATTR static uint8_t rtcMemory[512];
+#endif
+
+bool DutyCycle::loadRtc() {
+    #if defined(ESP8266)
+    return ESP.rtcUserMemoryRead(0, reinterpret_cast<uint32_t *>(&rtc), sizeof(rtc));
+    #else
+    memcpy(&rtc, rtcMemory, sizeof(rtc));
+    return true;
+    #endif
+}
+
+void DutyCycle::storeRtc() {
+    #if defined(ESP8266)
+    ESP.rtcUserMemoryWrite(0, reinterpret_cast<uint32_t *>(&rtc), sizeof(rtc));
+    #else
+    memcpy(rtcMemory, &rtc, sizeof(rtc));
+    #endif
+}
+
+void DutyCycle::powerDown(uint32_t ms, bool radioOnWake) {
+    // needs GPIO16 wired to RST to wake up again
+    #if defined(ESP8266)
+    ESP.deepSleep(uint64_t(ms) * 1000, radioOnWake ? WAKE_RF_DEFAULT : WAKE_RF_DISABLED);
+    #else
+    (void)radioOnWake; // the radio stays off until WiFi.begin() anyway
+    esp_deep_sleep(uint64_t(ms) * 1000);
+    #endif
+    for (;;) yield();
+}
+#endif
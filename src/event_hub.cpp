@@ -0,0 +1,106 @@
+#include "event_hub.h"
+#include "state_json.h"
+
+bool EventHub::subscribe(EventClient client) {
+    for (Subscriber &sub : subscribers) {
+        if (sub.active) continue;
+
+        static const char head[] =
+            "HTTP/1.1 200 OK\r\nContent-Type: text/event-stream\r\nCache-Control: no-cache\r\n"
+            "Connection: keep-alive\r\n\r\nretry: 3000\n\n";
+        client.setNoDelay(true);
+        client.write(reinterpret_cast<const uint8_t *>(head), sizeof(head) - 1);
+
+        sub.client = client;
+        sub.active = true;
+        sub.frame = -1;
+        sub.offset = 0;
+        sub.version = 0;
+        sub.lastWrite = millis();
+        return true;
+    }
+    return false;
+}
+
+uint8_t EventHub::clientCount() const {
+    uint8_t count = 0;
+    for (const Subscriber &sub : subscribers) {
+        if (sub.active) count++;
+    }
+    return count;
+}
+
+void EventHub::update(const BatteryState &state, uint32_t version, bool sampled) {
+    if (version != frames[latest].version && clientCount() > 0) encode(state, version, sampled);
+
+    unsigned long now = millis();
+    for (Subscriber &sub : subscribers) {
+        if (!sub.active) continue;
+        if (!sub.client.connected()) {
+            release(sub);
+            continue;
+        }
+        feed(sub, now);
+    }
+}
+
+void EventHub::encode(const BatteryState &state, uint32_t version, bool sampled) {
+    // the other frame is overwritten, whoever is still writing it is a whole frame behind
+    uint8_t next = latest ^ 1;
+    for (Subscriber &sub : subscribers) {
+        if (sub.active && sub.frame == next) {
+            release(sub);
+            dropped++;
+        }
+    }
+
+    Frame &frame = frames[next];
+    int head = snprintf(frame.text, sizeof(frame.text), "id: %u\ndata: ", unsigned(version));
+    size_t json = writeStateJson(frame.text + head, sizeof(frame.text) - head - 2, state, sampled);
+    if (json == 0) return;
+    frame.len = head + json;
+    frame.text[frame.len++] = '\n';
+    frame.text[frame.len++] = '\n';
+    frame.version = version;
+    latest = next;
+    encoded++;
+}
+
+void EventHub::feed(Subscriber &sub, unsigned long now) {
+    const Frame &newest = frames[latest];
+    if (sub.frame < 0) {
+        if (newest.len > 0 && newest.version != sub.version) {
+            if (sub.version != 0 && newest.version - sub.version > 1) skipped += newest.version - sub.version - 1;
+            sub.frame = latest;
+            sub.offset = 0;
+        } else if (now - sub.lastWrite >= SSE_KEEPALIVE_MS && sub.client.availableForWrite() >= 3) {
+            sub.client.write(reinterpret_cast<const uint8_t *>(":\n\n"), 3);
+            sub.lastWrite = now;
+            return;
+        } else {
+            return;
+        }
+    }
+
+    const Frame &frame = frames[sub.frame];
+    size_t len = frame.len - sub.offset;
+    size_t room = sub.client.availableForWrite();
+    if (room < len) len = room;
+    if (len == 0) return;
+
+    size_t written = sub.client.write(reinterpret_cast<const uint8_t *>(frame.text + sub.offset), len);
+    sub.offset += written;
+    if (written > 0) sub.lastWrite = now;
+    if (sub.offset >= frame.len) {
+        sub.version = frame.version;
+        sub.frame = -1;
+        sent++;
+    }
+}
+
+void EventHub::release(Subscriber &sub) {
+    sub.client.stop();
+    sub.client = EventClient();
+    sub.active = false;
+    sub.frame = -1;
+}
@@ -0,0 +1,103 @@
+#include <stddef.h>
+#include "fast_boot.h"
+#include "config.h"
+#include "flash_log.h"
+
+static const uint32_t rtcMagic = 0x46425431; // "FBT1", bump when RtcBlock changes
+
+void FastBoot::begin() {
+    // power on or a block from another firmware: cold start
+    if (!loadRtc() || rtc.magic != rtcMagic || rtc.crc != rtcCrc()) {
+        rtc = RtcBlock{};
+        rtc.magic = rtcMagic;
+    } else {
+        warm = true;
+        rtc.boots++;
+    }
+    rtc.crc = rtcCrc();
+    storeRtc();
+}
+
+bool FastBoot::restore(int pack, BatteryState &state) const {
+    if (pack >= cachedPacks || !(rtc.hasState & (1 << pack))) return false;
+    state = rtc.states[pack];
+    state.error = BATTERY_ERR_RESTORED;
+
+    return true;
+}
+
+void FastBoot::store(int pack, const BatteryState &state) {
+    if (pack >= cachedPacks) return;
+    rtc.states[pack] = state;
+    rtc.hasState |= 1 << pack;
+    rtc.crc = rtcCrc();
+    storeRtc();
+}
+
+void FastBoot::storeWifi(const WifiCache &cache) {
+    rtc.wifi = cache;
+    rtc.wifi.valid = 1;
+    rtc.crc = rtcCrc();
+    storeRtc();
+}
+
+void FastBoot::forgetWifi() {
+    rtc.wifi.valid = 0;
+    rtc.crc = rtcCrc();
+    storeRtc();
+}
+
+void FastBoot::wifiUp(WifiStart how) {
+    if (wifiStart != BOOT_WIFI_CONNECTING) return;
+    wifiMs = millis();
+    wifiStart = how;
+}
+
+void FastBoot::sampled() {
+    if (sampleMs == 0) sampleMs = millis();
+}
+
+size_t FastBoot::formatReport(char *buf, size_t size) const {
+    static const char wifiNames[][16] PROGMEM = {"connecting", "cached", "scanned", "access point", "none"};
+    // -1 for what has not happened yet
+    int len = snprintf_P(buf, size,
+                         PSTR("{\"warm\":%s,\"boots\":%u,\"restored_packs\":%u,\"wifi\":\"%s\",\"wifi_ms\":%ld,"
+                              "\"first_sample_ms\":%ld}"),
+                         warm ? "true" : "false", rtc.boots, __builtin_popcount(warm ? rtc.hasState : 0),
+                         wifiNames[wifiStart], wifiStart == BOOT_WIFI_CONNECTING ? -1L : long(wifiMs),
+                         sampleMs == 0 ? -1L : long(sampleMs));
+    if (len < 0) return 0;
+
+    return size_t(len) < size ? size_t(len) : size - 1;
+}
+
+uint16_t FastBoot::rtcCrc() const {
+    return FlashLog::crc16(reinterpret_cast<const uint8_t *>(&rtc), offsetof(RtcBlock, crc));
+}
+
+#ifndef NATIVE
+#if defined(ESP32)
+#include <esp_attr.h>
+RTC_DATA_ATTR static uint8_t rtcMemory[256];
+#endif
+
+// in 4 byte blocks, the lower half of rtc user memory is DutyCycle's
+static const uint32_t rtcOffset = 64;
+
+bool FastBoot::loadRtc() {
+    #if defined(ESP8266)
+    return ESP.rtcUserMemoryRead(rtcOffset, reinterpret_cast<uint32_t *>(&rtc), sizeof(rtc));
+    #else
+    memcpy(&rtc, rtcMemory, sizeof(rtc));
+    return true;
+    #endif
+}
+
+void FastBoot::storeRtc() {
+    #if defined(ESP8266)
+    ESP.rtcUserMemoryWrite(rtcOffset, reinterpret_cast<uint32_t *>(&rtc), sizeof(rtc));
+    #else
+    memcpy(rtcMemory, &rtc, sizeof(rtc));
+    #endif
+}
+#endif
@@ -0,0 +1,305 @@
+#include "flash_log.h"
+
+namespace {
+
+struct SegmentHeader {
+    uint32_t magic;
+    uint8_t version;
+    uint8_t recordSize;
+    uint16_t reserved;
+    uint32_t seq;
+    uint32_t start;
+};
+static_assert(sizeof(SegmentHeader) == 16, "SegmentHeader is part of the on-flash format");
+
+int16_t clampToInt16(int32_t value) {
+    if (value > 32767) return 32767;
+    if (value < -32768) return -32768;
+    return int16_t(value);
+}
+
+}
+
+
+String FlashLog::segmentPath(uint32_t seq) {
+    char path[20];
+    snprintf(path, sizeof(path), "/log/%08lx", (unsigned long) seq);
+    return String(path);
+}
+
+uint16_t FlashLog::crc16(const uint8_t *data, size_t len) {
+    uint16_t crc = 0xFFFF;
+    for (size_t i = 0; i < len; i++) {
+        crc ^= uint16_t(data[i]) << 8;
+        for (int bit = 0; bit < 8; bit++) {
+            crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+        }
+    }
+    return crc;
+}
+
+bool FlashLog::validRecord(const LogRecord &record) {
+    return record.crc == crc16(reinterpret_cast<const uint8_t *>(&record), offsetof(LogRecord, crc));
+}
+
+bool FlashLog::begin() {
+    if (!LittleFS.begin()) return false;
+    mounted = true;
+    LittleFS.mkdir("/log");
+
+    // keep the newest FLASH_LOG_SEGMENTS, oldest first. Older ones are left
+    // over from a larger config and removed once the directory was read.
+    uint32_t seqs[FLASH_LOG_SEGMENTS];
+    uint32_t stale[FLASH_LOG_SEGMENTS];
+    int found = 0;
+    int staleCount = 0;
+    Dir dir = LittleFS.openDir("/log");
+    while (dir.next()) {
+        char *end;
+        String name = dir.fileName();
+        uint32_t seq = strtoul(name.c_str(), &end, 16);
+        if (*end != '\0') continue;
+
+        if (found == FLASH_LOG_SEGMENTS) {
+            uint32_t dropped = seq;
+            if (seq > seqs[0]) {
+                dropped = seqs[0];
+                memmove(&seqs[0], &seqs[1], (found - 1) * sizeof(seqs[0]));
+                found--;
+            }
+            if (staleCount < FLASH_LOG_SEGMENTS) stale[staleCount++] = dropped;
+            if (dropped == seq) continue;
+        }
+        int pos = found++;
+        while (pos > 0 && seqs[pos - 1] > seq) {
+            seqs[pos] = seqs[pos - 1];
+            pos--;
+        }
+        seqs[pos] = seq;
+    }
+    for (int i = 0; i < staleCount; i++) {
+        LittleFS.remove(segmentPath(stale[i]));
+    }
+
+    segmentCount = 0;
+    for (int i = 0; i < found; i++) {
+        Segment segment;
+        if (!loadSegment(seqs[i], segment)) {
+            LittleFS.remove(segmentPath(seqs[i]));
+            continue;
+        }
+        segments[segmentCount++] = segment;
+    }
+
+    // continue the clock and the boot counter of the newest record
+    for (int i = segmentCount - 1; i >= 0; i--) {
+        if (segments[i].count == 0) continue;
+        File file = LittleFS.open(segmentPath(segments[i].seq), "r");
+        LogRecord last;
+        file.seek(headerSize + (segments[i].count - 1) * sizeof(LogRecord));
+        if (file.read(reinterpret_cast<uint8_t *>(&last), sizeof(last)) == sizeof(last)) {
+            base = last.time + 1;
+            boot = last.boot + 1;
+        }
+        break;
+    }
+
+    return true;
+}
+
+bool FlashLog::loadSegment(uint32_t seq, Segment &segment) {
+    File file = LittleFS.open(segmentPath(seq), "r+");
+    if (!file) return false;
+
+    SegmentHeader header;
+    size_t size = file.size();
+    if (size < headerSize || file.read(reinterpret_cast<uint8_t *>(&header), sizeof(header)) != sizeof(header)) return false;
+    if (header.magic != magic || header.version != version || header.recordSize != sizeof(LogRecord)) return false;
+
+    // a reset during a write leaves a partial or corrupt record at the end
+    uint32_t count = (size - headerSize) / sizeof(LogRecord);
+    LogRecord last{};
+    while (count > 0) {
+        file.seek(headerSize + (count - 1) * sizeof(LogRecord));
+        if (file.read(reinterpret_cast<uint8_t *>(&last), sizeof(last)) == sizeof(last) && validRecord(last)) break;
+        count--;
+    }
+    size_t valid = headerSize + count * sizeof(LogRecord);
+    if (valid != size) file.truncate(valid);
+
+    segment.seq = seq;
+    segment.start = header.start;
+    segment.end = count > 0 ? last.time : header.start;
+    segment.count = count;
+
+    return true;
+}
+
+bool FlashLog::startSegment(uint32_t start) {
+    if (segmentCount == FLASH_LOG_SEGMENTS) {
+        LittleFS.remove(segmentPath(segments[0].seq));
+        memmove(&segments[0], &segments[1], (segmentCount - 1) * sizeof(Segment));
+        segmentCount--;
+    }
+
+    uint32_t seq = segmentCount > 0 ? segments[segmentCount - 1].seq + 1 : 0;
+    SegmentHeader header = {magic, version, uint8_t(sizeof(LogRecord)), 0, seq, start};
+    File file = LittleFS.open(segmentPath(seq), "w");
+    if (!file || file.write(reinterpret_cast<const uint8_t *>(&header), sizeof(header)) != sizeof(header)) return false;
+    file.close();
+
+    segments[segmentCount++] = {seq, start, start, 0};
+
+    return true;
+}
+
+void FlashLog::add(const BatteryState &state) {
+    if (!mounted) return;
+    uint32_t t = now();
+    if (stored && t - lastStored < FLASH_LOG_INTERVAL_S) return;
+    stored = true;
+    lastStored = t;
+
+    LogRecord &record = pending[pendingCount++];
+    record.time = t;
+    record.boot = boot;
+    record.status = state.status;
+    record.remaining_capacity_perc = state.remaining_capacity_perc;
+    record.remaining_capacity = state.remaining_capacity;
+    record.voltage = clampToInt16(state.voltage_mv / 10);
+    record.current = clampToInt16(state.current_ma / 10);
+    record.temp_zone0 = state.temp_zone0;
+    record.temp_zone1 = state.temp_zone1;
+    // the record format has room for 10 cells, larger packs keep only those
+    memset(record.cells, 0, sizeof(record.cells));
+    memcpy(record.cells, state.cells.data(), std::min(sizeof(record.cells), sizeof(state.cells)));
+    record.crc = crc16(reinterpret_cast<const uint8_t *>(&record), offsetof(LogRecord, crc));
+
+    if (pendingCount == FLASH_LOG_BATCH) flush();
+}
+
+void FlashLog::flush() {
+    int written = 0;
+    while (mounted && written < pendingCount) {
+        if (segmentCount == 0 || segments[segmentCount - 1].count >= recordsPerSegment) {
+            if (!startSegment(pending[written].time)) break;
+        }
+        Segment &segment = segments[segmentCount - 1];
+        int n = std::min(uint32_t(pendingCount - written), recordsPerSegment - segment.count);
+
+        File file = LittleFS.open(segmentPath(segment.seq), "a");
+        size_t len = n * sizeof(LogRecord);
+        if (!file || file.write(reinterpret_cast<const uint8_t *>(&pending[written]), len) != len) break;
+        file.close();
+
+        segment.count += n;
+        segment.end = pending[written + n - 1].time;
+        written += n;
+    }
+    // on a write error the batch is dropped, begin() cuts whatever was torn
+    pendingCount = 0;
+}
+
+const FlashLog::Segment *FlashLog::findSegment(uint32_t seq) const {
+    for (int i = 0; i < segmentCount; i++) {
+        if (segments[i].seq >= seq) return &segments[i];
+    }
+    return nullptr;
+}
+
+FlashLog::Cursor FlashLog::query(uint32_t from, uint32_t to) const {
+    Cursor cursor;
+    cursor.to = to;
+
+    const Segment *segment = nullptr;
+    for (int i = 0; i < segmentCount; i++) {
+        if (segments[i].count > 0 && segments[i].end >= from) {
+            segment = &segments[i];
+            break;
+        }
+    }
+    if (segment == nullptr) return cursor;
+
+    // records are sorted, binary search the first one at or after from
+    File file = LittleFS.open(segmentPath(segment->seq), "r");
+    uint32_t lo = 0;
+    uint32_t hi = segment->count;
+    while (lo < hi) {
+        uint32_t mid = (lo + hi) / 2;
+        uint32_t time = 0;
+        file.seek(headerSize + mid * sizeof(LogRecord));
+        file.read(reinterpret_cast<uint8_t *>(&time), sizeof(time));
+        if (time < from) lo = mid + 1;
+        else hi = mid;
+    }
+
+    cursor.log = this;
+    cursor.seq = segment->seq;
+    cursor.index = lo;
+    cursor.file = file;
+
+    return cursor;
+}
+
+bool FlashLog::Cursor::next(LogRecord &record) {
+    while (log != nullptr) {
+        // the segment may have been rotated away meanwhile, findSegment() moves on to the next one
+        const Segment *segment = log->findSegment(seq);
+        if (segment == nullptr) return false;
+        if (segment->seq != seq) {
+            seq = segment->seq;
+            index = 0;
+            file.close();
+        }
+        if (index >= segment->count) {
+            seq++;
+            index = 0;
+            file.close();
+            continue;
+        }
+        if (!file) file = LittleFS.open(segmentPath(seq), "r");
+
+        file.seek(headerSize + index * sizeof(LogRecord));
+        index++;
+        if (file.read(reinterpret_cast<uint8_t *>(&record), sizeof(record)) != sizeof(record) || !validRecord(record)) continue;
+        if (record.time > to) return false;
+
+        return true;
+    }
+
+    return false;
+}
+
+
+FlashLogSource::FlashLogSource(const FlashLog &log, uint32_t from, uint32_t to) : cursor(log.query(from, to)) {
+    flashLog = &log;
+}
+
+size_t FlashLogSource::nextRecord(char *line, size_t size) {
+    int len = 0;
+    switch (part) {
+        case PART_HEAD:
+            len = snprintf(line, size, "{\"now\":%lu,\"boot\":%u,\"rows\":[", (unsigned long) flashLog->now(), flashLog->bootCount());
+            part = PART_ROWS;
+            break;
+        case PART_ROWS: {
+            LogRecord r;
+            if (!cursor.next(r)) {
+                len = snprintf(line, size, "]}");
+                part = PART_DONE;
+                break;
+            }
+            len = snprintf(line, size, "%s[%lu,%u,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d,%d]",
+                firstRow ? "" : ",", (unsigned long) r.time, r.boot, r.status, r.remaining_capacity_perc,
+                r.remaining_capacity, r.voltage, r.current, r.temp_zone0, r.temp_zone1,
+                r.cells[0], r.cells[1], r.cells[2], r.cells[3], r.cells[4],
+                r.cells[5], r.cells[6], r.cells[7], r.cells[8], r.cells[9]);
+            firstRow = false;
+            break;
+        }
+        default:
+            return 0;
+    }
+
+    return (len < 0) ? 0 : std::min(size_t(len), size - 1);
+}
@@ -0,0 +1,86 @@
+#include <string.h>
+#include "frame_parser.h"
+
+static_assert((NinebotFrameParser::capacity & (NinebotFrameParser::capacity - 1)) == 0, "capacity must be a power of two");
+
+size_t NinebotFrameParser::feed(const uint8_t *bytes, size_t len) {
+    releaseConsumed();
+
+    size_t n = len < space() ? len : space();
+    for (size_t i = 0; i < n; i++) {
+        size_t pos = (head + i) & mask;
+        ring[pos] = bytes[i];
+        ring[pos + capacity] = bytes[i];
+    }
+    head += n;
+
+    return n;
+}
+
+bool NinebotFrameParser::next(NinebotFrame &frame) {
+    releaseConsumed();
+
+    while (buffered() > 0) {
+        const uint8_t *start = at(tail);
+        size_t avail = buffered();
+
+        if (start[0] != 0x5A) {
+            // jump straight to the next candidate header byte
+            const void *found = memchr(start, 0x5A, avail);
+            drop(found ? size_t(static_cast<const uint8_t *>(found) - start) : avail);
+            continue;
+        }
+        if (avail < 2) return false;
+        if (start[1] != 0xA5) {
+            drop(1);
+            continue;
+        }
+        if (avail < 3) return false;
+
+        size_t frameLen = start[2] + NinebotFrame::overhead;
+        if (frameLen > maxFrameLen) {
+            drop(1);
+            continue;
+        }
+        if (avail < frameLen) return false;
+
+        uint16_t received = start[frameLen - 2] | (start[frameLen - 1] << 8);
+        if (received != checksum(start, start[2])) {
+            badCrc++;
+            drop(1);
+            continue;
+        }
+
+        frame.data = start;
+        frame.len = frameLen;
+        consumed = frameLen;
+        return true;
+    }
+
+    return false;
+}
+
+void NinebotFrameParser::reset() {
+    head = 0;
+    tail = 0;
+    consumed = 0;
+}
+
+uint16_t NinebotFrameParser::checksum(const uint8_t *frame, size_t payloadLen) {
+    unsigned int cs = 0;
+    for (size_t i = 2; i <= payloadLen + 6; i++) {
+        cs += frame[i];
+    }
+
+    return uint16_t(0xFFFF - cs);
+}
+
+void NinebotFrameParser::drop(size_t len) {
+    tail += len;
+    skipped += len;
+}
+
+void NinebotFrameParser::releaseConsumed() {
+    tail += consumed;
+    consumed = 0;
+}
@@ -0,0 +1,13 @@
+#include "histogram.h"
+
+void LatencyHistogram::observe(uint32_t us) {
+    // (us - 1) >> 7 is 0 up to 128 us, 1 up to 256 us, ... the bucket is its bit length
+    uint32_t scaled = us == 0 ? 0 : (us - 1) >> 7;
+    uint8_t i = scaled == 0 ? 0 : uint8_t(32 - __builtin_clz(scaled));
+    if (i > buckets) i = buckets;
+
+    counts[i]++;
+    total++;
+    sum += us;
+    if (us > peak) peak = us;
+}
@@ -0,0 +1,279 @@
+#include "history.h"
+
+namespace {
+
+size_t putVarint(uint8_t *out, uint32_t value) {
+    size_t len = 0;
+    while (value >= 0x80) {
+        out[len++] = uint8_t(value) | 0x80;
+        value >>= 7;
+    }
+    out[len++] = uint8_t(value);
+    return len;
+}
+
+size_t getVarint(const uint8_t *in, uint32_t &value) {
+    size_t len = 0;
+    uint32_t shift = 0;
+    value = 0;
+    do {
+        value |= uint32_t(in[len] & 0x7F) << shift;
+        shift += 7;
+    } while (in[len++] & 0x80);
+    return len;
+}
+
+uint32_t zigzag(int32_t value) {
+    return (uint32_t(value) << 1) ^ uint32_t(value >> 31);
+}
+
+int32_t unzigzag(uint32_t value) {
+    return int32_t(value >> 1) ^ -int32_t(value & 1);
+}
+
+int16_t clampToInt16(int32_t value) {
+    if (value > 32767) return 32767;
+    if (value < -32768) return -32768;
+    return int16_t(value);
+}
+
+// enough for the largest pack, channelName() stops at the configured cell count
+const char *const channelNames[5 + 16] = {
+    "voltage", "current", "soc", "temp0", "temp1",
+    "cell0", "cell1", "cell2", "cell3", "cell4", "cell5", "cell6", "cell7", "cell8", "cell9",
+    "cell10", "cell11", "cell12", "cell13", "cell14", "cell15",
+};
+
+}
+
+
+DeltaLog::DeltaLog(uint8_t *_storage, size_t size, uint8_t _channels) {
+    storage = _storage;
+    blocks = size / blockSize;
+    channels = _channels < maxChannels ? _channels : maxChannels;
+}
+
+uint32_t DeltaLog::blockStart(const uint8_t *block) {
+    return uint32_t(block[0]) | (uint32_t(block[1]) << 8) | (uint32_t(block[2]) << 16) | (uint32_t(block[3]) << 24);
+}
+
+uint16_t DeltaLog::blockUsed(const uint8_t *block) {
+    return uint16_t(block[4] | (block[5] << 8));
+}
+
+void DeltaLog::startBlock(uint32_t t) {
+    uint8_t *block = blockAt(written);
+    block[0] = t & 0xFF;
+    block[1] = (t >> 8) & 0xFF;
+    block[2] = (t >> 16) & 0xFF;
+    block[3] = (t >> 24) & 0xFF;
+    block[4] = 0;
+    block[5] = 0;
+    written++;
+    lastT = t;
+    memset(last, 0, sizeof(last));
+}
+
+void DeltaLog::append(uint32_t t, const int16_t values[]) {
+    if (blocks == 0) return;
+    if (written == 0) startBlock(t);
+
+    // worst case: 5 byte time delta, the mask and 3 bytes per channel
+    uint8_t record[5 + maxChannels / 8 + maxChannels * 3];
+    const size_t maskLen = (channels + 7) / 8;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        size_t len = putVarint(record, t - lastT);
+        uint8_t *mask = record + len;
+        memset(mask, 0, maskLen);
+        len += maskLen;
+        for (uint8_t ch = 0; ch < channels; ch++) {
+            int32_t delta = int32_t(values[ch]) - last[ch];
+            if (delta == 0) continue;
+            mask[ch / 8] |= 1 << (ch % 8);
+            len += putVarint(record + len, zigzag(delta));
+        }
+
+        uint8_t *block = blockAt(written - 1);
+        uint16_t used = blockUsed(block);
+        if (headerSize + used + len > blockSize) {
+            // the new block starts from zero, so the record has to be encoded again
+            startBlock(t);
+            continue;
+        }
+        memcpy(block + headerSize + used, record, len);
+        used += len;
+        block[4] = used & 0xFF;
+        block[5] = used >> 8;
+        memcpy(last, values, channels * sizeof(values[0]));
+        lastT = t;
+        return;
+    }
+}
+
+DeltaLog::Cursor DeltaLog::read(uint32_t since) const {
+    Cursor cursor;
+    cursor.log = this;
+    cursor.since = since;
+    if (written == 0) return cursor;
+
+    uint32_t seq = oldest();
+    // every record of a block is older than the start of the next one
+    while (seq + 1 < written && blockStart(blockAt(seq + 1)) < since) seq++;
+    cursor.enter(seq);
+
+    return cursor;
+}
+
+void DeltaLog::Cursor::enter(uint32_t seq) {
+    block = seq;
+    pos = 0;
+    t = blockStart(log->blockAt(seq));
+    memset(prev, 0, sizeof(prev));
+}
+
+bool DeltaLog::Cursor::next(uint32_t &time, int16_t values[]) {
+    if (log == nullptr || log->written == 0) return false;
+
+    for (;;) {
+        // the block under the cursor was evicted while streaming, continue at the oldest one
+        if (block < log->oldest()) enter(log->oldest());
+
+        const uint8_t *data = log->blockAt(block);
+        if (pos >= blockUsed(data)) {
+            if (block + 1 >= log->written) return false;
+            enter(block + 1);
+            continue;
+        }
+
+        const uint8_t *record = data + headerSize + pos;
+        uint32_t dt;
+        size_t len = getVarint(record, dt);
+        const uint8_t *mask = record + len;
+        len += (log->channels + 7) / 8;
+        for (uint8_t ch = 0; ch < log->channels; ch++) {
+            if (!(mask[ch / 8] & (1 << (ch % 8)))) continue;
+            uint32_t delta;
+            len += getVarint(record + len, delta);
+            prev[ch] = int16_t(prev[ch] + unzigzag(delta));
+        }
+        pos += len;
+        t += dt;
+
+        if (t < since) continue;
+        time = t;
+        memcpy(values, prev, log->channels * sizeof(values[0]));
+        return true;
+    }
+}
+
+
+TelemetryHistory::TelemetryHistory()
+    : raw(rawStorage, sizeof(rawStorage), channels),
+      minutes(minuteStorage, sizeof(minuteStorage), rollupChannels),
+      quarters(quarterStorage, sizeof(quarterStorage), rollupChannels) {
+}
+
+void TelemetryHistory::add(const BatteryState &state) {
+    int16_t values[channels] = {
+        clampToInt16(state.voltage_mv / 10),
+        clampToInt16(state.current_ma / 10),
+        state.remaining_capacity_perc,
+        state.temp_zone0,
+        state.temp_zone1,
+    };
+    memcpy(values + 5, state.cells.data(), sizeof(state.cells));
+    uint32_t t = state.uptime;
+
+    raw.append(t, values);
+    rollup(minute, minutes, 60, t, values);
+    rollup(quarter, quarters, 15 * 60, t, values);
+}
+
+void TelemetryHistory::rollup(Rollup &acc, DeltaLog &log, uint32_t periodSeconds, uint32_t t, const int16_t values[]) {
+    uint32_t period = t / periodSeconds;
+    if (acc.count > 0 && period != acc.period) acc.flush(log, periodSeconds);
+    if (acc.count == 0) acc.period = period;
+    acc.add(values);
+}
+
+const DeltaLog &TelemetryHistory::log(Resolution res) const {
+    switch (res) {
+        case RES_MINUTE: return minutes;
+        case RES_QUARTER: return quarters;
+        default: return raw;
+    }
+}
+
+const char *TelemetryHistory::channelName(uint8_t channel) {
+    return channel < channels ? channelNames[channel] : "";
+}
+
+void TelemetryHistory::Rollup::add(const int16_t values[]) {
+    for (uint8_t ch = 0; ch < channels; ch++) {
+        if (count == 0 || values[ch] < min[ch]) min[ch] = values[ch];
+        if (count == 0 || values[ch] > max[ch]) max[ch] = values[ch];
+        sum[ch] = (count == 0 ? 0 : sum[ch]) + values[ch];
+    }
+    count++;
+}
+
+void TelemetryHistory::Rollup::flush(DeltaLog &log, uint32_t periodSeconds) {
+    int16_t out[rollupChannels];
+    for (uint8_t ch = 0; ch < channels; ch++) {
+        out[ch * 3] = min[ch];
+        out[ch * 3 + 1] = max[ch];
+        out[ch * 3 + 2] = int16_t(sum[ch] / count);
+    }
+    log.append(period * periodSeconds, out);
+    count = 0;
+}
+
+
+HistorySource::HistorySource(const TelemetryHistory &history, TelemetryHistory::Resolution _res, uint32_t since)
+    : res(_res), cursor(history.log(_res).read(since)) {
+    channels = history.log(_res).channelCount();
+}
+
+size_t HistorySource::nextRecord(char *line, size_t size) {
+    static const char *const resNames[] = {"raw", "1m", "15m"};
+    static const char *const suffixes[] = {"_min", "_max", "_avg"};
+    int len = 0;
+
+    switch (part) {
+        case PART_HEAD:
+            len = snprintf(line, size, "{\"res\":\"%s\",\"columns\":[\"t\"", resNames[res]);
+            part = PART_COLUMNS;
+            break;
+        case PART_COLUMNS:
+            if (res == TelemetryHistory::RES_SAMPLE) {
+                len = snprintf(line, size, ",\"%s\"", TelemetryHistory::channelName(column));
+            } else {
+                len = snprintf(line, size, ",\"%s%s\"", TelemetryHistory::channelName(column / 3), suffixes[column % 3]);
+            }
+            if (++column >= channels) {
+                len += snprintf(line + len, size - len, "],\"rows\":[");
+                part = PART_ROWS;
+            }
+            break;
+        case PART_ROWS: {
+            uint32_t t;
+            int16_t values[DeltaLog::maxChannels];
+            if (!cursor.next(t, values)) {
+                len = snprintf(line, size, "]}");
+                part = PART_DONE;
+                break;
+            }
+            len = snprintf(line, size, "%s[%lu", firstRow ? "" : ",", (unsigned long) t);
+            for (uint8_t ch = 0; ch < channels && size_t(len) < size; ch++) {
+                len += snprintf(line + len, size - len, ",%d", values[ch]);
+            }
+            if (size_t(len) < size) len += snprintf(line + len, size - len, "]");
+            firstRow = false;
+            break;
+        }
+        default:
+            return 0;
+    }
+
+    return (len < 0) ? 0 : std::min(size_t(len), size - 1);
+}
@@ -0,0 +1,607 @@
+#include <strings.h>
+#include "http_server.h"
+#include "trace.h"
+
+static_assert(HTTP_BUFFER_SIZE < 0x1000 + 7, "chunk sizes are written as three hex digits");
+static_assert(SSE_MAX_CLIENTS < HTTP_MAX_CLIENTS, "/events subscribers would take every connection");
+
+// request heads longer than this are answered with 431 and closed
+static const uint16_t maxHeadBytes = 4096;
+
+static const char *statusText(int code) {
+    switch (code) {
+        case 200: return "OK";
+        case 204: return "No Content";
+        case 304: return "Not Modified";
+        case 400: return "Bad Request";
+        case 404: return "Not Found";
+        case 414: return "URI Too Long";
+        case 431: return "Request Header Fields Too Large";
+        case 500: return "Internal Server Error";
+        case 503: return "Service Unavailable";
+        default: return "";
+    }
+}
+
+HttpServer::HttpServer(uint16_t _port) {
+    port = _port;
+}
+
+void HttpServer::on(const __FlashStringHelper *uri, Handler handler) {
+    if (routeCount < maxRoutes) routes[routeCount++] = Route{uri, handler};
+}
+
+void HttpServer::onNotFound(Handler handler) {
+    notFound = handler;
+}
+
+void HttpServer::collectHeaders(const char *keys[], size_t count) {
+    collectedCount = 0;
+    for (size_t i = 0; i < count && i < maxCollected; i++) collected[collectedCount++] = keys[i];
+}
+
+void HttpServer::begin() {
+    listen();
+}
+
+uint8_t HttpServer::connections() const {
+    uint8_t count = 0;
+    for (const Connection &conn : conns) {
+        if (conn.state != CONN_FREE) count++;
+    }
+    return count;
+}
+
+void HttpServer::update() {
+    poll();
+
+    for (Connection &conn : conns) {
+        if (conn.state == CONN_FREE) continue;
+        if (conn.gone) {
+            releaseStream(conn);
+            conn.state = CONN_FREE;
+            conn.generation++;
+            continue;
+        }
+
+        switch (conn.state) {
+            case CONN_REQUEST:
+                // an idle keep-alive connection is no timeout, a half sent request is
+                if (millis() - conn.lastActivity > HTTP_IDLE_MS) {
+                    if (conn.parse != PARSE_METHOD) expired++;
+                    disconnect(conn, false);
+                }
+                break;
+            case CONN_READY:
+                // any handler may stream, so requests wait for a free stream slot
+                if (claimStream() >= 0) dispatch(conn);
+                break;
+            case CONN_RESPONSE:
+                if (pump(conn)) {
+                    finish(conn);
+                } else if (millis() - conn.lastActivity > HTTP_STALL_MS) {
+                    expired++;
+                    releaseStream(conn);
+                    disconnect(conn, true);
+                }
+                break;
+            case CONN_EVENTS:
+                pump(conn);
+                break;
+            default:
+                break;
+        }
+    }
+}
+
+HttpServer::Connection *HttpServer::claimConnection() {
+    for (Connection &conn : conns) {
+        if (conn.state != CONN_FREE) continue;
+        conn.generation++;
+        conn.gone = false;
+        // responses leave in as few writes as the buffer allows, nagle would only hold back the last one
+        conn.noDelay = true;
+        reset(conn);
+        return &conn;
+    }
+    refused++;
+    return nullptr;
+}
+
+void HttpServer::reset(Connection &conn) {
+    conn.state = CONN_REQUEST;
+    conn.parse = PARSE_METHOD;
+    conn.keepAlive = false;
+    conn.tooLong = false;
+    conn.headOnly = false;
+    conn.headBytes = 0;
+    conn.targetLen = 0;
+    conn.target[0] = '\0';
+    conn.fieldLen = 0;
+    for (char *value : conn.headerValues) value[0] = '\0';
+    conn.outStart = conn.outEnd = 0;
+    conn.flash = nullptr;
+    conn.flashLeft = 0;
+    conn.lastActivity = millis();
+}
+
+void HttpServer::parse(Connection &conn, const uint8_t *data, size_t len) {
+    if (len > 0) conn.lastActivity = millis();
+    for (size_t i = 0; i < len; i++) {
+        if (conn.state != CONN_REQUEST) {
+            // pipelined requests are not supported, answer this one and close
+            conn.keepAlive = false;
+            return;
+        }
+        if (++conn.headBytes > maxHeadBytes) {
+            conn.tooLong = true;
+            conn.state = CONN_READY;
+            return;
+        }
+
+        char c = char(data[i]);
+        switch (conn.parse) {
+            case PARSE_METHOD:
+                if (c == ' ') {
+                    conn.field[conn.fieldLen] = '\0';
+                    conn.headOnly = strcmp(conn.field, "HEAD") == 0;
+                    conn.parse = PARSE_TARGET;
+                } else if (c != '\r' && c != '\n' && conn.fieldLen < fieldSize - 1) {
+                    conn.field[conn.fieldLen++] = c;
+                }
+                break;
+            case PARSE_TARGET:
+                if (c == ' ') {
+                    conn.target[conn.targetLen] = '\0';
+                    conn.fieldLen = 0;
+                    conn.parse = PARSE_VERSION;
+                } else if (conn.targetLen < targetSize - 1) {
+                    conn.target[conn.targetLen++] = c;
+                } else {
+                    conn.tooLong = true;
+                }
+                break;
+            case PARSE_VERSION:
+                if (c == '\n') {
+                    conn.field[conn.fieldLen] = '\0';
+                    conn.keepAlive = strcmp(conn.field, "HTTP/1.1") == 0;
+                    conn.fieldLen = 0;
+                    conn.parse = PARSE_NAME;
+                } else if (c != '\r' && conn.fieldLen < fieldSize - 1) {
+                    conn.field[conn.fieldLen++] = c;
+                }
+                break;
+            case PARSE_NAME:
+                if (c == '\n') {
+                    if (conn.fieldLen == 0) conn.state = CONN_READY; // empty line, end of the head
+                    conn.fieldLen = 0;
+                } else if (c == ':') {
+                    endField(conn);
+                } else if (c != '\r' && conn.fieldLen < fieldSize - 1) {
+                    conn.field[conn.fieldLen++] = c;
+                }
+                break;
+            case PARSE_VALUE: {
+                bool connection = conn.header == maxCollected;
+                char *value = connection ? conn.field : conn.headerValues[conn.header];
+                size_t size = connection ? fieldSize : headerValueSize;
+                if (c == '\n') {
+                    value[conn.valueLen] = '\0';
+                    if (connection && strcasecmp(value, "close") == 0) conn.keepAlive = false;
+                    if (connection && strcasecmp(value, "keep-alive") == 0) conn.keepAlive = true;
+                    conn.fieldLen = 0;
+                    conn.parse = PARSE_NAME;
+                } else if (c != '\r' && !(c == ' ' && conn.valueLen == 0) && conn.valueLen < size - 1) {
+                    value[conn.valueLen++] = c;
+                }
+                break;
+            }
+            case PARSE_SKIP:
+                if (c == '\n') {
+                    conn.fieldLen = 0;
+                    conn.parse = PARSE_NAME;
+                }
+                break;
+        }
+    }
+}
+
+void HttpServer::endField(Connection &conn) {
+    conn.field[conn.fieldLen] = '\0';
+    conn.valueLen = 0;
+    conn.parse = PARSE_SKIP;
+    if (strcasecmp(conn.field, "Connection") == 0) {
+        conn.header = maxCollected;
+        conn.parse = PARSE_VALUE;
+        return;
+    }
+    for (uint8_t i = 0; i < collectedCount; i++) {
+        if (strcasecmp(conn.field, collected[i]) == 0) {
+            conn.header = i;
+            conn.parse = PARSE_VALUE;
+            return;
+        }
+    }
+}
+
+void HttpServer::dispatch(Connection &conn) {
+    current = &conn;
+    headersLen = 0;
+    headers[0] = '\0';
+    responded = false;
+
+    if (conn.tooLong) {
+        conn.keepAlive = false;
+        send(conn.targetLen >= targetSize - 1 ? 414 : 431, "text/plain", "request too long");
+    } else {
+        size_t pathLen = strcspn(conn.target, "?");
+        Handler handler = notFound;
+        uint8_t route = 0;
+        for (; route < routeCount; route++) {
+            PGM_P uri = reinterpret_cast<PGM_P>(routes[route].uri);
+            if (strlen_P(uri) == pathLen && strncmp_P(conn.target, uri, pathLen) == 0) {
+                handler = routes[route].handler;
+                break;
+            }
+        }
+        TRACE_SCOPE(TRACE_HANDLER, route);
+        if (handler != nullptr) handler();
+        else send(404, "text/plain", "Not found");
+        if (!responded) send(500, "text/plain", "500: no response");
+    }
+
+    served++;
+    current = nullptr;
+    if (conn.state == CONN_RESPONSE) {
+        conn.lastActivity = millis();
+        if (pump(conn)) finish(conn);
+    }
+}
+
+void HttpServer::finish(Connection &conn) {
+    if (conn.keepAlive) {
+        reset(conn);
+    } else {
+        disconnect(conn, false);
+    }
+}
+
+String HttpServer::uri() const {
+    if (current == nullptr) return String();
+    size_t pathLen = strcspn(current->target, "?");
+    char buf[targetSize];
+    memcpy(buf, current->target, pathLen);
+    buf[pathLen] = '\0';
+    return String(buf);
+}
+
+const char *HttpServer::query(const Connection &conn, const char *name, size_t &len) const {
+    const char *pos = strchr(conn.target, '?');
+    size_t nameLen = strlen_P(name);
+    while (pos != nullptr) {
+        pos++;
+        const char *end = strchr(pos, '&');
+        if (end == nullptr) end = pos + strlen(pos);
+        const char *eq = static_cast<const char *>(memchr(pos, '=', end - pos));
+        const char *keyEnd = eq != nullptr ? eq : end;
+        if (size_t(keyEnd - pos) == nameLen && strncmp_P(pos, name, nameLen) == 0) {
+            const char *value = eq != nullptr ? eq + 1 : end;
+            len = end - value;
+            return value;
+        }
+        pos = *end == '&' ? end : nullptr;
+    }
+    return nullptr;
+}
+
+bool HttpServer::hasArg(const __FlashStringHelper *name) const {
+    size_t len;
+    return current != nullptr && query(*current, reinterpret_cast<PGM_P>(name), len) != nullptr;
+}
+
+String HttpServer::arg(const __FlashStringHelper *name) const {
+    size_t len = 0;
+    const char *value = current != nullptr ? query(*current, reinterpret_cast<PGM_P>(name), len) : nullptr;
+    if (value == nullptr) return String();
+
+    // %xx and '+' decoded, the result is never longer than the target
+    char buf[targetSize];
+    size_t out = 0;
+    for (size_t i = 0; i < len; i++) {
+        char c = value[i];
+        if (c == '+') {
+            c = ' ';
+        } else if (c == '%' && i + 2 < len && isxdigit(value[i + 1]) && isxdigit(value[i + 2])) {
+            char hex[3] = {value[i + 1], value[i + 2], '\0'};
+            c = char(strtol(hex, nullptr, 16));
+            i += 2;
+        }
+        buf[out++] = c;
+    }
+    buf[out] = '\0';
+    return String(buf);
+}
+
+String HttpServer::header(const __FlashStringHelper *name) const {
+    if (current == nullptr) return String();
+    for (uint8_t i = 0; i < collectedCount; i++) {
+        if (strcasecmp_P(collected[i], reinterpret_cast<PGM_P>(name)) == 0) return String(current->headerValues[i]);
+    }
+    return String();
+}
+
+HttpClient HttpServer::client() {
+    HttpClient handle;
+    if (current == nullptr || responded) return handle;
+
+    responded = true;
+    current->state = CONN_EVENTS;
+    current->keepAlive = false;
+    handle.server = this;
+    handle.slot = uint8_t(current - conns);
+    handle.generation = current->generation;
+    return handle;
+}
+
+void HttpServer::sendHeader(const __FlashStringHelper *name, const String &value, bool first) {
+    char line[128];
+    int len = snprintf_P(line, sizeof(line), PSTR("%s: %s\r\n"), reinterpret_cast<PGM_P>(name), value.c_str());
+    if (len < 0 || size_t(len) >= sizeof(line) || headersLen + len >= sizeof(headers)) return;
+
+    if (first) {
+        memmove(headers + len, headers, headersLen + 1);
+        memcpy(headers, line, len);
+    } else {
+        memcpy(headers + headersLen, line, len + 1);
+    }
+    headersLen += len;
+}
+
+bool HttpServer::writeHead(int code, const char *contentType, size_t len) {
+    Connection &conn = *current;
+    conn.outStart = conn.outEnd = 0;
+    char line[96];
+    int n = snprintf_P(line, sizeof(line), PSTR("HTTP/1.1 %d %s\r\n"), code, statusText(code));
+    if (n < 0 || !appendOut(conn, line, n)) return false;
+    if (contentType != nullptr) {
+        n = snprintf_P(line, sizeof(line), PSTR("Content-Type: %s\r\n"), contentType);
+        if (n < 0 || !appendOut(conn, line, n)) return false;
+    }
+    if (len == CONTENT_LENGTH_UNKNOWN) {
+        n = snprintf_P(line, sizeof(line), PSTR("Transfer-Encoding: chunked\r\n"));
+    } else {
+        n = snprintf_P(line, sizeof(line), PSTR("Content-Length: %lu\r\n"), (unsigned long)len);
+    }
+    if (n < 0 || !appendOut(conn, line, n)) return false;
+    if (!appendOut(conn, headers, headersLen)) return false;
+    n = snprintf_P(line, sizeof(line), PSTR("Connection: %s\r\n\r\n"), conn.keepAlive ? "keep-alive" : "close");
+
+    return n >= 0 && appendOut(conn, line, n);
+}
+
+bool HttpServer::appendOut(Connection &conn, const char *data, size_t len) {
+    if (HTTP_BUFFER_SIZE - conn.outEnd < len) return false;
+    memcpy(conn.out + conn.outEnd, data, len);
+    conn.outEnd += len;
+    return true;
+}
+
+void HttpServer::send(int code, const char *contentType, const String &content) {
+    send(code, contentType, content.c_str(), content.length());
+}
+
+void HttpServer::send(int code, const char *contentType, const char *content, size_t len) {
+    if (current == nullptr || responded) return;
+    responded = true;
+    current->state = CONN_RESPONSE;
+
+    if (!writeHead(code, contentType, len) || !appendOut(*current, content, current->headOnly ? 0 : len)) {
+        sendTooLarge();
+    }
+}
+
+void HttpServer::sendTooLarge() {
+    static const char tooLarge[] = "500: response too large";
+    headersLen = 0;
+    current->keepAlive = false;
+    writeHead(500, "text/plain", sizeof(tooLarge) - 1);
+    appendOut(*current, tooLarge, sizeof(tooLarge) - 1);
+}
+
+void HttpServer::send_P(int code, PGM_P contentType, PGM_P content, size_t len) {
+    if (current == nullptr || responded) return;
+    responded = true;
+    current->state = CONN_RESPONSE;
+
+    char type[48];
+    strncpy_P(type, contentType, sizeof(type) - 1);
+    type[sizeof(type) - 1] = '\0';
+    if (!writeHead(code, type, len)) {
+        sendTooLarge();
+        return;
+    }
+    current->flash = content;
+    current->flashLeft = current->headOnly ? 0 : len;
+}
+
+int8_t HttpServer::claimStream() {
+    for (int8_t i = 0; i < HTTP_STREAMS; i++) {
+        if (streams[i].body == nullptr) return i;
+    }
+    return -1;
+}
+
+void HttpServer::startStream(int code, const char *contentType, int8_t slot, StreamSource *body) {
+    responded = true;
+    current->state = CONN_RESPONSE;
+    streams[slot].body = body;
+    current->stream = slot;
+    if (!writeHead(code, contentType, CONTENT_LENGTH_UNKNOWN)) {
+        releaseStream(*current);
+        sendTooLarge();
+        return;
+    }
+    if (current->headOnly) releaseStream(*current);
+}
+
+void HttpServer::releaseStream(Connection &conn) {
+    if (conn.stream < 0) return;
+    Stream &stream = streams[conn.stream];
+    stream.body->~StreamSource();
+    stream.body = nullptr;
+    conn.stream = -1;
+}
+
+bool HttpServer::pump(Connection &conn) {
+    // a few refills per call, so one fast client does not keep loop() to itself
+    for (int round = 0; round < 4; round++) {
+        if (conn.outStart == conn.outEnd) {
+            conn.outStart = conn.outEnd = 0;
+        } else if (conn.outStart > 0 && HTTP_BUFFER_SIZE - conn.outEnd < 128) {
+            memmove(conn.out, conn.out + conn.outStart, conn.outEnd - conn.outStart);
+            conn.outEnd -= conn.outStart;
+            conn.outStart = 0;
+        }
+
+        size_t room = HTTP_BUFFER_SIZE - conn.outEnd;
+        if (conn.flashLeft > 0 && room > 0) {
+            size_t n = std::min(room, conn.flashLeft);
+            memcpy_P(conn.out + conn.outEnd, conn.flash, n);
+            conn.flash += n;
+            conn.flashLeft -= n;
+            conn.outEnd += n;
+        } else if (conn.stream >= 0 && room >= 64 && streams[conn.stream].body->ready()) {
+            // size line in front, crlf behind, the final empty chunk once the body is done
+            char *chunk = conn.out + conn.outEnd;
+            size_t n;
+            {
+                TRACE_SCOPE(TRACE_BODY);
+                n = streams[conn.stream].body->read(chunk + 5, room - 7);
+            }
+            if (n == 0) {
+                memcpy(chunk, "0\r\n\r\n", 5);
+                conn.outEnd += 5;
+                releaseStream(conn);
+            } else {
+                char size[6];
+                snprintf(size, sizeof(size), "%03x\r\n", unsigned(n));
+                memcpy(chunk, size, 5);
+                chunk[5 + n] = '\r';
+                chunk[6 + n] = '\n';
+                conn.outEnd += n + 7;
+            }
+        }
+
+        if (conn.outStart == conn.outEnd) break;
+        size_t sent = transmit(conn, conn.out + conn.outStart, conn.outEnd - conn.outStart);
+        if (sent > 0) conn.lastActivity = millis();
+        conn.outStart += sent;
+        if (conn.outStart < conn.outEnd) return false;
+    }
+
+    return conn.outStart == conn.outEnd && conn.flashLeft == 0 && conn.stream < 0;
+}
+
+HttpServer::Connection *HttpServer::handle(const HttpClient &client) const {
+    if (client.server != this) return nullptr;
+    Connection *conn = const_cast<Connection *>(&conns[client.slot]);
+    if (conn->generation != client.generation || conn->state != CONN_EVENTS || conn->gone) return nullptr;
+    return conn;
+}
+
+
+bool HttpClient::connected() const {
+    return server != nullptr && server->handle(*this) != nullptr;
+}
+
+size_t HttpClient::availableForWrite() const {
+    HttpServer::Connection *conn = server != nullptr ? server->handle(*this) : nullptr;
+    if (conn == nullptr) return 0;
+    return HTTP_BUFFER_SIZE - (conn->outEnd - conn->outStart);
+}
+
+size_t HttpClient::write(const uint8_t *data, size_t len) {
+    HttpServer::Connection *conn = server != nullptr ? server->handle(*this) : nullptr;
+    if (conn == nullptr) return 0;
+
+    if (conn->outStart > 0) {
+        memmove(conn->out, conn->out + conn->outStart, conn->outEnd - conn->outStart);
+        conn->outEnd -= conn->outStart;
+        conn->outStart = 0;
+    }
+    size_t n = std::min(len, size_t(HTTP_BUFFER_SIZE - conn->outEnd));
+    memcpy(conn->out + conn->outEnd, data, n);
+    conn->outEnd += n;
+    server->pump(*conn);
+    return n;
+}
+
+void HttpClient::setNoDelay(bool noDelay) {
+    HttpServer::Connection *conn = server != nullptr ? server->handle(*this) : nullptr;
+    if (conn == nullptr) return;
+    conn->noDelay = noDelay;
+    server->applyNoDelay(*conn);
+}
+
+void HttpClient::stop() {
+    HttpServer::Connection *conn = server != nullptr ? server->handle(*this) : nullptr;
+    if (conn != nullptr) server->disconnect(*conn, false);
+    server = nullptr;
+}
+
+#ifndef NATIVE
+static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nRetry-After: 1\r\nConnection: close\r\n\r\n";
+
+void HttpServer::listen() {
+    listener = new AsyncServer(port);
+    listener->onClient([](void *arg, AsyncClient *tcp) {
+        HttpServer *self = static_cast<HttpServer *>(arg);
+        Connection *conn = self->claimConnection();
+        // the client object is ours, it goes once the connection is closed
+        if (conn == nullptr) {
+            tcp->onDisconnect([](void *, AsyncClient *closed) { delete closed; });
+            tcp->add(busy, sizeof(busy) - 1);
+            tcp->send();
+            tcp->close();
+            return;
+        }
+
+        conn->tcp = tcp;
+        self->applyNoDelay(*conn);
+        tcp->onData([self, conn](void *, AsyncClient *, void *data, size_t len) {
+            self->parse(*conn, static_cast<const uint8_t *>(data), len);
+        });
+        tcp->onDisconnect([conn](void *, AsyncClient *closed) {
+            conn->gone = true;
+            conn->tcp = nullptr;
+            delete closed;
+        });
+        tcp->onError([conn](void *, AsyncClient *, int8_t) { conn->gone = true; });
+    }, this);
+    listener->begin();
+}
+
+void HttpServer::poll() {
+    // all of it happens in the tcp callbacks
+}
+
+size_t HttpServer::transmit(Connection &conn, const char *data, size_t len) {
+    if (conn.tcp == nullptr || !conn.tcp->canSend()) return 0;
+    size_t n = std::min(len, conn.tcp->space());
+    if (n == 0) return 0;
+    n = conn.tcp->add(data, n);
+    conn.tcp->send();
+    return n;
+}
+
+void HttpServer::disconnect(Connection &conn, bool abort) {
+    conn.state = CONN_CLOSING;
+    // the disconnect callback marks the connection gone and deletes the client
+    if (conn.tcp != nullptr) conn.tcp->close(abort);
+    else conn.gone = true;
+}
+
+void HttpServer::applyNoDelay(Connection &conn) {
+    if (conn.tcp != nullptr) conn.tcp->setNoDelay(conn.noDelay);
+}
+#endif
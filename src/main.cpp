@@ -1,28 +1,191 @@
 #include <Arduino.h>
 #include <SoftwareSerial.h>
-#include "battery.h"
-#include "config.h"
-#include "site.hpp"
-
+// before config.h, its SSID macro would clash with WiFi.SSID()
 #if defined(ESP32)
   #include <WiFi.h>
-  #include <WebServer.h>
   #include <ESPmDNS.h>
-  WebServer server(80);
 #elif defined(ESP8266)
   #include <ESP8266WiFi.h>
-  #include <ESP8266WebServer.h>
   #include <ESP8266mDNS.h>
-  ESP8266WebServer server(80);
+#endif
+#include "battery.h"
+#include "config.h"
+#include "site.hpp"
+#include "mqtt_publisher.h"
+#include "duty_cycle.h"
+#include "fast_boot.h"
+
+#if defined(DUTY_CYCLE_S) && DUTY_CYCLE_DEEP && defined(CHARGE_RELAY_PIN)
+#error "the charge limit needs the cpu awake, use DUTY_CYCLE_DEEP false"
+#endif
+#if defined(DUTY_CYCLE_S) && !DUTY_CYCLE_DEEP && defined(CREATE_APN)
+#error "light sleep needs station mode, comment out CREATE_APN"
 #endif
 
+HttpServer server(80);
+
 
 // SoftwareSerial serial(1, 2);
 BatteryMonitor batteryMonitor(Serial, false);
-BatteryState batteryState;
+BatteryState packStates[BATTERY_PACKS];
+BatteryPoller packPollers[BATTERY_PACKS];
+// pack 0 feeds history, statistics, events, mqtt and the charge limit
+BatteryState &batteryState = packStates[0];
+BatteryPoller &batteryPoller = packPollers[0];
+TelemetryHistory telemetryHistory;
+FlashLog flashLog;
+EventHub eventHub;
+LatencyHistogram loopTime;
+ChargeController chargeController(batteryPoller);
+PackStats packStats(batteryPoller);
+DutyCycle dutyCycle;
+FastBoot fastBoot;
+#ifdef BUS_CAPTURE_BYTES
+static uint8_t captureRing[BUS_CAPTURE_BYTES];
+BusCapture busCapture(captureRing, sizeof(captureRing));
+#endif
+#ifdef MQTT_HOST
+MqttPublisher mqttPublisher;
+#endif
+
+
+// starts the association without waiting for it. The cached channel and bssid
+// skip the scan, STATIC_IP or the cached lease skip dhcp.
+void beginStation() {
+    WiFi.persistent(false);
+    WiFi.mode(WIFI_STA);
+    const FastBoot::WifiCache *cache = fastBoot.wifi();
+    #ifdef STATIC_IP
+    WiFi.config(IPAddress(STATIC_IP), IPAddress(STATIC_GATEWAY), IPAddress(STATIC_NETMASK), IPAddress(STATIC_GATEWAY));
+    #else
+    if (cache != nullptr && FAST_BOOT_LEASE) {
+        WiFi.config(IPAddress(cache->ip), IPAddress(cache->gateway), IPAddress(cache->netmask), IPAddress(cache->dns));
+    }
+    #endif
+    if (cache != nullptr) {
+        WiFi.begin(String(SSID).c_str(), String(PASSWORD).c_str(), cache->channel, cache->bssid);
+    } else {
+        WiFi.begin(SSID, PASSWORD);
+    }
+}
+
+// from loop() until the station is up: caches what worked, or falls back to a
+// full scan and dhcp when the cached parameters did not
+void updateStation() {
+    static bool up = false;
+    static bool fallback = false;
+    if (up) return;
+
+    if (WiFi.status() == WL_CONNECTED) {
+        up = true;
+        FastBoot::WifiCache cache{};
+        memcpy(cache.bssid, WiFi.BSSID(), sizeof(cache.bssid));
+        cache.channel = uint8_t(WiFi.channel());
+        cache.ip = uint32_t(WiFi.localIP());
+        cache.gateway = uint32_t(WiFi.gatewayIP());
+        cache.netmask = uint32_t(WiFi.subnetMask());
+        cache.dns = uint32_t(WiFi.dnsIP());
+        fastBoot.wifiUp(!fallback && fastBoot.wifi() != nullptr ? FastBoot::BOOT_WIFI_CACHED : FastBoot::BOOT_WIFI_SCANNED);
+        fastBoot.storeWifi(cache);
+        #ifdef DEBUG
+        Serial.print(F("WiFi connected, IP address: "));
+        Serial.println(WiFi.localIP());
+        #endif
+
+        if (!MDNS.begin(LOCAL_DNS_NAME)) {
+            #ifdef DEBUG
+            Serial.println(F("Error setting up MDNS responder!"));
+            #endif
+        } else {
+            #ifdef DEBUG
+            Serial.println(F("mDNS responder started: http://battery.local"));
+            #endif
+        }
+    } else if (!fallback && fastBoot.wifi() != nullptr && millis() > FAST_BOOT_WIFI_MS) {
+        // the access point moved to another channel or the lease is gone
+        fallback = true;
+        fastBoot.forgetWifi();
+        WiFi.disconnect();
+        #ifndef STATIC_IP
+        WiFi.config(IPAddress(uint32_t(0)), IPAddress(uint32_t(0)), IPAddress(uint32_t(0)));
+        #endif
+        WiFi.begin(SSID, PASSWORD);
+    }
+}
+
+#if defined(DUTY_CYCLE_S) && DUTY_CYCLE_DEEP
+// deep duty cycle: no web server, the radio only comes up on publishing wakes
+void setupBurst() {
+    #ifdef MQTT_HOST
+    dutyCycle.begin(DUTY_CYCLE_S, true, true);
+    #else
+    dutyCycle.begin(DUTY_CYCLE_S, true, false);
+    #endif
+    if (dutyCycle.resumed()) {
+        batteryState = dutyCycle.cached();
+    } else {
+        initWithFakeData(batteryState);
+    }
+    WiFi.persistent(false);
+
+    #ifdef MQTT_HOST
+    if (dutyCycle.radioOn()) {
+        fastBoot.begin();
+        beginStation();
+        mqttPublisher.begin(MQTT_HOST, MQTT_PORT, MQTT_CLIENT_ID, MQTT_TOPIC_PREFIX);
+        batteryPoller.onSample([](const BatteryState &state) { mqttPublisher.add(state); });
+        return;
+    }
+    #endif
+    WiFi.mode(WIFI_OFF);
+    #if defined(ESP8266)
+    WiFi.forceSleepBegin();
+    #endif
+}
 
+// one sample, published when the radio is on, then back to sleep
+void loopBurst() {
+    batteryPoller.update();
+    bool published = false;
+    #ifdef MQTT_HOST
+    static bool reported = false;
+    if (dutyCycle.radioOn()) updateStation();
+    if (dutyCycle.radioOn() && WiFi.status() == WL_CONNECTED) {
+        mqttPublisher.update();
+        if (!reported && mqttPublisher.connected()) {
+            char report[320];
+            dutyCycle.formatReport(report, sizeof(report));
+            reported = mqttPublisher.publish("duty", report);
+        }
+        published = batteryPoller.hasSample() && reported && mqttPublisher.flushed();
+    }
+    #endif
+
+    bool done = batteryPoller.hasSample() && (published || !dutyCycle.radioOn());
+    if (done || dutyCycle.burstExpired()) dutyCycle.sleep(batteryState, batteryPoller.hasSample(), published);
+}
+#endif
 
 void setup() {
+    #if defined(ESP32)
+    bootNonce = esp_random();
+    #else
+    bootNonce = RANDOM_REG32;
+    #endif
+    for (int i = 0; i < BATTERY_PACKS; i++) {
+        packPollers[i].attach(batteryMonitor, packStates[i], i);
+    }
+    #if defined(DUTY_CYCLE_S) && DUTY_CYCLE_DEEP
+    setupBurst();
+    return;
+    #endif
+
+    // the last samples first, so the first response after a reset has numbers in it
+    fastBoot.begin();
+    for (int i = 0; i < BATTERY_PACKS; i++) {
+        if (!fastBoot.restore(i, packStates[i])) initWithFakeData(packStates[i]);
+    }
+
     #ifdef DEBUG
     Serial.begin(115200);
     Serial.println();
@@ -32,6 +195,7 @@ void setup() {
 
     #ifdef CREATE_APN
     WiFi.softAP(SSID, PASSWORD);
+    fastBoot.wifiUp(FastBoot::BOOT_WIFI_ACCESS_POINT);
     #ifdef DEBUG
     Serial.print(F("created wifi network: "));
     Serial.print(SSID);
@@ -39,30 +203,27 @@ void setup() {
     Serial.println(PASSWORD);
     #endif
     #else
-    WiFi.begin(SSID, PASSWORD);
-    while (WiFi.status() != WL_CONNECTED) {
-        delay(500);
-        #ifdef DEBUG
-        Serial.print(F("."));
-        #endif
-    }
+    #if defined(DUTY_CYCLE_S) && !DUTY_CYCLE_DEEP
+    // the modem sleeps between beacons whenever loop() does, see DutyCycle::idle()
+    dutyCycle.begin(DUTY_CYCLE_S, false, true);
+    #if defined(ESP8266)
+    WiFi.setSleepMode(WIFI_LIGHT_SLEEP);
+    #else
+    WiFi.setSleep(true);
     #endif
-
-    #ifdef DEBUG
-    Serial.println(F("WiFi connected."));
-    Serial.print(F("IP address: "));
-    Serial.println(WiFi.localIP());
+    #endif
+    // loop() polls the bus while the station associates, see updateStation()
+    beginStation();
     #endif
 
-    server.on(F("/"), handleRoot);
-    
-    server.onNotFound(handleNotFound);
+    setupRoutes();
 
     server.begin();
     #ifdef DEBUG
     Serial.println(F("HTTP server started"));
     #endif
 
+    #ifdef CREATE_APN
     if (!MDNS.begin(LOCAL_DNS_NAME)) {
         #ifdef DEBUG
         Serial.println(F("Error setting up MDNS responder!"));
@@ -73,11 +234,76 @@ void setup() {
         Serial.println(F("mDNS responder started: http://battery.local"));
         #endif
     }
+    #endif
     
-    initWithFakeData(batteryState);
+    #ifdef BUS_CAPTURE_BYTES
+    batteryMonitor.setCapture(&busCapture);
+    #endif
+    #ifdef CHARGE_RELAY_PIN
+    // first listener, the relay decision should not wait for the others
+    chargeController.begin(CHARGE_RELAY_PIN, CHARGE_RELAY_ACTIVE_LOW);
+    batteryPoller.onSample([](const BatteryState &state) { chargeController.add(state); });
+    #endif
+    batteryPoller.onSample([](const BatteryState &state) { telemetryHistory.add(state); });
+    batteryPoller.onSample([](const BatteryState &state) { packStats.add(state); });
+    flashLog.begin();
+    batteryPoller.onSample([](const BatteryState &state) { flashLog.add(state); });
+    for (int i = 0; i < FastBoot::cachedPacks; i++) {
+        // the snapshot of each poller is its entry in packStates
+        packPollers[i].onSample([](const BatteryState &state) {
+            fastBoot.store(int(&state - packStates), state);
+            fastBoot.sampled();
+        });
+    }
+    #ifdef MQTT_HOST
+    mqttPublisher.begin(MQTT_HOST, MQTT_PORT, MQTT_CLIENT_ID, MQTT_TOPIC_PREFIX);
+    batteryPoller.onSample([](const BatteryState &state) { mqttPublisher.add(state); });
+    #endif
 }
 
 void loop() {
-    server.handleClient();
-    MDNS.update();
+    #if defined(DUTY_CYCLE_S) && DUTY_CYCLE_DEEP
+    loopBurst();
+    return;
+    #endif
+
+    unsigned long started = micros();
+    #ifndef CREATE_APN
+    updateStation();
+    #endif
+    {
+        TRACE_SCOPE(TRACE_POLLER);
+        for (BatteryPoller &poller : packPollers) {
+            poller.update();
+        }
+    }
+    {
+        TRACE_SCOPE(TRACE_HTTP);
+        server.update();
+    }
+    {
+        TRACE_SCOPE(TRACE_CHARGE);
+        chargeController.update();
+    }
+    {
+        TRACE_SCOPE(TRACE_EVENTS);
+        eventHub.update(batteryState, batteryPoller.version(), batteryPoller.hasSample());
+    }
+    #ifdef MQTT_HOST
+    {
+        TRACE_SCOPE(TRACE_MQTT);
+        mqttPublisher.update();
+    }
+    #endif
+    {
+        TRACE_SCOPE(TRACE_MDNS);
+        MDNS.update();
+    }
+    unsigned long took = micros() - started;
+    loopTime.observe(took);
+    TRACE_SPAN(TRACE_LOOP, started, took);
+    #if defined(DUTY_CYCLE_S) && !DUTY_CYCLE_DEEP
+    // not with a reply on its way, it would wait out the sleep
+    if (batteryMonitor.inFlight() == 0) dutyCycle.idle(took);
+    #endif
 }
\ No newline at end of file
@@ -0,0 +1,193 @@
+#include "metrics.h"
+
+namespace {
+
+struct Scalar {
+    const char *name;
+    const char *type;
+    const char *help;
+};
+
+const Scalar scalars[] = {
+    {"bms_frames_sent_total", "counter", "requests written to the bus"},
+    {"bms_replies_total", "counter", "valid replies received"},
+    {"bms_timeouts_total", "counter", "requests without a reply in time"},
+    {"bms_crc_errors_total", "counter", "complete frames with a bad checksum"},
+    {"bms_resync_bytes_total", "counter", "bytes skipped looking for a frame start"},
+    {"bms_retries_total", "counter", "sweeps started again after a failed one"},
+    {"bms_stray_replies_total", "counter", "replies from a pack that had no request outstanding"},
+    {"bms_round_seconds", "gauge", "last round over all packs, first request to the end of the last sweep"},
+    {"bms_sweeps_total", "counter", "register sweeps by result"},
+    {"bms_sample_age_seconds", "gauge", "age of the served snapshot, -1 before the first one"},
+    {"device_uptime_seconds", "gauge", "seconds since boot"},
+    {"bms_cell_imbalance_volts", "gauge", "highest minus lowest cell voltage"},
+    {"bms_charge_ampere_hours_total", "counter", "charge integrated from the current since boot"},
+    {"bms_time_to_empty_seconds", "gauge", "at the smoothed discharge current, -1 while not discharging"},
+    {"bms_time_to_full_seconds", "gauge", "at the smoothed charge current, -1 while not charging"},
+#if defined(ESP8266) || defined(ESP32)
+    {"device_heap_free_bytes", "gauge", "free heap"},
+    {"device_heap_max_block_bytes", "gauge", "largest allocatable block"},
+#endif
+};
+const uint8_t scalarCount = sizeof(scalars) / sizeof(scalars[0]);
+
+int writeSeconds(char *buf, size_t size, uint64_t us) {
+    return snprintf(buf, size, "%lu.%06lu", (unsigned long) (us / 1000000), (unsigned long) (us % 1000000));
+}
+
+}
+
+
+MetricsSource::MetricsSource(const BatteryMonitor &_monitor, const BatteryPoller &_poller, const PackStats &_stats,
+                             const LatencyHistogram &_loopTime) {
+    monitor = &_monitor;
+    poller = &_poller;
+    stats = &_stats;
+    loopTime = &_loopTime;
+}
+
+size_t MetricsSource::writeScalar(char *line, size_t size, uint8_t index) {
+    const Scalar &s = scalars[index];
+    int len = snprintf(line, size, "# HELP %s %s\n# TYPE %s %s\n", s.name, s.help, s.name, s.type);
+    if (len < 0 || size_t(len) >= size) return 0;
+    char *out = line + len;
+    size_t room = size - len;
+
+    unsigned long value = 0;
+    switch (index) {
+        case 0: value = monitor->framesSent(); break;
+        case 1: value = monitor->replies(); break;
+        case 2: value = monitor->timeouts(); break;
+        case 3: value = monitor->crcErrors(); break;
+        case 4: value = monitor->resyncs(); break;
+        case 5: value = poller->retries(); break;
+        case 6: value = monitor->strays(); break;
+        case 7: {
+            int n = snprintf(out, room, "%s ", s.name);
+            if (n < 0 || size_t(n) >= room) return 0;
+            int m = writeSeconds(out + n, room - n, uint64_t(monitor->roundMs()) * 1000);
+            if (m < 0 || size_t(n + m + 1) >= room) return 0;
+            out[n + m] = '\n';
+            return len + n + m + 1;
+        }
+        case 8: {
+            int n = snprintf(out, room, "%s{result=\"ok\"} %lu\n%s{result=\"error\"} %lu\n", s.name,
+                             (unsigned long) poller->sweeps(), s.name, (unsigned long) poller->failedSweeps());
+            return n < 0 ? 0 : std::min(size_t(len + n), size - 1);
+        }
+        case 9: {
+            int n = snprintf(out, room, "%s ", s.name);
+            if (n < 0 || size_t(n) >= room) return 0;
+            int m = poller->hasSample() ? writeSeconds(out + n, room - n, uint64_t(poller->ageMs()) * 1000)
+                                        : snprintf(out + n, room - n, "-1");
+            if (m < 0 || size_t(n + m + 1) >= room) return 0;
+            out[n + m] = '\n';
+            return len + n + m + 1;
+        }
+        case 10: value = millis() / 1000; break;
+        case 11: {
+            int n = snprintf(out, room, "%s %d.%03d\n", s.name, stats->imbalance() / 1000, stats->imbalance() % 1000);
+            return n < 0 ? 0 : std::min(size_t(len + n), size - 1);
+        }
+        case 12: {
+            long in = stats->chargedMah();
+            long drawn = stats->dischargedMah();
+            int n = snprintf(out, room, "%s{direction=\"in\"} %ld.%03ld\n%s{direction=\"out\"} %ld.%03ld\n", s.name,
+                             in / 1000, in % 1000, s.name, drawn / 1000, drawn % 1000);
+            return n < 0 ? 0 : std::min(size_t(len + n), size - 1);
+        }
+        case 13:
+        case 14: {
+            long seconds = index == 13 ? stats->timeToEmptyS() : stats->timeToFullS();
+            int n = snprintf(out, room, "%s %ld\n", s.name, seconds);
+            return n < 0 ? 0 : std::min(size_t(len + n), size - 1);
+        }
+#if defined(ESP8266)
+        case 15: value = ESP.getFreeHeap(); break;
+        case 16: value = ESP.getMaxFreeBlockSize(); break;
+#elif defined(ESP32)
+        case 15: value = ESP.getFreeHeap(); break;
+        case 16: value = ESP.getMaxAllocHeap(); break;
+#endif
+        default: break;
+    }
+    int n = snprintf(out, room, "%s %lu\n", s.name, value);
+
+    return n < 0 ? 0 : std::min(size_t(len + n), size - 1);
+}
+
+bool MetricsSource::writeHistogram(char *line, size_t size, int &len, const char *name, const char *help,
+                                   const char *labels, const LatencyHistogram &histogram, bool header) {
+    len = 0;
+    if (header && bucket == 0) {
+        len = snprintf(line, size, "# HELP %s %s\n# TYPE %s histogram\n", name, help, name);
+        if (len < 0 || size_t(len) >= size) return true;
+    }
+    const char *sep = labels[0] != '\0' ? "," : "";
+
+    if (bucket <= LatencyHistogram::buckets) {
+        if (bucket == 0) cumulative = 0;
+        cumulative += histogram.bucket(bucket);
+        int n = snprintf(line + len, size - len, "%s_bucket{%s%sle=\"", name, labels, sep);
+        if (n < 0) return true;
+        len += n;
+        if (bucket < LatencyHistogram::buckets) n = writeSeconds(line + len, size - len, LatencyHistogram::boundUs(bucket));
+        else n = snprintf(line + len, size - len, "+Inf");
+        if (n < 0) return true;
+        len += n;
+        n = snprintf(line + len, size - len, "\"} %lu\n", (unsigned long) cumulative);
+        if (n < 0) return true;
+        len += n;
+        bucket++;
+        return false;
+    }
+
+    int n = snprintf(line + len, size - len, "%s_sum%s%s%s ", name, labels[0] ? "{" : "", labels, labels[0] ? "}" : "");
+    if (n < 0) return true;
+    len += n;
+    n = writeSeconds(line + len, size - len, histogram.sumUs());
+    if (n < 0) return true;
+    len += n;
+    n = snprintf(line + len, size - len, "\n%s_count%s%s%s %lu\n", name, labels[0] ? "{" : "", labels,
+                 labels[0] ? "}" : "", (unsigned long) histogram.count());
+    if (n >= 0) len += n;
+    bucket = 0;
+    return true;
+}
+
+size_t MetricsSource::nextRecord(char *line, size_t size) {
+    int len = 0;
+    switch (part) {
+        case PART_SCALARS:
+            len = writeScalar(line, size, item);
+            if (++item >= scalarCount) part = PART_ROUNDTRIP;
+            break;
+        case PART_ROUNDTRIP: {
+            // empty series are left out: the keyed ones not in use yet would all be
+            // register="other" next to the catch-all, and prometheus rejects repeated label sets
+            if (bucket == 0) {
+                while (series < BatteryMonitor::latencySeries && monitor->latency(series).count() == 0) series++;
+                if (series >= BatteryMonitor::latencySeries) {
+                    part = PART_LOOP;
+                    return nextRecord(line, size);
+                }
+            }
+            char labels[24];
+            int reg = monitor->latencyRegister(series);
+            if (reg < 0) snprintf(labels, sizeof(labels), "register=\"other\"");
+            else snprintf(labels, sizeof(labels), "register=\"0x%02x\"", reg);
+            if (writeHistogram(line, size, len, "bms_roundtrip_seconds", "request to reply time", labels, monitor->latency(series), !roundTripHeader)) {
+                roundTripHeader = true;
+                if (++series >= BatteryMonitor::latencySeries) part = PART_LOOP;
+            }
+            break;
+        }
+        case PART_LOOP:
+            if (writeHistogram(line, size, len, "device_loop_seconds", "duration of one loop() pass", "", *loopTime, true)) part = PART_DONE;
+            break;
+        default:
+            return 0;
+    }
+
+    return (len < 0) ? 0 : std::min(size_t(len), size - 1);
+}
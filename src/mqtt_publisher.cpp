@@ -0,0 +1,355 @@
+#include "mqtt_publisher.h"
+#include "config.h"
+#include "state_json.h"
+
+namespace {
+
+const char *const fieldTopics[MqttPublisher::FIELD_COUNT] = {
+    "status", "perc", "remaining", "voltage", "current", "power", "temp0", "temp1", "cells", "serial", "error",
+};
+
+// smallest change worth a message in BatteryState units (mV, mA, mW), 0 = any
+// change. cells use cellDeadband
+const int32_t deadbands[MqttPublisher::FIELD_COUNT] = {
+    0, 1, 10, 20, 50, 500, 1, 1, 0, 0, 0,
+};
+const int16_t cellDeadband = 5; // mV
+
+const unsigned long backoffMinMs = 1000;
+const unsigned long backoffMaxMs = 60000;
+const unsigned long connectTimeoutMs = 10000;
+const unsigned long connackTimeoutMs = 5000;
+
+const uint8_t PACKET_CONNECT = 0x10;
+const uint8_t PACKET_CONNACK = 0x20;
+const uint8_t PACKET_PUBLISH = 0x30;
+const uint8_t PACKET_PINGREQ = 0xC0;
+const uint8_t PACKET_PINGRESP = 0xD0;
+
+// mqtt "remaining length", 7 bits per byte, returns bytes used
+size_t putLength(uint8_t *out, size_t len) {
+    size_t n = 0;
+    do {
+        uint8_t b = len & 0x7F;
+        len >>= 7;
+        out[n++] = len > 0 ? (b | 0x80) : b;
+    } while (len > 0);
+    return n;
+}
+
+size_t putString(uint8_t *out, const char *s, size_t len) {
+    out[0] = uint8_t(len >> 8);
+    out[1] = uint8_t(len);
+    memcpy(out + 2, s, len);
+    return len + 2;
+}
+
+}
+
+
+void MqttPublisher::begin(const char *_host, uint16_t _port, const char *_clientId, const char *_prefix) {
+    host = _host;
+    port = _port;
+    clientId = _clientId;
+    prefix = _prefix;
+    backoffMs = 0;
+    enter(MQTT_IDLE);
+}
+
+void MqttPublisher::numericFields(const BatteryState &state, int32_t *out) {
+    out[FIELD_STATUS] = state.status;
+    out[FIELD_PERC] = state.remaining_capacity_perc;
+    out[FIELD_REMAINING] = state.remaining_capacity;
+    out[FIELD_VOLTAGE] = state.voltage_mv;
+    out[FIELD_CURRENT] = state.current_ma;
+    out[FIELD_POWER] = state.power_mw;
+    out[FIELD_TEMP0] = state.temp_zone0;
+    out[FIELD_TEMP1] = state.temp_zone1;
+}
+
+bool MqttPublisher::differs(const BatteryState &from, const BatteryState &to) {
+    int32_t a[FIELD_COUNT];
+    int32_t b[FIELD_COUNT];
+    numericFields(from, a);
+    numericFields(to, b);
+    for (int f = FIELD_STATUS; f <= FIELD_TEMP1; f++) {
+        int32_t moved = abs(b[f] - a[f]);
+        if (moved > 0 && moved >= deadbands[f]) return true;
+    }
+    for (size_t i = 0; i < from.cells.size(); i++) {
+        if (abs(to.cells[i] - from.cells[i]) >= cellDeadband) return true;
+    }
+
+    return strcmp(from.serial, to.serial) != 0 || from.error != to.error;
+}
+
+void MqttPublisher::add(const BatteryState &state) {
+    numericFields(state, value);
+    for (int f = FIELD_STATUS; f <= FIELD_TEMP1; f++) {
+        int32_t moved = abs(value[f] - published[f]);
+        if (!(everPublished & (1UL << f)) || (moved > 0 && moved >= deadbands[f])) queue(Field(f));
+    }
+
+    cells = state.cells;
+    bool cellsMoved = !(everPublished & (1UL << FIELD_CELLS));
+    for (size_t i = 0; i < cells.size(); i++) {
+        if (abs(cells[i] - publishedCells[i]) >= cellDeadband) cellsMoved = true;
+    }
+    if (cellsMoved) queue(FIELD_CELLS);
+
+    if (strcmp(state.serial, serial) != 0 || !(everPublished & (1UL << FIELD_SERIAL))) {
+        memcpy(serial, state.serial, sizeof(serial));
+        queue(FIELD_SERIAL);
+    }
+    if (state.error != error || !(everPublished & (1UL << FIELD_ERROR))) {
+        error = state.error;
+        queue(FIELD_ERROR);
+    }
+}
+
+void MqttPublisher::queue(Field field) {
+    if (dirty & (1UL << field)) replaced++;
+    dirty |= 1UL << field;
+}
+
+void MqttPublisher::update() {
+    if (host == nullptr) return;
+    unsigned long now = millis();
+
+    switch (state) {
+    case MQTT_IDLE:
+        if (now - stateSince < backoffMs) return;
+        if (!link.connect(host, port)) {
+            fail();
+            return;
+        }
+        enter(MQTT_TCP_CONNECTING);
+        return;
+
+    case MQTT_TCP_CONNECTING:
+        if (link.connected()) {
+            rxInHeader = true;
+            rxPos = 0;
+            if (sendConnect()) enter(MQTT_WAIT_CONNACK);
+        } else if (!link.connecting() || now - stateSince > connectTimeoutMs) {
+            fail();
+        }
+        return;
+
+    case MQTT_WAIT_CONNACK:
+        receive();
+        if (state == MQTT_WAIT_CONNACK && now - stateSince > connackTimeoutMs) fail();
+        return;
+
+    case MQTT_CONNECTED:
+        break;
+    }
+
+    if (!link.connected()) {
+        fail();
+        return;
+    }
+    receive();
+    if (state != MQTT_CONNECTED) return;
+
+    if (now - lastSent >= MQTT_KEEPALIVE_S * 1000UL) {
+        // the broker had a whole keepalive period to answer the last ping
+        if (pingPending) {
+            fail();
+            return;
+        }
+        if (!sendPing()) return;
+    }
+
+    if (now - lastRefresh >= MQTT_REFRESH_S * 1000UL) {
+        lastRefresh = now;
+        dirty |= everPublished;
+    }
+
+    // oldest field first would need timestamps, field order is good enough
+    while (dirty != 0 && state == MQTT_CONNECTED) {
+        int field = 0;
+        while (!(dirty & (1UL << field))) field++;
+        if (!sendField(Field(field))) break;
+    }
+}
+
+void MqttPublisher::enter(State next) {
+    state = next;
+    stateSince = millis();
+}
+
+void MqttPublisher::fail() {
+    link.close();
+    pingPending = false;
+    backoffMs = backoffMs == 0 ? backoffMinMs : backoffMs * 2;
+    if (backoffMs > backoffMaxMs) backoffMs = backoffMaxMs;
+    enter(MQTT_IDLE);
+    #ifdef DEBUG
+    Serial.print(F("mqtt: disconnected, retry in "));
+    Serial.println(backoffMs);
+    #endif
+}
+
+bool MqttPublisher::sendPacket(const uint8_t *packet, size_t len) {
+    if (link.space() < len) return false;
+    size_t written = link.write(packet, len);
+    bytes += written;
+    lastSent = millis();
+    if (written != len) {
+        // half a packet on the wire, the stream can not be recovered
+        fail();
+        return false;
+    }
+    return true;
+}
+
+bool MqttPublisher::sendConnect() {
+    size_t idLen = strlen(clientId);
+    if (idLen > 23) idLen = 23; // longest id every 3.1.1 broker has to accept
+
+    uint8_t body[10 + 2 + 23] = {0x00, 0x04, 'M', 'Q', 'T', 'T', 0x04, 0x02,
+                                 uint8_t(MQTT_KEEPALIVE_S >> 8), uint8_t(MQTT_KEEPALIVE_S & 0xFF)};
+    size_t bodyLen = 10 + putString(body + 10, clientId, idLen);
+
+    uint8_t packet[5 + sizeof(body)];
+    packet[0] = PACKET_CONNECT;
+    size_t len = 1 + putLength(packet + 1, bodyLen);
+    memcpy(packet + len, body, bodyLen);
+
+    return sendPacket(packet, len + bodyLen);
+}
+
+bool MqttPublisher::sendPing() {
+    const uint8_t packet[2] = {PACKET_PINGREQ, 0};
+    if (!sendPacket(packet, sizeof(packet))) return false;
+    pingPending = true;
+
+    return true;
+}
+
+bool MqttPublisher::publish(const char *subtopic, const char *payload) {
+    if (state != MQTT_CONNECTED) return false;
+    size_t payloadLen = strlen(payload);
+    if (payloadLen > publishPayloadMax) payloadLen = publishPayloadMax;
+
+    return sendPublish(subtopic, payload, payloadLen);
+}
+
+bool MqttPublisher::flushed() {
+    return state == MQTT_CONNECTED && dirty == 0 && link.flushed();
+}
+
+bool MqttPublisher::sendPublish(const char *subtopic, const char *payload, size_t payloadLen) {
+    char topic[48];
+    int topicLen = snprintf(topic, sizeof(topic), "%s/%s", prefix, subtopic);
+    if (topicLen < 0 || size_t(topicLen) >= sizeof(topic)) topicLen = sizeof(topic) - 1;
+
+    uint8_t packet[5 + 2 + sizeof(topic) + publishPayloadMax];
+    size_t bodyLen = 2 + topicLen + payloadLen;
+    packet[0] = PACKET_PUBLISH;
+    size_t len = 1 + putLength(packet + 1, bodyLen);
+    len += putString(packet + len, topic, topicLen);
+    memcpy(packet + len, payload, payloadLen);
+    len += payloadLen;
+    if (!sendPacket(packet, len)) return false;
+    messages++;
+
+    return true;
+}
+
+bool MqttPublisher::sendField(Field field) {
+    char payload[112];
+    size_t payloadLen = formatField(field, payload, sizeof(payload));
+    if (!sendPublish(fieldTopics[field], payload, payloadLen)) return false;
+
+    dirty &= ~(1UL << field);
+    everPublished |= 1UL << field;
+    published[field] = value[field];
+    if (field == FIELD_CELLS) publishedCells = cells;
+
+    return true;
+}
+
+size_t MqttPublisher::formatField(Field field, char *buf, size_t size) const {
+    int len;
+    switch (field) {
+    case FIELD_VOLTAGE:
+    case FIELD_CURRENT:
+        len = formatFixed(buf, size, value[field], 2);
+        break;
+    case FIELD_POWER:
+        len = formatFixed(buf, size, value[field], 1);
+        break;
+    case FIELD_CELLS:
+        len = 0;
+        for (size_t i = 0; i < cells.size() && len >= 0 && size_t(len) < size; i++) {
+            int n = snprintf(buf + len, size - len, "%c%d", i == 0 ? '[' : ',', cells[i]);
+            len = n < 0 ? n : len + n;
+        }
+        if (len >= 0 && size_t(len) < size) len += snprintf(buf + len, size - len, "]");
+        break;
+    case FIELD_SERIAL:
+        len = snprintf(buf, size, "%s", serial);
+        break;
+    case FIELD_ERROR:
+        strncpy_P(buf, batteryErrorText(error), size - 1);
+        buf[size - 1] = '\0';
+        len = strlen(buf);
+        break;
+    default:
+        len = snprintf(buf, size, "%ld", long(value[field]));
+        break;
+    }
+    if (len < 0) return 0;
+
+    return size_t(len) < size ? size_t(len) : size - 1;
+}
+
+void MqttPublisher::receive() {
+    uint8_t chunk[16];
+    size_t n;
+    while ((n = link.read(chunk, link.available() < sizeof(chunk) ? link.available() : sizeof(chunk))) > 0) {
+        for (size_t i = 0; i < n; i++) {
+            uint8_t b = chunk[i];
+            if (rxInHeader) {
+                if (rxPos == 0) {
+                    rxType = b & 0xF0;
+                    rxRemaining = 0;
+                    rxLenShift = 0;
+                    rxPos = 1;
+                    continue;
+                }
+                rxRemaining |= uint32_t(b & 0x7F) << rxLenShift;
+                rxLenShift += 7;
+                if (b & 0x80) continue;
+                rxInHeader = false;
+                rxPos = 0;
+                if (rxRemaining > 0) continue;
+            } else {
+                if (rxPos < sizeof(rxBody)) rxBody[rxPos] = b;
+                if (++rxPos < rxRemaining) continue;
+            }
+
+            // whole packet, only the connack and ping replies matter for qos 0
+            rxInHeader = true;
+            rxPos = 0;
+            if (rxType == PACKET_CONNACK && state == MQTT_WAIT_CONNACK) {
+                if (rxRemaining < 2 || rxBody[1] != 0) {
+                    fail();
+                    return;
+                }
+                connects++;
+                backoffMs = 0;
+                lastRefresh = millis();
+                dirty |= everPublished; // subscribers that came up meanwhile get everything once
+                enter(MQTT_CONNECTED);
+                #ifdef DEBUG
+                Serial.println(F("mqtt: connected"));
+                #endif
+            } else if (rxType == PACKET_PINGRESP) {
+                pingPending = false;
+            }
+        }
+    }
+}
@@ -0,0 +1,54 @@
+#include <chrono>
+#include <cstdlib>
+#include <thread>
+#include "native/arduino_shim.h"
+
+static const auto started = std::chrono::steady_clock::now();
+static bool virtualClock = false;
+static unsigned long virtualUs = 0;
+
+void setVirtualMicros(unsigned long us) {
+    virtualClock = true;
+    virtualUs = us;
+}
+
+unsigned long millis() {
+    if (virtualClock) return virtualUs / 1000;
+    return std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - started).count();
+}
+
+unsigned long micros() {
+    if (virtualClock) return virtualUs;
+    return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - started).count();
+}
+
+void delay(unsigned long ms) {
+    if (virtualClock) {
+        virtualUs += ms * 1000;
+        return;
+    }
+    std::this_thread::sleep_for(std::chrono::milliseconds(ms));
+}
+
+void yield() {
+    std::this_thread::yield();
+}
+
+void panic() {
+    abort();
+}
+
+void pinMode(uint8_t, uint8_t) {
+}
+
+void digitalWrite(uint8_t pin, uint8_t value) {
+    static int8_t levels[64];
+    static bool known[64];
+    if (pin < 64 && known[pin] && levels[pin] == value) return;
+    if (pin < 64) {
+        known[pin] = true;
+        levels[pin] = value;
+    }
+    printf("gpio %u -> %s\n", pin, value ? "HIGH" : "LOW");
+    fflush(stdout);
+}
@@ -0,0 +1,35 @@
+#include <unistd.h>
+#include "duty_cycle.h"
+
+// rtc memory is a file that outlives the process, deep sleep is a sleep and a
+// fresh start of the same binary, so millis() and everything in RAM reset
+static const char *rtcPath() {
+    const char *path = getenv("DUTY_RTC");
+    return path ? path : "/tmp/bms_rtc";
+}
+
+bool DutyCycle::loadRtc() {
+    FILE *file = fopen(rtcPath(), "rb");
+    if (file == nullptr) return false;
+    bool ok = fread(&rtc, sizeof(rtc), 1, file) == 1;
+    fclose(file);
+
+    return ok;
+}
+
+void DutyCycle::storeRtc() {
+    FILE *file = fopen(rtcPath(), "wb");
+    if (file == nullptr) return;
+    fwrite(&rtc, sizeof(rtc), 1, file);
+    fclose(file);
+}
+
+void DutyCycle::powerDown(uint32_t ms, bool radioOnWake) {
+    printf("deep sleep %u ms, radio %s on wake\n", ms, radioOnWake ? "on" : "off");
+    fflush(stdout);
+    usleep(useconds_t(ms) * 1000);
+    // a reset drops every connection and the serial port with it
+    for (int fd = 3; fd < 256; fd++) close(fd);
+    execl("/proc/self/exe", "native_fw", static_cast<char *>(nullptr));
+    panic();
+}
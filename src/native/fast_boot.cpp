@@ -0,0 +1,23 @@
+#include "fast_boot.h"
+
+// rtc memory is a file that outlives the process, like DUTY_RTC for the duty cycle
+static const char *rtcPath() {
+    const char *path = getenv("BOOT_RTC");
+    return path ? path : "/tmp/bms_boot";
+}
+
+bool FastBoot::loadRtc() {
+    FILE *file = fopen(rtcPath(), "rb");
+    if (file == nullptr) return false;
+    bool ok = fread(&rtc, sizeof(rtc), 1, file) == 1;
+    fclose(file);
+
+    return ok;
+}
+
+void FastBoot::storeRtc() {
+    FILE *file = fopen(rtcPath(), "wb");
+    if (file == nullptr) return;
+    fwrite(&rtc, sizeof(rtc), 1, file);
+    fclose(file);
+}
@@ -0,0 +1,82 @@
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include "native/fs_shim.h"
+
+NativeFS LittleFS;
+
+size_t File::write(const uint8_t *buf, size_t len) {
+    return file ? fwrite(buf, 1, len, file.get()) : 0;
+}
+
+size_t File::read(uint8_t *buf, size_t len) {
+    return file ? fread(buf, 1, len, file.get()) : 0;
+}
+
+bool File::seek(uint32_t pos, SeekMode mode) {
+    int whence = mode == SeekCur ? SEEK_CUR : (mode == SeekEnd ? SEEK_END : SEEK_SET);
+    return file && fseek(file.get(), pos, whence) == 0;
+}
+
+size_t File::position() const {
+    return file ? ftell(file.get()) : 0;
+}
+
+size_t File::size() const {
+    if (!file) return 0;
+    fflush(file.get());
+    struct stat info{};
+    return fstat(fileno(file.get()), &info) == 0 ? info.st_size : 0;
+}
+
+bool File::truncate(uint32_t size) {
+    if (!file) return false;
+    fflush(file.get());
+    return ftruncate(fileno(file.get()), size) == 0;
+}
+
+void File::flush() {
+    if (file) fflush(file.get());
+}
+
+bool NativeFS::begin() {
+    const char *dir = getenv("FLASH_FS_ROOT");
+    root = dir ? dir : "/tmp/flashfs";
+    ::mkdir(root.c_str(), 0755);
+
+    return true;
+}
+
+File NativeFS::open(const String &path, const char *mode) {
+    // same modes as the esp: "r", "w", "a", plus "r+" for in place fixes
+    FILE *raw = fopen(full(path).c_str(), strcmp(mode, "r") == 0 ? "rb" : (strcmp(mode, "r+") == 0 ? "r+b" : (strcmp(mode, "a") == 0 ? "ab" : "wb")));
+    if (raw == nullptr) return File();
+
+    return File(std::shared_ptr<FILE>(raw, fclose), path);
+}
+
+bool NativeFS::exists(const String &path) {
+    return access(full(path).c_str(), F_OK) == 0;
+}
+
+bool NativeFS::remove(const String &path) {
+    return unlink(full(path).c_str()) == 0;
+}
+
+bool NativeFS::mkdir(const String &path) {
+    return ::mkdir(full(path).c_str(), 0755) == 0;
+}
+
+Dir NativeFS::openDir(const String &path) {
+    std::vector<String> names;
+    DIR *dir = opendir(full(path).c_str());
+    if (dir != nullptr) {
+        while (dirent *entry = readdir(dir)) {
+            if (entry->d_name[0] != '.') names.push_back(entry->d_name);
+        }
+        closedir(dir);
+    }
+
+    return Dir(names);
+}
@@ -0,0 +1,100 @@
+// posix transport of HttpServer: non-blocking sockets polled from update()
+#include <arpa/inet.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "http_server.h"
+
+static const char busy[] = "HTTP/1.1 503 Service Unavailable\r\nContent-Length: 0\r\nRetry-After: 1\r\nConnection: close\r\n\r\n";
+
+void HttpServer::listen() {
+    listenFd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+    sockaddr_in addr{};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_ANY);
+    addr.sin_port = htons(port);
+    if (bind(listenFd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || ::listen(listenFd, 64) != 0) {
+        fprintf(stderr, "cannot listen on port %d\n", port);
+        close(listenFd);
+        listenFd = -1;
+        return;
+    }
+    fcntl(listenFd, F_SETFL, O_NONBLOCK);
+}
+
+void HttpServer::poll() {
+    if (listenFd < 0) return;
+
+    int fd;
+    while ((fd = accept(listenFd, nullptr, nullptr)) >= 0) {
+        fcntl(fd, F_SETFL, O_NONBLOCK);
+        Connection *conn = claimConnection();
+        if (conn == nullptr) {
+            ::send(fd, busy, sizeof(busy) - 1, MSG_NOSIGNAL | MSG_DONTWAIT);
+            close(fd);
+            continue;
+        }
+        conn->fd = fd;
+        applyNoDelay(*conn);
+    }
+
+    for (Connection &conn : conns) {
+        if (conn.state == CONN_FREE || conn.gone) continue;
+        if (conn.state == CONN_CLOSING) {
+            close(conn.fd);
+            conn.fd = -1;
+            conn.gone = true;
+            continue;
+        }
+
+        // only a connection waiting for its request reads, the others just look for a close
+        uint8_t buf[512];
+        ssize_t n = conn.state == CONN_REQUEST ? recv(conn.fd, buf, sizeof(buf), MSG_DONTWAIT)
+                                               : recv(conn.fd, buf, 1, MSG_DONTWAIT | MSG_PEEK);
+        if (n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK)) {
+            close(conn.fd);
+            conn.fd = -1;
+            conn.gone = true;
+        } else if (n > 0 && conn.state == CONN_REQUEST) {
+            parse(conn, buf, size_t(n));
+        }
+    }
+}
+
+size_t HttpServer::transmit(Connection &conn, const char *data, size_t len) {
+    if (conn.fd < 0) return 0;
+    ssize_t n = ::send(conn.fd, data, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n >= 0) return size_t(n);
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+        close(conn.fd);
+        conn.fd = -1;
+        conn.gone = true;
+    }
+    return 0;
+}
+
+void HttpServer::disconnect(Connection &conn, bool abort) {
+    conn.state = CONN_CLOSING;
+    if (conn.fd < 0) {
+        conn.gone = true;
+        return;
+    }
+    if (abort) {
+        linger reset{1, 0};
+        setsockopt(conn.fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+    }
+    close(conn.fd);
+    conn.fd = -1;
+    conn.gone = true;
+}
+
+void HttpServer::applyNoDelay(Connection &conn) {
+    int flag = conn.noDelay ? 1 : 0;
+    if (conn.fd >= 0) setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &flag, sizeof(flag));
+}
@@ -0,0 +1,161 @@
+// host build of the firmware: same poller and web routes as main.cpp, talking
+// to a real adapter or tools/bms_sim.py through BMS_PORT (default /tmp/bms)
+#include <stdlib.h>
+#include <random>
+#include "battery.h"
+#include "config.h"
+#include "site.hpp"
+#include "mqtt_publisher.h"
+#include "fast_boot.h"
+
+static const char *bmsPort() {
+    const char *port = getenv("BMS_PORT");
+    return port ? port : "/tmp/bms";
+}
+
+PosixSerial bmsSerial(bmsPort());
+HttpServer server(NATIVE_HTTP_PORT);
+BatteryMonitor batteryMonitor(bmsSerial, false);
+BatteryState packStates[BATTERY_PACKS];
+BatteryPoller packPollers[BATTERY_PACKS];
+// pack 0 feeds history, statistics, events, mqtt and the charge limit
+BatteryState &batteryState = packStates[0];
+BatteryPoller &batteryPoller = packPollers[0];
+TelemetryHistory telemetryHistory;
+FlashLog flashLog;
+EventHub eventHub;
+LatencyHistogram loopTime;
+MqttPublisher mqttPublisher;
+ChargeController chargeController(batteryPoller);
+PackStats packStats(batteryPoller);
+DutyCycle dutyCycle;
+FastBoot fastBoot;
+#ifdef BUS_CAPTURE_BYTES
+static uint8_t captureRing[BUS_CAPTURE_BYTES];
+BusCapture busCapture(captureRing, sizeof(captureRing));
+#endif
+
+// DUTY_CYCLE_S in the environment: deep duty cycle, each wake is a fresh start
+// of this binary with the state in DUTY_RTC, see DutyCycle
+static int runBursts(uint32_t cycleS) {
+    bool radio = getenv("MQTT_HOST") != nullptr;
+    dutyCycle.begin(cycleS, true, radio);
+    if (dutyCycle.resumed()) {
+        batteryState = dutyCycle.cached();
+    } else {
+        initWithFakeData(batteryState);
+    }
+    if (dutyCycle.radioOn()) {
+        mqttPublisher.begin(getenv("MQTT_HOST"), MQTT_PORT, MQTT_CLIENT_ID, MQTT_TOPIC_PREFIX);
+        batteryPoller.onSample([](const BatteryState &state) { mqttPublisher.add(state); });
+    }
+    printf("wake, radio %s, cached sample %s\n", dutyCycle.radioOn() ? "on" : "off", dutyCycle.resumed() ? "yes" : "no");
+
+    bool reported = false;
+    for (;;) {
+        batteryPoller.update();
+        bool published = false;
+        if (dutyCycle.radioOn()) {
+            mqttPublisher.update();
+            if (!reported && mqttPublisher.connected()) {
+                char report[320];
+                dutyCycle.formatReport(report, sizeof(report));
+                printf("%s\n", report);
+                reported = mqttPublisher.publish("duty", report);
+            }
+            published = batteryPoller.hasSample() && reported && mqttPublisher.flushed();
+        }
+        bool done = batteryPoller.hasSample() && (published || !dutyCycle.radioOn());
+        if (done || dutyCycle.burstExpired()) dutyCycle.sleep(batteryState, batteryPoller.hasSample(), published);
+        delay(1);
+    }
+}
+
+int main() {
+    bootNonce = std::random_device{}();
+    for (int i = 0; i < BATTERY_PACKS; i++) {
+        packPollers[i].attach(batteryMonitor, packStates[i], i);
+    }
+    const char *cycle = getenv("DUTY_CYCLE_S");
+    if (cycle != nullptr) return runBursts(uint32_t(atoi(cycle)));
+
+    setupRoutes();
+    server.begin();
+    #ifdef BUS_CAPTURE_BYTES
+    batteryMonitor.setCapture(&busCapture);
+    #endif
+    // BOOT_RTC in the environment stands in for rtc memory, a restart of the binary is a warm start
+    fastBoot.begin();
+    fastBoot.wifiUp(FastBoot::BOOT_WIFI_NONE);
+    for (int i = 0; i < BATTERY_PACKS; i++) {
+        if (!fastBoot.restore(i, packStates[i])) initWithFakeData(packStates[i]);
+    }
+    // relay pin from the environment, gpio writes are printed
+    const char *relayPin = getenv("CHARGE_RELAY_PIN");
+    if (relayPin != nullptr) {
+        chargeController.begin(uint8_t(atoi(relayPin)), CHARGE_RELAY_ACTIVE_LOW);
+        batteryPoller.onSample([](const BatteryState &state) { chargeController.add(state); });
+    }
+    batteryPoller.onSample([](const BatteryState &state) { telemetryHistory.add(state); });
+    batteryPoller.onSample([](const BatteryState &state) { packStats.add(state); });
+    flashLog.begin();
+    batteryPoller.onSample([](const BatteryState &state) { flashLog.add(state); });
+    for (int i = 0; i < FastBoot::cachedPacks; i++) {
+        // the snapshot of each poller is its entry in packStates
+        packPollers[i].onSample([](const BatteryState &state) {
+            fastBoot.store(int(&state - packStates), state);
+            fastBoot.sampled();
+        });
+    }
+    // the broker comes from the environment here, MQTT_HOST=localhost for tools/mqtt_sink.py
+    const char *mqttHost = getenv("MQTT_HOST");
+    if (mqttHost != nullptr) {
+        mqttPublisher.begin(mqttHost, MQTT_PORT, MQTT_CLIENT_ID, MQTT_TOPIC_PREFIX);
+        batteryPoller.onSample([](const BatteryState &state) { mqttPublisher.add(state); });
+    }
+    printf("polling %s, http://localhost:%d\n", bmsPort(), NATIVE_HTTP_PORT);
+
+    uint32_t reported = batteryPoller.version();
+    unsigned long maxLoopUs = 0;
+    for (;;) {
+        unsigned long started = micros();
+        {
+            TRACE_SCOPE(TRACE_POLLER);
+            for (BatteryPoller &poller : packPollers) {
+                poller.update();
+            }
+        }
+        {
+            TRACE_SCOPE(TRACE_HTTP);
+            server.update();
+        }
+        {
+            TRACE_SCOPE(TRACE_CHARGE);
+            chargeController.update();
+        }
+        {
+            TRACE_SCOPE(TRACE_EVENTS);
+            eventHub.update(batteryState, batteryPoller.version(), batteryPoller.hasSample());
+        }
+        {
+            TRACE_SCOPE(TRACE_MQTT);
+            mqttPublisher.update();
+        }
+        unsigned long took = micros() - started;
+        loopTime.observe(took);
+        TRACE_SPAN(TRACE_LOOP, started, took);
+        if (took > maxLoopUs) maxLoopUs = took;
+
+        if (batteryPoller.version() != reported) {
+            reported = batteryPoller.version();
+            printf("v%u sweep %lu ms, round %lu ms, max loop %lu us, mqtt %u msgs %u bytes, sse %u clients %u frames, "
+                   "http %u requests %u rejected %u timeouts, %s\n",
+                   reported, batteryPoller.sweepMs(), batteryMonitor.roundMs(), maxLoopUs, mqttPublisher.messagesSent(),
+                   mqttPublisher.bytesSent(), eventHub.clientCount(), eventHub.framesSent(), server.requests(),
+                   server.rejected(), server.timeouts(), batteryErrorText(batteryState.error));
+            fflush(stdout);
+            maxLoopUs = 0;
+        }
+        delay(1);
+    }
+}
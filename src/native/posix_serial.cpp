@@ -0,0 +1,61 @@
+#include <fcntl.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+#include "native/posix_serial.h"
+
+PosixSerial::PosixSerial(const char *_path) {
+    path = _path;
+}
+
+PosixSerial::~PosixSerial() {
+    if (fd >= 0) close(fd);
+}
+
+static speed_t baudConstant(unsigned long baud) {
+    switch (baud) {
+        case 9600: return B9600;
+        case 19200: return B19200;
+        case 38400: return B38400;
+        case 57600: return B57600;
+        default: return B115200;
+    }
+}
+
+void PosixSerial::begin(unsigned long baud) {
+    if (fd >= 0) close(fd);
+    fd = open(path, O_RDWR | O_NOCTTY | O_NONBLOCK);
+    if (fd < 0) {
+        fprintf(stderr, "cannot open %s\n", path);
+        return;
+    }
+
+    termios tio{};
+    if (tcgetattr(fd, &tio) == 0) {
+        cfmakeraw(&tio);
+        cfsetispeed(&tio, baudConstant(baud));
+        cfsetospeed(&tio, baudConstant(baud));
+        tcsetattr(fd, TCSANOW, &tio);
+    }
+}
+
+int PosixSerial::available() {
+    int count = 0;
+    if (fd < 0 || ioctl(fd, FIONREAD, &count) != 0) return 0;
+
+    return count;
+}
+
+int PosixSerial::read() {
+    uint8_t value;
+    if (fd < 0 || ::read(fd, &value, 1) != 1) return -1;
+
+    return value;
+}
+
+size_t PosixSerial::write(const uint8_t *buf, size_t len) {
+    if (fd < 0) return 0;
+    ssize_t written = ::write(fd, buf, len);
+
+    return written < 0 ? 0 : size_t(written);
+}
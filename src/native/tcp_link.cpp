@@ -0,0 +1,104 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <netdb.h>
+#include <poll.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <unistd.h>
+#include "tcp_link.h"
+
+TcpLink::TcpLink() = default;
+
+TcpLink::~TcpLink() {
+    close();
+}
+
+bool TcpLink::connect(const char *host, uint16_t port) {
+    close();
+
+    // name lookup blocks, fine for the host build
+    addrinfo hints{};
+    hints.ai_family = AF_INET;
+    hints.ai_socktype = SOCK_STREAM;
+    addrinfo *result = nullptr;
+    char service[8];
+    snprintf(service, sizeof(service), "%u", port);
+    if (getaddrinfo(host, service, &hints, &result) != 0 || result == nullptr) return false;
+
+    fd = socket(result->ai_family, result->ai_socktype | SOCK_NONBLOCK, 0);
+    int rc = fd < 0 ? -1 : ::connect(fd, result->ai_addr, result->ai_addrlen);
+    freeaddrinfo(result);
+    if (rc != 0 && errno != EINPROGRESS) {
+        close();
+        return false;
+    }
+    pending = true;
+
+    return true;
+}
+
+bool TcpLink::connecting() {
+    if (!pending) return false;
+
+    pollfd p = {fd, POLLOUT, 0};
+    if (poll(&p, 1, 0) <= 0) return true;
+    int error = 0;
+    socklen_t len = sizeof(error);
+    getsockopt(fd, SOL_SOCKET, SO_ERROR, &error, &len);
+    pending = false;
+    if (error != 0) close();
+
+    return false;
+}
+
+bool TcpLink::connected() {
+    return fd >= 0 && !connecting();
+}
+
+size_t TcpLink::space() {
+    if (!connected()) return 0;
+    pollfd p = {fd, POLLOUT, 0};
+
+    return poll(&p, 1, 0) > 0 && (p.revents & POLLOUT) ? 1460 : 0;
+}
+
+size_t TcpLink::write(const uint8_t *data, size_t len) {
+    if (!connected()) return 0;
+    ssize_t n = send(fd, data, len, MSG_NOSIGNAL | MSG_DONTWAIT);
+    if (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK) close();
+
+    return n < 0 ? 0 : size_t(n);
+}
+
+bool TcpLink::flushed() {
+    if (!connected()) return false;
+    int queued = 0;
+
+    return ioctl(fd, TIOCOUTQ, &queued) == 0 && queued == 0;
+}
+
+size_t TcpLink::available() {
+    if (!connected()) return 0;
+    int count = 0;
+    if (ioctl(fd, FIONREAD, &count) != 0) return 0;
+    if (count == 0) {
+        // readable with nothing buffered means the peer closed
+        pollfd p = {fd, POLLIN, 0};
+        if (poll(&p, 1, 0) > 0 && (p.revents & (POLLIN | POLLHUP))) close();
+    }
+
+    return count;
+}
+
+size_t TcpLink::read(uint8_t *buf, size_t len) {
+    if (fd < 0) return 0;
+    ssize_t n = recv(fd, buf, len, MSG_DONTWAIT);
+
+    return n < 0 ? 0 : size_t(n);
+}
+
+void TcpLink::close() {
+    if (fd >= 0) ::close(fd);
+    fd = -1;
+    pending = false;
+}
@@ -0,0 +1,192 @@
+#include "pack_stats.h"
+#include "config.h"
+#include "state_json.h"
+
+static const uint16_t cellFields = 1 << BatteryMonitor::FIELD_CELLS_VOLTAGE;
+static const uint16_t currentFields = (1 << BatteryMonitor::FIELD_CURRENT) | (1 << BatteryMonitor::FIELD_VOLTAGE);
+static_assert(STATS_MAX_GAP_S * 1000UL < (1UL << 18), "the EWMA weight is computed in 32 bits");
+
+// Welford: one pass, no sample kept, stable where sum and sum of squares cancel.
+// x in uV, the mean in 1/65536 uV: with whole uV the steps delta / n round to
+// nothing after a few days of samples and the mean stops moving. delta * (x -
+// mean) is never negative, m2 in mV * uV holds decades of 1 Hz samples.
+static void welford(int64_t &mean, int64_t &m2, uint32_t n, int32_t x) {
+    const int shift = PackStats::meanShift;
+    int64_t delta = (int64_t(x) << shift) - mean;
+    int64_t half = n / 2; // rounded, truncating would drift the mean with the sample count
+    mean += (delta >= 0 ? delta + half : delta - half) / int64_t(n);
+    int64_t after = (int64_t(x) << shift) - mean;
+    // both in 1/256 uV, the product in 1/65536 uV^2 fits 64 bits
+    m2 += ((((delta >> (shift - 8)) * (after >> (shift - 8))) >> 16) + 500) / 1000;
+}
+
+// floor of the square root
+static uint32_t isqrt(uint64_t value) {
+    uint64_t root = 0;
+    uint64_t bit = 1ULL << 62;
+    while (bit > value) bit >>= 2;
+    while (bit != 0) {
+        if (value >= root + bit) {
+            value -= root + bit;
+            root = (root >> 1) + bit;
+        } else {
+            root >>= 1;
+        }
+        bit >>= 2;
+    }
+    return uint32_t(root);
+}
+
+// uV, sample standard deviation from m2 in mV * uV
+static int32_t stdDevUv(int64_t m2, uint32_t n) {
+    if (n < 2) return 0;
+    uint64_t div = n - 1;
+    uint64_t variance = uint64_t(m2) / div * 1000 + uint64_t(m2) % div * 1000 / div; // uV^2
+    return int32_t(isqrt(variance));
+}
+
+PackStats::PackStats(BatteryPoller &_poller) {
+    poller = &_poller;
+}
+
+void PackStats::add(const BatteryState &state) {
+    uint16_t fields = poller->lastFields();
+    if ((fields & cellFields) == cellFields) addCells(state);
+    if ((fields & currentFields) == currentFields) addCurrent(state);
+    if (state.remaining_capacity >= 0) remaining = state.remaining_capacity;
+    if (state.actual_capacity > 0) capacity = state.actual_capacity;
+}
+
+void PackStats::addCells(const BatteryState &state) {
+    int16_t low = INT16_MAX;
+    int16_t high = 0;
+    for (int16_t mv : state.cells) {
+        if (mv <= 0) return; // a cell that did not read, the whole set is left out
+        if (mv < low) low = mv;
+        if (mv > high) high = mv;
+    }
+
+    cellCount++;
+    for (size_t i = 0; i < state.cells.size(); i++) {
+        Cell &c = cells[i];
+        int16_t mv = state.cells[i];
+        if (cellCount == 1 || mv < c.min) c.min = mv;
+        if (cellCount == 1 || mv > c.max) c.max = mv;
+        welford(c.mean, c.m2, cellCount, int32_t(mv) * 1000);
+    }
+
+    spread = high - low;
+    if (spread > spreadMax) spreadMax = spread;
+    welford(spreadMean, spreadM2, cellCount, int32_t(spread) * 1000);
+}
+
+void PackStats::addCurrent(const BatteryState &state) {
+    unsigned long now = poller->sampleStartedUs();
+    int32_t current = state.current_ma;
+    if (!averaged) {
+        averaged = true;
+        currentAvg = current * (1 << avgShift);
+        powerAvg = state.power_mw * (1 << avgShift);
+        lastUs = now;
+        lastCurrent = current;
+        return;
+    }
+
+    uint32_t dtMs = (now - lastUs) / 1000;
+    lastUs += dtMs * 1000; // the remainder counts towards the next interval
+    if (dtMs > STATS_MAX_GAP_S * 1000UL) {
+        // nothing known about the current in between, start over from this sample
+        skipped++;
+        currentAvg = current * (1 << avgShift);
+        powerAvg = state.power_mw * (1 << avgShift);
+        lastCurrent = current;
+        return;
+    }
+
+    // trapezoid, an interval crossing zero is split where the line crosses
+    int64_t a = lastCurrent;
+    int64_t b = current;
+    if (a >= 0 && b >= 0) {
+        charged += (a + b) * dtMs / 2;
+    } else if (a <= 0 && b <= 0) {
+        discharged -= (a + b) * dtMs / 2;
+    } else {
+        int64_t in = a > 0 ? a : b;
+        int64_t out = a > 0 ? -b : -a;
+        charged += in * in * dtMs / (2 * (in + out));
+        discharged += out * out * dtMs / (2 * (in + out));
+    }
+    lastCurrent = current;
+
+    // time based: the same STATS_EWMA_S whether samples come every second or every ten.
+    // alpha in 1/16384, dtMs is at most STATS_MAX_GAP_S so the shift fits 32 bits
+    uint32_t alpha = (dtMs << 14) / (STATS_EWMA_S * 1000UL + dtMs);
+    currentAvg += int32_t((int64_t((current * (1 << avgShift)) - currentAvg) * alpha + (1 << 13)) >> 14);
+    powerAvg += int32_t((int64_t((state.power_mw * (1 << avgShift)) - powerAvg) * alpha + (1 << 13)) >> 14);
+}
+
+int32_t PackStats::cellMeanUv(uint8_t i) const {
+    return int32_t((cells[i].mean + (1 << (meanShift - 1))) >> meanShift);
+}
+
+int32_t PackStats::meanImbalanceUv() const {
+    return int32_t((spreadMean + (1 << (meanShift - 1))) >> meanShift);
+}
+
+int32_t PackStats::cellStdDevUv(uint8_t i) const {
+    return stdDevUv(cells[i].m2, cellCount);
+}
+
+int32_t PackStats::imbalanceStdDevUv() const {
+    return stdDevUv(spreadM2, cellCount);
+}
+
+int32_t PackStats::timeToEmptyS() const {
+    if (!averaged || remaining < 0 || currentAvg > -(STATS_MIN_CURRENT_MA * (1 << avgShift))) return -1;
+    return int32_t((int64_t(remaining) * 3600 << avgShift) / -currentAvg);
+}
+
+int32_t PackStats::timeToFullS() const {
+    if (!averaged || remaining < 0 || capacity <= 0 || currentAvg < STATS_MIN_CURRENT_MA * (1 << avgShift)) return -1;
+    int16_t missing = capacity > remaining ? capacity - remaining : 0;
+    return int32_t((int64_t(missing) * 3600 << avgShift) / currentAvg);
+}
+
+
+StatsSource::StatsSource(const PackStats &_stats) {
+    stats = &_stats;
+}
+
+size_t StatsSource::nextRecord(char *line, size_t size) {
+    int len;
+    if (item == 0) {
+        char spreadAvg[16], spreadSd[16], current[16], power[16];
+        formatFixed(spreadAvg, sizeof(spreadAvg), stats->meanImbalanceUv(), 1);
+        formatFixed(spreadSd, sizeof(spreadSd), stats->imbalanceStdDevUv(), 1);
+        formatFixed(current, sizeof(current), stats->avgCurrentMa(), 2);
+        formatFixed(power, sizeof(power), stats->avgPowerMw(), 2);
+        len = snprintf_P(line, size,
+                         PSTR("{\"samples\":%lu,\"imbalance_mv\":%d,\"imbalance_max_mv\":%d,\"imbalance_avg_mv\":%s,"
+                              "\"imbalance_sd_mv\":%s,\"charged_mah\":%ld,\"discharged_mah\":%ld,\"gaps\":%lu,"
+                              "\"current_avg\":%s,\"power_avg\":%s,\"ewma_s\":%d,\"tte_s\":%ld,\"ttf_s\":%ld,\"cells\":["),
+                         (unsigned long)stats->cellSamples(), stats->imbalance(), stats->maxImbalance(), spreadAvg,
+                         spreadSd, (long)stats->chargedMah(), (long)stats->dischargedMah(), (unsigned long)stats->gaps(),
+                         stats->hasAverage() ? current : "null", stats->hasAverage() ? power : "null", STATS_EWMA_S,
+                         (long)stats->timeToEmptyS(), (long)stats->timeToFullS());
+    } else if (item <= BATTERY_CELLS) {
+        uint8_t i = item - 1;
+        const PackStats::Cell &c = stats->cell(i);
+        char mean[16], sd[16];
+        formatFixed(mean, sizeof(mean), stats->cellMeanUv(i), 1);
+        formatFixed(sd, sizeof(sd), stats->cellStdDevUv(i), 1);
+        len = snprintf_P(line, size, PSTR("%s{\"min\":%d,\"max\":%d,\"mean\":%s,\"sd\":%s}"), i == 0 ? "" : ",",
+                         c.min, c.max, mean, sd);
+    } else if (item == BATTERY_CELLS + 1) {
+        len = snprintf_P(line, size, PSTR("]}"));
+    } else {
+        return 0;
+    }
+    item++;
+
+    return len < 0 ? 0 : std::min(size_t(len), size - 1);
+}
@@ -0,0 +1,112 @@
+#include "state_cbor.h"
+
+namespace {
+
+enum Major : uint8_t {
+    MAJOR_UINT = 0,
+    MAJOR_NEGATIVE = 1,
+    MAJOR_TEXT = 3,
+    MAJOR_ARRAY = 4,
+    MAJOR_MAP = 5,
+    MAJOR_SIMPLE = 7,
+};
+
+// appends to a fixed buffer, an overflow sticks and fails the whole item
+class CborWriter {
+public:
+    CborWriter(uint8_t *_buf, size_t _size) : buf(_buf), size(_size) {}
+
+    // shortest head for value, as the deterministic encoding wants it
+    void head(Major major, uint32_t value) {
+        uint8_t type = uint8_t(major << 5);
+        if (value < 24) {
+            put(type | value);
+        } else if (value <= 0xFF) {
+            put(type | 24);
+            put(uint8_t(value));
+        } else if (value <= 0xFFFF) {
+            put(type | 25);
+            put(uint8_t(value >> 8));
+            put(uint8_t(value));
+        } else {
+            put(type | 26);
+            for (int shift = 24; shift >= 0; shift -= 8) put(uint8_t(value >> shift));
+        }
+    }
+
+    void integer(int32_t value) {
+        // -1 - n for negatives, n does not overflow for INT32_MIN
+        if (value < 0) head(MAJOR_NEGATIVE, uint32_t(-(value + 1)));
+        else head(MAJOR_UINT, uint32_t(value));
+    }
+
+    void boolean(bool value) { put(uint8_t(MAJOR_SIMPLE << 5) | (value ? 21 : 20)); }
+
+    void text(const char *value, size_t maxLen) {
+        size_t len = strnlen(value, maxLen);
+        head(MAJOR_TEXT, uint32_t(len));
+        for (size_t i = 0; i < len; i++) {
+            // serials are ascii, anything else would break the utf-8 rule of text strings
+            char c = value[i];
+            put(c < 0x20 || c > 0x7e ? '?' : uint8_t(c));
+        }
+    }
+
+    size_t finish() const { return overflow ? 0 : pos; }
+
+private:
+    uint8_t *buf;
+    size_t size;
+    size_t pos = 0;
+    bool overflow = false;
+
+    void put(uint8_t b) {
+        if (pos < size) buf[pos++] = b;
+        else overflow = true;
+    }
+};
+
+uint8_t countBits(uint16_t mask) {
+    uint8_t n = 0;
+    for (; mask != 0; mask &= mask - 1) n++;
+    return n;
+}
+
+}
+
+size_t writeStateCbor(uint8_t *buf, size_t size, const BatteryState &state, bool sampled, uint16_t mask) {
+    mask &= cborAllKeys;
+    CborWriter out(buf, size);
+    out.head(MAJOR_MAP, countBits(mask));
+
+    for (uint8_t key = 0; key < CBOR_KEY_COUNT; key++) {
+        if (!(mask & (1 << key))) continue;
+        out.head(MAJOR_UINT, key);
+        switch (StateCborKey(key)) {
+            case CBOR_SAMPLED: out.boolean(sampled); break;
+            case CBOR_UPTIME: out.head(MAJOR_UINT, state.uptime); break;
+            case CBOR_STATUS: out.integer(state.status); break;
+            case CBOR_SERIAL: out.text(state.serial, sizeof(state.serial)); break;
+            case CBOR_PERC: out.integer(state.remaining_capacity_perc); break;
+            case CBOR_REMAINING: out.integer(state.remaining_capacity); break;
+            case CBOR_FACTORY: out.integer(state.factory_capacity); break;
+            case CBOR_ACTUAL: out.integer(state.actual_capacity); break;
+            case CBOR_CURRENT: out.integer(state.current_ma); break;
+            case CBOR_VOLTAGE: out.integer(state.voltage_mv); break;
+            case CBOR_POWER: out.integer(state.power_mw); break;
+            case CBOR_TEMP:
+                out.head(MAJOR_ARRAY, 2);
+                out.integer(state.temp_zone0);
+                out.integer(state.temp_zone1);
+                break;
+            case CBOR_CELLS:
+                out.head(MAJOR_ARRAY, uint32_t(state.cells.size()));
+                for (int16_t mv : state.cells) out.integer(mv);
+                break;
+            case CBOR_ERROR: out.integer(state.error); break;
+            default: break;
+        }
+    }
+
+    return out.finish();
+}
@@ -0,0 +1,103 @@
+#include "state_json.h"
+
+namespace {
+
+// appends src as json string body, anything outside printable ascii becomes '?'
+size_t writeEscaped(char *buf, size_t size, const char *src) {
+    size_t pos = 0;
+    for (; *src != '\0' && pos + 2 < size; src++) {
+        char c = *src;
+        if (c == '"' || c == '\\') {
+            buf[pos++] = '\\';
+        } else if (c < 0x20 || c > 0x7e) {
+            c = '?';
+        }
+        buf[pos++] = c;
+    }
+    buf[pos] = '\0';
+    return pos;
+}
+
+}
+
+int formatFixed(char *buf, size_t size, int32_t milli, uint8_t decimals) {
+    static const uint32_t scale[] = {1000, 100, 10, 1};
+    if (decimals < 1) decimals = 1;
+    if (decimals > 3) decimals = 3;
+    uint32_t divisor = scale[decimals];
+    uint32_t magnitude = milli < 0 ? uint32_t(-(milli + 1)) + 1 : uint32_t(milli);
+    magnitude = (magnitude + divisor / 2) / divisor;
+    uint32_t unit = scale[3 - decimals];
+
+    return snprintf(buf, size, "%s%lu.%0*lu", (milli < 0 && magnitude > 0) ? "-" : "",
+                    (unsigned long) (magnitude / unit), int(decimals), (unsigned long) (magnitude % unit));
+}
+
+size_t writeStateJson(char *buf, size_t size, const BatteryState &state, bool sampled) {
+    char serial[32];
+    char error[48];
+    writeEscaped(serial, sizeof(serial), state.serial);
+    strncpy_P(error, batteryErrorText(state.error), sizeof(error) - 1);
+    error[sizeof(error) - 1] = '\0';
+    int soh = (state.factory_capacity > 0) ? (state.actual_capacity * 100 / state.factory_capacity) : 0;
+    char current[16], voltage[16], power[16];
+    formatFixed(current, sizeof(current), state.current_ma, 2);
+    formatFixed(voltage, sizeof(voltage), state.voltage_mv, 2);
+    formatFixed(power, sizeof(power), state.power_mw, 2);
+
+    size_t pos = 0;
+    int len = snprintf(buf, size,
+        "{\"sampled\":%s,\"status\":%d,\"serial\":\"%s\",\"perc\":%d,\"rem\":%d,\"fac\":%d,\"act\":%d,\"soh\":%d,"
+        "\"current\":%s,\"voltage\":%s,\"power\":%s,\"temp\":[%d,%d],\"cells\":[",
+        sampled ? "true" : "false", state.status, serial, state.remaining_capacity_perc, state.remaining_capacity,
+        state.factory_capacity, state.actual_capacity, soh, current, voltage, power, state.temp_zone0, state.temp_zone1);
+    for (size_t i = 0; len >= 0 && i < state.cells.size(); i++) {
+        pos += len;
+        if (pos >= size) return 0;
+        len = snprintf(buf + pos, size - pos, i == 0 ? "%d" : ",%d", state.cells[i]);
+    }
+    if (len < 0) return 0;
+    pos += len;
+    if (pos >= size) return 0;
+    len = snprintf(buf + pos, size - pos, "],\"uptime\":%lu,\"error\":\"%s\"}", (unsigned long) state.uptime, error);
+    if (len < 0 || pos + len >= size) return 0;
+
+    return pos + len;
+}
+
+PacksSource::PacksSource(const BatteryMonitor &_monitor, const BatteryState *_states, const BatteryPoller *_pollers) {
+    monitor = &_monitor;
+    states = _states;
+    pollers = _pollers;
+}
+
+size_t PacksSource::nextRecord(char *line, size_t size) {
+    // head, then two records per pack: its timing and its state
+    int len;
+    if (item == 0) {
+        len = snprintf_P(line, size, PSTR("{\"round_ms\":%lu,\"packs\":["), monitor->roundMs());
+    } else if (item <= 2 * BATTERY_PACKS) {
+        int i = (item - 1) / 2;
+        const BatteryPoller &poller = pollers[i];
+        if (item % 2 == 1) {
+            long age = poller.hasSample() ? long(poller.ageMs()) : -1;
+            len = snprintf_P(line, size, PSTR("%s{\"address\":%u,\"sweep_ms\":%lu,\"age_ms\":%ld,\"state\":"),
+                             i == 0 ? "" : ",", monitor->packAddress(i), poller.sweepMs(), age);
+        } else {
+            size_t stateLen = writeStateJson(line, size - 1, states[i], poller.hasSample());
+            if (stateLen == 0) {
+                len = snprintf_P(line, size, PSTR("null}"));
+            } else {
+                line[stateLen] = '}';
+                len = int(stateLen + 1);
+            }
+        }
+    } else if (item == 2 * BATTERY_PACKS + 1) {
+        len = snprintf_P(line, size, PSTR("]}"));
+    } else {
+        return 0;
+    }
+    item++;
+
+    return len < 0 ? 0 : std::min(size_t(len), size - 1);
+}
@@ -0,0 +1,22 @@
+#include "stream_source.h"
+
+size_t RecordSource::read(char *buf, size_t max) {
+    size_t written = 0;
+    while (written < max) {
+        if (linePos == lineLen) {
+            if (finished) break;
+            lineLen = nextRecord(line, lineSize);
+            linePos = 0;
+            if (lineLen == 0) {
+                finished = true;
+                break;
+            }
+        }
+        size_t n = std::min(lineLen - linePos, max - written);
+        memcpy(buf + written, line + linePos, n);
+        linePos += n;
+        written += n;
+    }
+
+    return written;
+}
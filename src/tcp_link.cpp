@@ -0,0 +1,88 @@
+#ifndef NATIVE
+#include "tcp_link.h"
+
+TcpLink::TcpLink() {
+    client.onConnect([](void *arg, AsyncClient *) {
+        TcpLink *self = static_cast<TcpLink *>(arg);
+        self->pending = false;
+        self->open = true;
+    }, this);
+    client.onDisconnect([](void *arg, AsyncClient *) {
+        TcpLink *self = static_cast<TcpLink *>(arg);
+        self->pending = false;
+        self->open = false;
+    }, this);
+    client.onError([](void *arg, AsyncClient *, int8_t) {
+        TcpLink *self = static_cast<TcpLink *>(arg);
+        self->pending = false;
+    }, this);
+    client.onAck([](void *arg, AsyncClient *, size_t len, uint32_t) {
+        TcpLink *self = static_cast<TcpLink *>(arg);
+        self->unacked = len < self->unacked ? self->unacked - len : 0;
+    }, this);
+    client.onData([](void *arg, AsyncClient *, void *data, size_t len) {
+        // replies we care about are a few bytes, whatever does not fit is dropped
+        TcpLink *self = static_cast<TcpLink *>(arg);
+        const uint8_t *bytes = static_cast<const uint8_t *>(data);
+        for (size_t i = 0; i < len && self->rxHead - self->rxTail < rxSize; i++) {
+            self->rx[self->rxHead++ % rxSize] = bytes[i];
+        }
+    }, this);
+}
+
+TcpLink::~TcpLink() {
+    client.close(true);
+}
+
+bool TcpLink::connect(const char *host, uint16_t port) {
+    close();
+    rxHead = rxTail = 0;
+    pending = client.connect(host, port);
+
+    return pending;
+}
+
+bool TcpLink::connecting() {
+    return pending;
+}
+
+bool TcpLink::connected() {
+    return open && client.connected();
+}
+
+size_t TcpLink::space() {
+    return connected() && client.canSend() ? client.space() : 0;
+}
+
+size_t TcpLink::write(const uint8_t *data, size_t len) {
+    if (!connected()) return 0;
+    size_t added = client.add(reinterpret_cast<const char *>(data), len);
+    client.send();
+    unacked += added;
+
+    return added;
+}
+
+bool TcpLink::flushed() {
+    return connected() && unacked == 0;
+}
+
+size_t TcpLink::available() {
+    return rxHead - rxTail;
+}
+
+size_t TcpLink::read(uint8_t *buf, size_t len) {
+    size_t n = 0;
+    while (n < len && rxTail != rxHead) {
+        buf[n++] = rx[rxTail++ % rxSize];
+    }
+    return n;
+}
+
+void TcpLink::close() {
+    if (open || pending) client.close(true);
+    open = false;
+    pending = false;
+    unacked = 0;
+}
+#endif
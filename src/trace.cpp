@@ -0,0 +1,68 @@
+#include "trace.h"
+
+#ifdef TRACE_SPANS
+
+TraceRing traceRing;
+
+// indexed by TraceName
+static const char traceNames[TRACE_NAME_COUNT][8] PROGMEM = {
+    "loop", "poller", "http", "handler", "body", "events", "mqtt", "charge", "mdns", "bus",
+};
+
+TraceSource::TraceSource(const TraceRing &_ring) {
+    ring = &_ring;
+    seq = ring->oldest();
+    end = ring->added();
+
+    // spans are added when they end, the earliest start is not the oldest entry
+    origin = end > seq ? ring->at(end - 1).startUs : 0;
+    for (uint32_t i = seq; i < end; i++) {
+        if (int32_t(ring->at(i).startUs - origin) < 0) origin = ring->at(i).startUs;
+    }
+}
+
+size_t TraceSource::nextRecord(char *line, size_t size) {
+    // head, one name per track, the spans, tail. Tracks are tid track + 1.
+    const byte addresses[] = BATTERY_ADDRESSES;
+    int len;
+    if (item == 0) {
+        len = snprintf_P(line, size,
+                         PSTR("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[{\"name\":\"process_name\",\"ph\":\"M\","
+                              "\"pid\":1,\"args\":{\"name\":\"battery\"}},{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,"
+                              "\"tid\":%u,\"args\":{\"name\":\"loop\"}}"),
+                         traceLoopTrack + 1);
+        item++;
+    } else if (item <= BATTERY_PACKS) {
+        len = snprintf_P(line, size,
+                         PSTR(",{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%u,"
+                              "\"args\":{\"name\":\"bus pack %d (0x%02x)\"}}"),
+                         traceBusTrack(item - 1) + 1, item - 1, addresses[item - 1]);
+        item++;
+    } else if (seq < end) {
+        // a span overwritten since the start of the download is gone
+        if (seq < ring->oldest()) seq = ring->oldest();
+        const TraceSpan &span = ring->at(seq++);
+        len = snprintf_P(line, size, PSTR(",{\"name\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%u,\"ts\":%lu,\"dur\":%lu"),
+                         traceNames[span.name < TRACE_NAME_COUNT ? span.name : TRACE_LOOP], span.track + 1,
+                         (unsigned long)(span.startUs - origin), (unsigned long)span.durationUs);
+        if (len >= 0 && size_t(len) < size) {
+            if (span.name == TRACE_HANDLER) {
+                len += snprintf_P(line + len, size - len, PSTR(",\"args\":{\"route\":%u}}"), span.arg);
+            } else if (span.name == TRACE_BUS) {
+                len += snprintf_P(line + len, size - len, PSTR(",\"args\":{\"reg\":%u,\"error\":%u}}"), span.arg & 0xFF,
+                                  span.arg >> 8);
+            } else {
+                len += snprintf_P(line + len, size - len, PSTR("}"));
+            }
+        }
+    } else if (item == BATTERY_PACKS + 1) {
+        len = snprintf_P(line, size, PSTR("]}"));
+        item++;
+    } else {
+        return 0;
+    }
+
+    return len < 0 ? 0 : std::min(size_t(len), size - 1);
+}
+
+#endif
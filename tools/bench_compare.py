@@ -0,0 +1,59 @@
+#!/usr/bin/env python3
+"""Compares two runs of the host benchmarks (bench/bench.cpp).
+
+    python3 tools/bench_compare.py before.json after.json --threshold 10
+
+Prints the median time per op of every benchmark in both runs and the change.
+Exits with 1 when one got slower by more than --threshold percent or started
+to allocate, so it can gate a change in a script.
+"""
+import argparse
+import json
+import sys
+
+
+def load(path):
+    with open(path) as f:
+        run = json.load(f)
+    return run, {r["name"]: r for r in run["results"]}
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("before")
+    parser.add_argument("after")
+    parser.add_argument("--threshold", type=float, default=10.0, help="allowed slowdown in percent")
+    args = parser.parse_args()
+
+    before_run, before = load(args.before)
+    after_run, after = load(args.after)
+    if before_run.get("cells") != after_run.get("cells"):
+        print("warning: runs with different BATTERY_CELLS", file=sys.stderr)
+
+    failed = False
+    print(f"{'benchmark':<16} {'unit':<8} {'before ns':>12} {'after ns':>12} {'change':>8}  allocs")
+    for name, new in after.items():
+        old = before.get(name)
+        if old is None:
+            print(f"{name:<16} {new['unit']:<8} {'-':>12} {new['ns_median']:>12.1f} {'new':>8}")
+            continue
+        change = (new["ns_median"] - old["ns_median"]) * 100.0 / old["ns_median"]
+        allocs = f"{old['allocs_per_op']} -> {new['allocs_per_op']}"
+        flag = ""
+        if change > args.threshold:
+            flag = "  SLOWER"
+            failed = True
+        if new["allocs_per_op"] > old["allocs_per_op"] or new["alloc_peak"] > old["alloc_peak"]:
+            flag += "  ALLOCATES"
+            failed = True
+        print(f"{name:<16} {new['unit']:<8} {old['ns_median']:>12.1f} {new['ns_median']:>12.1f} "
+              f"{change:>+7.1f}%  {allocs}{flag}")
+    for name in before:
+        if name not in after:
+            print(f"{name:<16} missing in {args.after}")
+
+    sys.exit(1 if failed else 0)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,190 @@
+#!/usr/bin/env python3
+"""Simulated Ninebot BMS answering 0x5A 0xA5 register reads on a pseudo-terminal.
+
+    python3 tools/bms_sim.py --link /tmp/bms --latency 20 --jitter 10 --drop 0.001 --corrupt 0.01
+
+The slave side of the pty is symlinked to --link, point the native build at it
+with BMS_PORT=/tmp/bms. Every answered, dropped and corrupted frame is counted
+and printed on exit.
+"""
+import argparse
+import os
+import random
+import select
+import signal
+import struct
+import sys
+import termios
+import time
+import tty
+
+BATTERY = 0x22
+CMD_READ = 0x01
+CMD_READ_REPLY = 0x04
+
+
+def checksum(body):
+    """body: len, src, dst, cmd, arg and payload"""
+    return struct.pack("<H", 0xFFFF - (sum(body) & 0xFFFF))
+
+
+def frame(src, dst, cmd, arg, payload):
+    body = bytes([len(payload), src, dst, cmd, arg]) + payload
+    return b"\x5a\xa5" + body + checksum(body)
+
+
+class Pack:
+    """register file of one pack, 16 bit little endian words"""
+
+    def __init__(self, cells, current_ma=-1500, perc=None):
+        self.words = [0] * 0x100
+        self.cells = cells
+        self.factory = 7800
+        self.remaining = 6200.0 if perc is None else self.factory * perc / 100
+        self.current_ma = current_ma
+        self.started = time.monotonic()
+        serial = b"3GCKB1234567890"[:14]
+        for i in range(0, 14, 2):
+            self.words[0x10 + i // 2] = serial[i] | (serial[i + 1] << 8)
+        self.words[0x18] = self.factory
+        self.words[0x19] = 7400
+        self.update()
+
+    def update(self):
+        now = time.monotonic()
+        self.remaining = max(0.0, self.remaining + self.current_ma * (now - self.started) / 3600.0)
+        self.started = now
+        perc = int(self.remaining * 100 / self.factory)
+        cell_mv = [3300 + perc * 9 + random.randint(-8, 8) for _ in range(self.cells)]
+        self.words[0x30] = 0x0001 if self.current_ma > 0 else 0x0000
+        self.words[0x31] = int(self.remaining)
+        self.words[0x32] = perc
+        self.words[0x33] = (self.current_ma // 10 + random.randint(-2, 2)) & 0xFFFF
+        self.words[0x34] = sum(cell_mv) // 10
+        self.words[0x35] = (20 + 24) | ((20 + 25) << 8)
+        for i, mv in enumerate(cell_mv):
+            self.words[0x40 + i] = mv
+
+    def read(self, reg, length):
+        out = bytearray()
+        for i in range((length + 1) // 2):
+            out += struct.pack("<H", self.words[(reg + i) & 0xFF])
+        return bytes(out[:length])
+
+
+class Simulator:
+    def __init__(self, args):
+        self.args = args
+        # one register file per bus address, 0x22 and up, each a little emptier than the one before
+        self.packs = {}
+        for i in range(args.packs):
+            perc = (args.perc if args.perc is not None else 6200 * 100 / 7800) - 5 * i
+            self.packs[BATTERY + i] = Pack(args.cells, args.current, perc)
+        self.rx = bytearray()
+        self.pending = []  # (due, bytes)
+        self.stats = {"requests": 0, "answered": 0, "dropped_bytes": 0, "corrupted": 0, "ignored": 0}
+
+    def requests(self):
+        """pull complete request frames out of self.rx"""
+        while True:
+            start = self.rx.find(b"\x5a\xa5")
+            if start < 0:
+                del self.rx[:-1]
+                return
+            del self.rx[:start]
+            if len(self.rx) < 3:
+                return
+            total = self.rx[2] + 9
+            if len(self.rx) < total:
+                return
+            raw = bytes(self.rx[:total])
+            if raw[-2:] != checksum(raw[2:-2]):
+                del self.rx[:1]
+                self.stats["ignored"] += 1
+                continue
+            del self.rx[:total]
+            yield raw
+
+    def handle(self, raw):
+        self.stats["requests"] += 1
+        src, dst, cmd, arg = raw[3], raw[4], raw[5], raw[6]
+        pack = self.packs.get(dst)
+        if pack is None or cmd != CMD_READ or raw[2] < 1:
+            self.stats["ignored"] += 1
+            return
+        pack.update()
+        reply = bytearray(frame(dst, src, CMD_READ_REPLY, arg, pack.read(arg, raw[7])))
+
+        if random.random() < self.args.corrupt:
+            reply[-2] ^= 0x5A
+            self.stats["corrupted"] += 1
+        if self.args.drop > 0:
+            kept = bytearray()
+            for b in reply:
+                if random.random() < self.args.drop:
+                    self.stats["dropped_bytes"] += 1
+                else:
+                    kept.append(b)
+            reply = kept
+        if random.random() < self.args.noise:
+            reply = bytearray(random.randbytes(random.randint(1, 8))) + reply
+
+        delay = max(0.0, self.args.latency + random.uniform(-self.args.jitter, self.args.jitter)) / 1000.0
+        self.pending.append((time.monotonic() + delay, bytes(reply)))
+        self.stats["answered"] += 1
+
+    def run(self, fd):
+        while True:
+            now = time.monotonic()
+            timeout = min([due for due, _ in self.pending], default=now + 0.1) - now
+            readable, _, _ = select.select([fd], [], [], max(0.0, timeout))
+            if readable:
+                try:
+                    self.rx += os.read(fd, 256)
+                except OSError:
+                    time.sleep(0.05)  # nobody has the slave side open yet
+                for raw in list(self.requests()):
+                    self.handle(raw)
+            now = time.monotonic()
+            for item in [p for p in self.pending if p[0] <= now]:
+                self.pending.remove(item)
+                os.write(fd, item[1])
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--link", default="/tmp/bms", help="symlink created for the slave side of the pty")
+    parser.add_argument("--latency", type=float, default=10.0, help="response latency in ms")
+    parser.add_argument("--jitter", type=float, default=0.0, help="+/- ms added to every response")
+    parser.add_argument("--drop", type=float, default=0.0, help="probability of dropping each response byte")
+    parser.add_argument("--corrupt", type=float, default=0.0, help="probability of a response with a broken checksum")
+    parser.add_argument("--noise", type=float, default=0.0, help="probability of garbage bytes before a response")
+    parser.add_argument("--cells", type=int, default=10)
+    parser.add_argument("--current", type=int, default=-1500, help="pack current in mA, positive charges")
+    parser.add_argument("--perc", type=float, default=None, help="initial remaining capacity in %%")
+    parser.add_argument("--packs", type=int, default=1, help="packs on the bus, at addresses 0x22 and up")
+    parser.add_argument("--seed", type=int, default=None)
+    args = parser.parse_args()
+    random.seed(args.seed)
+
+    master, slave = os.openpty()
+    tty.setraw(slave, termios.TCSANOW)
+    if os.path.lexists(args.link):
+        os.unlink(args.link)
+    os.symlink(os.ttyname(slave), args.link)
+
+    sim = Simulator(args)
+
+    def finish(*_):
+        os.unlink(args.link)
+        print(" ".join("%s=%d" % kv for kv in sim.stats.items()), file=sys.stderr)
+        sys.exit(0)
+
+    signal.signal(signal.SIGINT, finish)
+    signal.signal(signal.SIGTERM, finish)
+    print("simulated bms on %s -> %s" % (args.link, os.ttyname(slave)), file=sys.stderr)
+    sim.run(master)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,167 @@
+#!/usr/bin/env python3
+"""Swarm of HTTP clients against the firmware, host build or device.
+
+    python3 tools/http_load.py --clients 8 --duration 10 --slow 2
+
+Each client requests the --paths in turn as fast as the answers come, on one
+keep-alive connection unless --close. --slow adds clients that request
+/metrics and then read a few bytes per second, like a phone on a bad link;
+they must not slow the others down. Prints requests/s, latency percentiles
+per path and overall, and the errors (503 busy, resets, timeouts).
+"""
+import argparse
+import asyncio
+import collections
+import socket
+import time
+
+DEFAULT_PATHS = "/api/state,/api/state.cbor,/api/packs,/api/stats,/metrics,/dashboard"
+
+
+class Stats:
+    def __init__(self):
+        self.latency = collections.defaultdict(list)
+        self.errors = collections.Counter()
+        self.bytes = 0
+
+
+async def read_response(reader):
+    """returns (status, body length), the body is read and dropped"""
+    status_line = await reader.readline()
+    if not status_line:
+        raise ConnectionResetError("closed")
+    status = int(status_line.split()[1])
+    headers = {}
+    while True:
+        line = await reader.readline()
+        if line in (b"\r\n", b"\n", b""):
+            break
+        name, _, value = line.decode("latin-1").partition(":")
+        headers[name.strip().lower()] = value.strip()
+
+    length = 0
+    if headers.get("transfer-encoding") == "chunked":
+        while True:
+            size = int((await reader.readline()).strip(), 16)
+            await reader.readexactly(size + 2)
+            length += size
+            if size == 0:
+                break
+    elif "content-length" in headers:
+        length = int(headers["content-length"])
+        await reader.readexactly(length)
+    return status, length, headers.get("connection", "").lower() == "close"
+
+
+async def client(args, paths, stats, deadline, offset):
+    conn = None
+    i = offset
+    while time.monotonic() < deadline:
+        path = paths[i % len(paths)]
+        i += 1
+        try:
+            if conn is None:
+                conn = await asyncio.open_connection(args.host, args.port)
+            reader, writer = conn
+            started = time.monotonic()
+            keep = "close" if args.close else "keep-alive"
+            writer.write(f"GET {path} HTTP/1.1\r\nHost: {args.host}\r\nConnection: {keep}\r\n\r\n".encode())
+            status, length, closed = await asyncio.wait_for(read_response(reader), args.timeout)
+            took = time.monotonic() - started
+            if status == 200 or status == 304:
+                stats.latency[path].append(took)
+                stats.bytes += length
+            else:
+                stats.errors[f"http {status}"] += 1
+            if closed or args.close:
+                writer.close()
+                conn = None
+        except asyncio.TimeoutError:
+            stats.errors["timeout"] += 1
+            conn = drop(conn)
+        except (OSError, ValueError, IndexError, asyncio.IncompleteReadError) as e:
+            stats.errors[type(e).__name__] += 1
+            if args.verbose:
+                print(f"{path}: {e!r}")
+            conn = drop(conn)
+            await asyncio.sleep(0.01)
+    drop(conn)
+
+
+def drop(conn):
+    if conn is not None:
+        conn[1].close()
+    return None
+
+
+async def slow_client(args, deadline, stats):
+    """requests /metrics with a tiny receive window and trickles it in"""
+    while time.monotonic() < deadline:
+        sock = socket.socket()
+        sock.setsockopt(socket.SOL_SOCKET, socket.SO_RCVBUF, 1024)
+        sock.setblocking(False)
+        try:
+            await asyncio.get_running_loop().sock_connect(sock, (args.host, args.port))
+            reader, writer = await asyncio.open_connection(sock=sock, limit=64)
+            writer.write(f"GET /metrics HTTP/1.1\r\nHost: {args.host}\r\nConnection: close\r\n\r\n".encode())
+            while time.monotonic() < deadline:
+                data = await reader.read(16)
+                if not data:
+                    stats.errors["slow client done"] += 1
+                    break
+                await asyncio.sleep(1.0)
+            writer.close()
+        except OSError as e:
+            stats.errors[f"slow {type(e).__name__}"] += 1
+            sock.close()
+            await asyncio.sleep(0.5)
+
+
+def percentile(values, p):
+    values = sorted(values)
+    return values[min(len(values) - 1, int(len(values) * p / 100.0))]
+
+
+async def run(args):
+    paths = args.paths.split(",")
+    stats = Stats()
+    deadline = time.monotonic() + args.duration
+    tasks = [slow_client(args, deadline + 1, stats) for _ in range(args.slow)]
+    if args.slow:
+        await asyncio.sleep(0.5)  # the slow ones hold their connections before the swarm starts
+    started = time.monotonic()
+    tasks += [client(args, paths, stats, deadline, n) for n in range(args.clients)]
+    await asyncio.gather(*tasks)
+    elapsed = time.monotonic() - started
+
+    total = [t for values in stats.latency.values() for t in values]
+    print(f"{args.clients} clients, {args.slow} slow, {'close' if args.close else 'keep-alive'}, {elapsed:.1f} s")
+    print(f"{'path':<18} {'requests':>9} {'p50 ms':>8} {'p90 ms':>8} {'p99 ms':>8} {'max ms':>8}")
+    for path in paths + ["all"]:
+        values = total if path == "all" else stats.latency.get(path, [])
+        if not values:
+            print(f"{path:<18} {0:>9}")
+            continue
+        print(f"{path:<18} {len(values):>9} {percentile(values, 50) * 1000:>8.1f} {percentile(values, 90) * 1000:>8.1f} "
+              f"{percentile(values, 99) * 1000:>8.1f} {max(values) * 1000:>8.1f}")
+    print(f"{len(total) / elapsed:.0f} req/s, {stats.bytes / elapsed / 1024:.0f} KiB/s")
+    for error, count in sorted(stats.errors.items()):
+        print(f"  {error}: {count}")
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--host", default="localhost")
+    parser.add_argument("--port", type=int, default=8080)
+    parser.add_argument("--clients", type=int, default=4, help="clients requesting as fast as they can")
+    parser.add_argument("--slow", type=int, default=0, help="clients that barely read")
+    parser.add_argument("--duration", type=float, default=10.0, help="seconds")
+    parser.add_argument("--paths", default=DEFAULT_PATHS, help="comma separated, requested in turn")
+    parser.add_argument("--close", action="store_true", help="new connection per request")
+    parser.add_argument("--verbose", action="store_true", help="print every failed request")
+    parser.add_argument("--timeout", type=float, default=5.0, help="seconds per response")
+    asyncio.run(run(parser.parse_args()))
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,125 @@
+#!/usr/bin/env python3
+"""Minimal MQTT 3.1.1 broker stand-in that accepts QoS 0 publishes and counts them.
+
+    python3 tools/mqtt_sink.py --port 1883 --drop-after 60
+
+Answers CONNECT and PINGREQ, prints every publish with --verbose and a line
+with messages/s and the extrapolated bytes/hour every --report seconds.
+--drop-after closes the connection after that many seconds to exercise the
+reconnect backoff of the publisher.
+"""
+import argparse
+import socket
+import time
+
+CONNECT = 0x10
+CONNACK = 0x20
+PUBLISH = 0x30
+PINGREQ = 0xC0
+PINGRESP = 0xD0
+DISCONNECT = 0xE0
+
+
+def read_packet(buf):
+    """returns (type, body, rest) or None while the packet is incomplete"""
+    if len(buf) < 2:
+        return None
+    length, shift, pos = 0, 0, 1
+    while True:
+        if pos >= len(buf):
+            return None
+        b = buf[pos]
+        length |= (b & 0x7F) << shift
+        shift += 7
+        pos += 1
+        if not b & 0x80:
+            break
+    if len(buf) < pos + length:
+        return None
+    return buf[0] & 0xF0, buf[pos:pos + length], buf[pos + length:]
+
+
+class Stats:
+    def __init__(self):
+        self.started = time.monotonic()
+        self.window = self.started
+        self.messages = 0
+        self.bytes = 0
+        self.window_messages = 0
+        self.connects = 0
+
+    def report(self):
+        now = time.monotonic()
+        rate = self.window_messages / max(now - self.window, 1e-6)
+        per_hour = self.bytes * 3600 / max(now - self.started, 1e-6)
+        print(f"{rate:6.2f} msgs/s, {self.messages} msgs, {self.bytes} bytes, {per_hour:.0f} bytes/h, "
+              f"{self.connects} connects", flush=True)
+        self.window = now
+        self.window_messages = 0
+
+
+def serve(conn, args, stats):
+    accepted = time.monotonic()
+    buf = b""
+    while True:
+        if args.drop_after and time.monotonic() - accepted > args.drop_after:
+            print("dropping connection", flush=True)
+            return
+        # due on time, whether the publisher is quiet or sends all the time
+        left = args.report - (time.monotonic() - stats.window)
+        if left <= 0:
+            stats.report()
+            left = args.report
+        conn.settimeout(left)
+        try:
+            data = conn.recv(4096)
+        except socket.timeout:
+            continue
+        if not data:
+            return
+        stats.bytes += len(data)
+        buf += data
+        while (packet := read_packet(buf)) is not None:
+            kind, body, buf = packet
+            if kind == CONNECT:
+                stats.connects += 1
+                conn.sendall(bytes([CONNACK, 2, 0, 0]))
+            elif kind == PINGREQ:
+                conn.sendall(bytes([PINGRESP, 0]))
+            elif kind == PUBLISH:
+                stats.messages += 1
+                stats.window_messages += 1
+                if args.verbose:
+                    topic_len = int.from_bytes(body[:2], "big")
+                    print(body[2:2 + topic_len].decode(), body[2 + topic_len:].decode(errors="replace"), flush=True)
+            elif kind == DISCONNECT:
+                return
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("--port", type=int, default=1883)
+    parser.add_argument("--report", type=float, default=10.0, help="seconds between statistics lines")
+    parser.add_argument("--drop-after", type=float, default=0.0, help="close every connection after this many seconds")
+    parser.add_argument("--verbose", action="store_true", help="print every publish")
+    args = parser.parse_args()
+
+    stats = Stats()
+    listener = socket.socket(socket.AF_INET, socket.SOCK_STREAM)
+    listener.setsockopt(socket.SOL_SOCKET, socket.SO_REUSEADDR, 1)
+    listener.bind(("", args.port))
+    listener.listen(1)
+    print(f"listening on :{args.port}", flush=True)
+    try:
+        while True:
+            conn, peer = listener.accept()
+            print(f"client {peer[0]}:{peer[1]}", flush=True)
+            with conn:
+                serve(conn, args, stats)
+            stats.report()
+    except KeyboardInterrupt:
+        stats.report()
+
+
+if __name__ == "__main__":
+    main()